@@ -0,0 +1,13 @@
+#pragma once
+#include <dw1000/decadriver/deca_types.h>
+
+double dwt_getrangebias(uint8 chan, float range, uint8 prf);
+
+// Precomputes the bias correction for every 25cm bin of given channel/PRF,
+// so that deca_range_bias() is a single table lookup instead of a table scan
+void deca_range_bias_init(uint8 chan, uint8 prf);
+// Returns the same correction as dwt_getrangebias() for the channel/PRF
+// previously passed to deca_range_bias_init()
+float deca_range_bias(float range);
+// deca_range_bias() for ranges in mm, without floating point
+int deca_range_bias_mm(int range_mm);
@@ -0,0 +1,88 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+struct shell;
+
+// Counters and gauges of the running app, cheap enough to be updated from any context.
+// Metrics are defined statically per target, so every build only carries its own,
+// the simulation runs the gateway pipeline and shares its metrics.
+enum hrtls_metric {
+#if defined(CONFIG_HRTLS_TARGET_ANCHOR) || defined(CONFIG_HRTLS_TARGET_TAG)
+    HRTLS_METRIC_TWR_OK,
+    // TWR results -1..-5, see HRTLS_METRIC_TWR_ERR()
+    HRTLS_METRIC_TWR_ERR_1,
+    HRTLS_METRIC_TWR_ERR_2,
+    HRTLS_METRIC_TWR_ERR_3,
+    HRTLS_METRIC_TWR_ERR_4,
+    HRTLS_METRIC_TWR_ERR_5,
+#endif
+#if defined(CONFIG_HRTLS_TARGET_GW) || defined(CONFIG_HRTLS_TARGET_SIM) || defined(CONFIG_HRTLS_TARGET_TAG)
+    HRTLS_METRIC_MESH_RX,
+#endif
+#if defined(CONFIG_HRTLS_TARGET_TAG)
+    HRTLS_METRIC_SOLVER_FAIL,
+    HRTLS_METRIC_NLOS_REJECTED,
+    HRTLS_METRIC_LOC_QUEUE_DROPS,
+    HRTLS_METRIC_RANGES_QUEUE_DROPS,
+    HRTLS_METRIC_LOC_COALESCED,
+    HRTLS_METRIC_MESH_TX_FAIL,
+    // gauge, mesh sends waiting for their end callback
+    HRTLS_METRIC_MESH_TX_IN_FLIGHT,
+#endif
+#if defined(CONFIG_HRTLS_TARGET_GW) || defined(CONFIG_HRTLS_TARGET_SIM)
+    HRTLS_METRIC_FIXES_RX,
+    HRTLS_METRIC_RANGES_RX,
+    HRTLS_METRIC_DUPLICATES,
+    HRTLS_METRIC_SOLVER_FAIL,
+    HRTLS_METRIC_TRACKER_QUEUE_DROPS,
+    HRTLS_METRIC_RANGES_QUEUE_DROPS,
+    HRTLS_METRIC_ZONE_EVENT_DROPS,
+    HRTLS_METRIC_SCHEDULER_DROPS,
+    // tracks which neither fit into the scheduler nor into the offline log
+    HRTLS_METRIC_TRACK_DROPS,
+    HRTLS_METRIC_PUBLISHES,
+    HRTLS_METRIC_PUBLISH_FAIL,
+    HRTLS_METRIC_OFFLINE_STORED,
+    // offline log sectors rotated out before being drained
+    HRTLS_METRIC_OFFLINE_DROPS,
+    HRTLS_METRIC_MQTT_CONNECTS,
+    // gauge, 1 while the broker is reachable
+    HRTLS_METRIC_MQTT_CONNECTED,
+#endif
+    HRTLS_METRICS_COUNT
+};
+
+#define HRTLS_METRIC_TWR_ERR(res) (HRTLS_METRIC_TWR_ERR_1 - 1 - (res))
+
+// distributions in fixed log-linear buckets, see stats/histogram.h
+enum hrtls_metric_histogram {
+#if defined(CONFIG_HRTLS_TARGET_TAG)
+    // rtls_find_position() duration
+    HRTLS_METRIC_SOLVE_US,
+    // start of the radio wake up until the first poll sent
+    HRTLS_METRIC_WAKEUP_TO_POLL_US,
+#endif
+#if defined(CONFIG_HRTLS_TARGET_GW) || defined(CONFIG_HRTLS_TARGET_SIM)
+    // single multilateration batch
+    HRTLS_METRIC_MULTILAT_US,
+    // MQTT payload of a published position
+    HRTLS_METRIC_PUBLISH_BYTES,
+#endif
+    HRTLS_METRIC_HISTOGRAMS_COUNT
+};
+
+void hrtls_metric_inc(enum hrtls_metric metric);
+void hrtls_metric_add(enum hrtls_metric metric, uint32_t value);
+void hrtls_metric_set(enum hrtls_metric metric, uint32_t value);
+uint32_t hrtls_metric_get(enum hrtls_metric metric);
+const char *hrtls_metric_name(enum hrtls_metric metric);
+
+void hrtls_metric_record(enum hrtls_metric_histogram histogram, uint32_t value);
+const char *hrtls_metric_histogram_name(enum hrtls_metric_histogram histogram);
+
+// zeroes counters and histograms, gauges keep their value
+void hrtls_metrics_reset(void);
+void hrtls_metrics_print(const struct shell *sh);
+// {"<counter>":n,...,"<histogram>":{"count":n,"p50":v,"p99":v},...}, returns length or -ENOMEM
+int hrtls_metrics_to_json(char *buf, size_t size);
@@ -0,0 +1,53 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/sys/util.h>
+
+// Anchor map is split into square regions on the XY plane, versioned separately,
+// so that tags only fetch regions around them which have changed
+#define HRTLS_MAP_REGION_SIZE_MM 16000
+#define HRTLS_MAP_REGION_ANCHORS_MAX 8
+
+struct hrtls_map_anchor {
+    uint16_t addr;
+    int32_t x;
+    int32_t y;
+    int32_t z;
+};
+
+struct hrtls_map_region_id {
+    int8_t x;
+    int8_t y;
+};
+
+// region together with the version of it known to the requester, 0 if unknown
+struct hrtls_map_region_ref {
+    struct hrtls_map_region_id id;
+    uint16_t version;
+};
+
+// tags track regions in a 3x3 neighbourhood of their own
+#define HRTLS_MAP_NEIGHBOURHOOD_REGIONS 9
+
+// le16 addr, le32 x/y/z in mm
+#define HRTLS_MAP_ANCHOR_LEN (2 + 3 * 4)
+// region x/y (i8 each), version (le16)
+#define HRTLS_MAP_REGION_REF_LEN (1 + 1 + 2)
+
+static inline int8_t hrtls_map_region_coord(int32_t coord_mm) {
+    int32_t region = coord_mm >= 0 ? coord_mm / HRTLS_MAP_REGION_SIZE_MM
+                                   : (coord_mm + 1) / HRTLS_MAP_REGION_SIZE_MM - 1;
+    return (int8_t)CLAMP(region, INT8_MIN, INT8_MAX);
+}
+
+static inline struct hrtls_map_region_id hrtls_map_region_of(int32_t x_mm, int32_t y_mm) {
+    return (struct hrtls_map_region_id) {
+        .x = hrtls_map_region_coord(x_mm),
+        .y = hrtls_map_region_coord(y_mm)
+    };
+}
+
+static inline bool hrtls_map_region_eq(struct hrtls_map_region_id a, struct hrtls_map_region_id b) {
+    return a.x == b.x && a.y == b.y;
+}
@@ -1,3 +1,17 @@
 #pragma once
 
 #define HRTLS_COMPANY_ID 0x2137
+
+// group address gateways announce themselves on and accept locations at
+#define HRTLS_GW_GROUP_ADDR 0xC001
+
+// group address all tags subscribe to, for commands common to the whole fleet
+#define HRTLS_TAG_GROUP_ADDR 0xC002
+// tags can be assigned to one of user defined groups at runtime, so that
+// a single multicast command reaches all of them
+#define HRTLS_TAG_USER_GROUP_BASE_ADDR 0xC100
+#define HRTLS_TAG_USER_GROUPS 256
+
+// Segmented access messages carry 12 bytes per segment, which include the
+// 4 byte transport MIC, parameters fitting given segments after a vendor opcode
+#define HRTLS_MODEL_VND_SEGMENTED_MAX_LEN(segments) ((segments) * 12 - 4 - 3)
@@ -1,9 +1,13 @@
 #pragma once
+#include <stddef.h>
 #include <stdint.h>
 
 #include <zephyr/bluetooth/mesh.h>
+#include <zephyr/sys/util.h>
 
+#include <models/anchor_map.h>
 #include <models/common.h>
+#include <models/varint.h>
 
 struct hrtls_model_gw_location {
     int16_t x;
@@ -12,10 +16,45 @@ struct hrtls_model_gw_location {
     int16_t err;
 } __packed;
 
+// decoded location, common for all location push formats, in mm
+struct hrtls_model_gw_fix {
+    uint8_t seq;
+    // receiver's clock once decoded, fixes carry their age rather than the sender's clock
+    uint32_t timestamp_ms;
+    // receiver's clock when the fix arrived, for latency tracing
+    uint32_t rx_ms;
+    int32_t x;
+    int32_t y;
+    int32_t z;
+    uint32_t err;
+};
+
+struct hrtls_model_gw_range {
+    uint16_t anchor_addr;
+    uint32_t distance_mm;
+    // NLOS likelihood scaled to 0..UINT8_MAX
+    uint8_t nlos;
+};
+
 typedef void hrlts_model_gw_loc_push_handler_t(uint16_t sender_addr, const struct hrtls_model_gw_location *location);
+typedef void hrlts_model_gw_fix_push_handler_t(uint16_t sender_addr,
+                                               uint16_t recv_dst,
+                                               const struct hrtls_model_gw_fix fixes[],
+                                               size_t count);
+typedef void hrtls_model_gw_ranges_push_handler_t(uint16_t sender_addr,
+                                                  uint16_t recv_dst,
+                                                  uint8_t seq,
+                                                  const struct hrtls_model_gw_range ranges[],
+                                                  size_t count);
+typedef void hrtls_model_gw_map_get_handler_t(uint16_t sender_addr,
+                                              const struct hrtls_map_region_ref refs[],
+                                              size_t count);
 
 struct hrtls_model_gw_handlers {
     hrlts_model_gw_loc_push_handler_t *push;
+    hrlts_model_gw_fix_push_handler_t *fix_push;
+    hrtls_model_gw_ranges_push_handler_t *ranges_push;
+    hrtls_model_gw_map_get_handler_t *map_get;
 };
 
 #define HRTLS_MODEL_GW_ID 0x0001
@@ -25,6 +64,59 @@ struct hrtls_model_gw_handlers {
 #define HRTLS_MODEL_GW_LOC_PUSH_OPCODE BT_MESH_MODEL_OP_3(0x02, HRTLS_COMPANY_ID)
 #define HRTLS_MODEL_GW_LOC_PUSH_LEN sizeof(struct hrtls_model_gw_location)
 
+// Location v2, a single le64 word so that it still fits an unsegmented PDU, from LSB:
+// seq, age in 64 ms units, log2 of error in cm and signed x/y/z in cm,
+// i.e. up to +-655 m horizontally and +-81 m vertically; out of range values saturate.
+// Age saturates at HRTLS_LOC_V2_AGE_MAX_MS, older fixes have to be sent as a batch of one
+#define HRTLS_MODEL_GW_LOC_PUSH_V2_OPCODE BT_MESH_MODEL_OP_3(0x07, HRTLS_COMPANY_ID)
+#define HRTLS_MODEL_GW_LOC_PUSH_V2_LEN sizeof(uint64_t)
+
+#define HRTLS_LOC_V2_SEQ_BITS 8
+#define HRTLS_LOC_V2_AGE_BITS 4
+#define HRTLS_LOC_V2_ERR_BITS 4
+#define HRTLS_LOC_V2_XY_BITS 17
+#define HRTLS_LOC_V2_Z_BITS 14
+#define HRTLS_LOC_V2_AGE_UNIT_MS 64
+#define HRTLS_LOC_V2_MM_PER_UNIT 10
+#define HRTLS_LOC_V2_AGE_MAX_MS (BIT_MASK(HRTLS_LOC_V2_AGE_BITS) * HRTLS_LOC_V2_AGE_UNIT_MS)
+
+BUILD_ASSERT(HRTLS_LOC_V2_SEQ_BITS + HRTLS_LOC_V2_AGE_BITS + HRTLS_LOC_V2_ERR_BITS +
+             2 * HRTLS_LOC_V2_XY_BITS + HRTLS_LOC_V2_Z_BITS == 64);
+
+// Batch of consecutive fixes: seq of the first fix (u8), age of the first fix in ms
+// when sent (le32) and fix count (u8), followed by varint timestamp delta and zigzag
+// varint x/y/z/err deltas of every fix, the first one relative to zeroed position
+#define HRTLS_MODEL_GW_LOC_BATCH_PUSH_OPCODE BT_MESH_MODEL_OP_3(0x06, HRTLS_COMPANY_ID)
+#define HRTLS_MODEL_GW_LOC_BATCH_HDR_LEN (1 + 4 + 1)
+#define HRTLS_MODEL_GW_LOC_BATCH_FIX_MIN_LEN 5
+#define HRTLS_MODEL_GW_LOC_BATCH_FIX_MAX_LEN (5 * HRTLS_VARINT_MAX_LEN)
+
+// Batches have to fit both the sender's TX_SEG_MAX and the receiver's RX_SEG_MAX, so their
+// length is bounded rather than their fix count, senders flush a batch early once the next
+// fix wouldn't fit; the fix count is bounded by the shortest possible fixes
+#define HRTLS_MODEL_GW_LOC_BATCH_SEGMENTS 5
+#define HRTLS_MODEL_GW_LOC_BATCH_PUSH_MAX_LEN HRTLS_MODEL_VND_SEGMENTED_MAX_LEN(HRTLS_MODEL_GW_LOC_BATCH_SEGMENTS)
+#define HRTLS_MODEL_GW_LOC_BATCH_MAX \
+    ((HRTLS_MODEL_GW_LOC_BATCH_PUSH_MAX_LEN - HRTLS_MODEL_GW_LOC_BATCH_HDR_LEN) / HRTLS_MODEL_GW_LOC_BATCH_FIX_MIN_LEN)
+
+BUILD_ASSERT(HRTLS_MODEL_GW_LOC_BATCH_HDR_LEN + HRTLS_MODEL_GW_LOC_BATCH_FIX_MAX_LEN <=
+             HRTLS_MODEL_GW_LOC_BATCH_PUSH_MAX_LEN);
+
+// Anchor map regions a tag is interested in, as a list of region refs; regions known
+// to the tag in a different version are answered with HRTLS_MODEL_TAG_CONF_UPDATE_OPCODE
+#define HRTLS_MODEL_GW_MAP_GET_OPCODE BT_MESH_MODEL_OP_3(0x09, HRTLS_COMPANY_ID)
+#define HRTLS_MODEL_GW_MAP_GET_MAX_LEN (HRTLS_MAP_NEIGHBOURHOOD_REGIONS * HRTLS_MAP_REGION_REF_LEN)
+
+// Raw TWR ranges of a single positioning cycle, to be solved by the gateway: seq (u8) and
+// range count (u8), followed by anchor address (le16), distance in cm (le16) and scaled
+// NLOS likelihood (u8) of every range
+#define HRTLS_MODEL_GW_RANGES_PUSH_OPCODE BT_MESH_MODEL_OP_3(0x0A, HRTLS_COMPANY_ID)
+#define HRTLS_MODEL_GW_RANGES_MAX 8
+#define HRTLS_MODEL_GW_RANGES_HDR_LEN (1 + 1)
+#define HRTLS_MODEL_GW_RANGE_LEN (2 + 2 + 1)
+#define HRTLS_MODEL_GW_RANGES_PUSH_MAX_LEN \
+    (HRTLS_MODEL_GW_RANGES_HDR_LEN + HRTLS_MODEL_GW_RANGES_MAX * HRTLS_MODEL_GW_RANGE_LEN)
+
 #define HRTLS_MODEL_GW(handlers) \
   BT_MESH_MODEL_VND_CB( \
     HRTLS_COMPANY_ID, \
@@ -34,4 +126,75 @@ struct hrtls_model_gw_handlers {
     handlers, \
     NULL)
 
+static inline uint64_t hrtls_loc_v2_mm_to_field(int32_t value_mm, unsigned bits) {
+    const int32_t max = BIT(bits - 1) - 1;
+    int32_t value = value_mm / HRTLS_LOC_V2_MM_PER_UNIT;
+    return (uint64_t)CLAMP(value, -max, max) & BIT64_MASK(bits);
+}
+
+static inline int32_t hrtls_loc_v2_field_to_mm(uint64_t field, unsigned bits) {
+    int32_t value = (int32_t)(field & BIT64_MASK(bits));
+    if (value & BIT(bits - 1)) {
+        value -= (int32_t)BIT(bits);
+    }
+    return value * HRTLS_LOC_V2_MM_PER_UNIT;
+}
+
+static inline uint64_t hrtls_model_gw_loc_v2_pack(const struct hrtls_model_gw_fix *fix, uint32_t age_ms) {
+    uint32_t age = MIN(age_ms / HRTLS_LOC_V2_AGE_UNIT_MS, BIT_MASK(HRTLS_LOC_V2_AGE_BITS));
+    uint32_t err = MIN(find_msb_set(fix->err / HRTLS_LOC_V2_MM_PER_UNIT), BIT_MASK(HRTLS_LOC_V2_ERR_BITS));
+
+    uint64_t word = 0;
+    unsigned shift = 0;
+    word |= (uint64_t)fix->seq << shift;
+    shift += HRTLS_LOC_V2_SEQ_BITS;
+    word |= (uint64_t)age << shift;
+    shift += HRTLS_LOC_V2_AGE_BITS;
+    word |= (uint64_t)err << shift;
+    shift += HRTLS_LOC_V2_ERR_BITS;
+    word |= hrtls_loc_v2_mm_to_field(fix->x, HRTLS_LOC_V2_XY_BITS) << shift;
+    shift += HRTLS_LOC_V2_XY_BITS;
+    word |= hrtls_loc_v2_mm_to_field(fix->y, HRTLS_LOC_V2_XY_BITS) << shift;
+    shift += HRTLS_LOC_V2_XY_BITS;
+    word |= hrtls_loc_v2_mm_to_field(fix->z, HRTLS_LOC_V2_Z_BITS) << shift;
+    return word;
+}
+
+// error is decoded as the upper bound of its log2 bucket
+static inline void hrtls_model_gw_loc_v2_unpack(uint64_t word, struct hrtls_model_gw_fix *out_fix, uint32_t *out_age_ms) {
+    out_fix->seq = word & BIT64_MASK(HRTLS_LOC_V2_SEQ_BITS);
+    word >>= HRTLS_LOC_V2_SEQ_BITS;
+    *out_age_ms = (word & BIT64_MASK(HRTLS_LOC_V2_AGE_BITS)) * HRTLS_LOC_V2_AGE_UNIT_MS;
+    word >>= HRTLS_LOC_V2_AGE_BITS;
+    out_fix->err = (BIT(word & BIT64_MASK(HRTLS_LOC_V2_ERR_BITS)) - 1) * HRTLS_LOC_V2_MM_PER_UNIT;
+    word >>= HRTLS_LOC_V2_ERR_BITS;
+    out_fix->x = hrtls_loc_v2_field_to_mm(word, HRTLS_LOC_V2_XY_BITS);
+    word >>= HRTLS_LOC_V2_XY_BITS;
+    out_fix->y = hrtls_loc_v2_field_to_mm(word, HRTLS_LOC_V2_XY_BITS);
+    word >>= HRTLS_LOC_V2_XY_BITS;
+    out_fix->z = hrtls_loc_v2_field_to_mm(word, HRTLS_LOC_V2_Z_BITS);
+}
+
+// encoded length of a batched fix, the first fix of a batch follows one with its own timestamp and zeroed position
+static inline size_t hrtls_model_gw_loc_batch_fix_len(const struct hrtls_model_gw_fix *fix,
+                                                      const struct hrtls_model_gw_fix *prev) {
+    return hrtls_varint_len(fix->timestamp_ms - prev->timestamp_ms)
+        + hrtls_varint_len(hrtls_zigzag_encode(fix->x - prev->x))
+        + hrtls_varint_len(hrtls_zigzag_encode(fix->y - prev->y))
+        + hrtls_varint_len(hrtls_zigzag_encode(fix->z - prev->z))
+        + hrtls_varint_len(hrtls_zigzag_encode(fix->err - prev->err));
+}
+
+int hrtls_model_gw_announce(struct bt_mesh_model *gw_model, uint8_t ttl, uint16_t period_ms, uint16_t map_version);
+struct hrtls_model_tag_cmd;
+int hrtls_model_gw_tag_cmd(struct bt_mesh_model *gw_model, uint16_t addr, const struct hrtls_model_tag_cmd *cmd);
+int hrtls_model_gw_map_update(struct bt_mesh_model *gw_model,
+                              uint16_t addr,
+                              uint16_t map_version,
+                              uint8_t part,
+                              uint8_t parts,
+                              const struct hrtls_map_region_ref *region,
+                              const struct hrtls_map_anchor anchors[],
+                              size_t count);
+
 extern const struct bt_mesh_model_op hrtls_model_gw_ops[];
@@ -1,21 +1,106 @@
 #pragma once
+#include <stddef.h>
+#include <stdint.h>
+
 #include <zephyr/bluetooth/mesh.h>
 
+#include <models/anchor_map.h>
 #include <models/common.h>
 #include <models/gw.h>
 
 #define HRTLS_MODEL_TAG_ID 0x0003
+
+// Anchor map region sent in response to HRTLS_MODEL_GW_MAP_GET_OPCODE: map version (le16),
+// index of the region among those sent in the response (u8) and their count (u8), region ref
+// with the current region version, anchor count (u8) and anchors of the region
 #define HRTLS_MODEL_TAG_CONF_UPDATE_OPCODE BT_MESH_MODEL_OP_3(0x05, HRTLS_COMPANY_ID)
+#define HRTLS_MODEL_TAG_CONF_UPDATE_HDR_LEN (2 + 1 + 1 + HRTLS_MAP_REGION_REF_LEN + 1)
+#define HRTLS_MODEL_TAG_CONF_UPDATE_MAX_LEN \
+    (HRTLS_MODEL_TAG_CONF_UPDATE_HDR_LEN + HRTLS_MAP_REGION_ANCHORS_MAX * HRTLS_MAP_ANCHOR_LEN)
+
+// Published by gateways to HRTLS_GW_GROUP_ADDR: initial TTL (u8), announcement period in ms (le16),
+// anchor map version (le16) which changes along with any of the regions
+#define HRTLS_MODEL_TAG_GW_ANNOUNCE_OPCODE BT_MESH_MODEL_OP_3(0x08, HRTLS_COMPANY_ID)
+#define HRTLS_MODEL_TAG_GW_ANNOUNCE_LEN (1 + 2 + 2)
+
+enum hrtls_model_tag_uplink {
+    HRTLS_MODEL_TAG_UPLINK_KEEP = 0,
+    // tag solves its position and sends fixes
+    HRTLS_MODEL_TAG_UPLINK_FIX = 1,
+    // tag sends raw ranges to be solved by the gateway
+    HRTLS_MODEL_TAG_UPLINK_RANGES = 2
+};
+
+// 0 keeps current value of the field
+struct hrtls_model_tag_cmd {
+    uint16_t period_ms;
+    uint8_t uplink;
+    // user group address the tag subscribes to, replacing the previous one
+    uint16_t group_addr;
+};
+
+// Runtime configuration sent to a single tag, a user group or HRTLS_TAG_GROUP_ADDR:
+// positioning period in ms (le16), uplink mode (u8) and user group address (le16)
+#define HRTLS_MODEL_TAG_CMD_OPCODE BT_MESH_MODEL_OP_3(0x0B, HRTLS_COMPANY_ID)
+#define HRTLS_MODEL_TAG_CMD_LEN (2 + 1 + 2)
 
-#define HRTLS_MODEL_TAG \
+typedef void hrtls_model_tag_gw_announce_handler_t(uint16_t gw_addr,
+                                                   uint8_t hops,
+                                                   int8_t rssi,
+                                                   uint16_t period_ms,
+                                                   uint16_t map_version);
+typedef void hrtls_model_tag_map_update_handler_t(uint16_t gw_addr,
+                                                  uint16_t map_version,
+                                                  uint8_t part,
+                                                  uint8_t parts,
+                                                  const struct hrtls_map_region_ref *region,
+                                                  const struct hrtls_map_anchor anchors[],
+                                                  size_t count);
+
+typedef void hrtls_model_tag_cmd_handler_t(uint16_t gw_addr, const struct hrtls_model_tag_cmd *cmd);
+
+struct hrtls_model_tag_handlers {
+    hrtls_model_tag_gw_announce_handler_t *gw_announce;
+    hrtls_model_tag_map_update_handler_t *map_update;
+    hrtls_model_tag_cmd_handler_t *cmd;
+};
+
+#define HRTLS_MODEL_TAG(handlers) \
   BT_MESH_MODEL_VND_CB( \
     HRTLS_COMPANY_ID, \
     HRTLS_MODEL_TAG_ID, \
     hrtls_model_tag_ops, \
     NULL, \
-    NULL, \
+    handlers, \
     NULL)
 
-int hrtls_model_tag_loc_push(struct bt_mesh_model *tag_model, uint16_t addr, struct hrtls_model_gw_location *location);
+// sends a single fix measured age_ms ago in location v2 format
+int hrtls_model_tag_loc_push(struct bt_mesh_model *tag_model,
+                             uint16_t addr,
+                             const struct hrtls_model_gw_fix *fix,
+                             uint32_t age_ms,
+                             const struct bt_mesh_send_cb *cb,
+                             void *cb_data);
+// fixes have to be consecutive, sequence number of each but the first one is implied,
+// the first one was measured first_age_ms ago
+int hrtls_model_tag_loc_batch_push(struct bt_mesh_model *tag_model,
+                                   uint16_t addr,
+                                   const struct hrtls_model_gw_fix fixes[],
+                                   size_t count,
+                                   uint32_t first_age_ms,
+                                   const struct bt_mesh_send_cb *cb,
+                                   void *cb_data);
+
+int hrtls_model_tag_ranges_push(struct bt_mesh_model *tag_model,
+                                uint16_t addr,
+                                uint8_t seq,
+                                const struct hrtls_model_gw_range ranges[],
+                                size_t count,
+                                const struct bt_mesh_send_cb *cb,
+                                void *cb_data);
+int hrtls_model_tag_map_get(struct bt_mesh_model *tag_model,
+                            uint16_t addr,
+                            const struct hrtls_map_region_ref refs[],
+                            size_t count);
 
 extern const struct bt_mesh_model_op hrtls_model_tag_ops[];
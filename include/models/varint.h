@@ -0,0 +1,50 @@
+#pragma once
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/net/buf.h>
+
+// LEB128 encoded uint32_t takes at most 5 bytes
+#define HRTLS_VARINT_MAX_LEN 5
+
+static inline uint32_t hrtls_zigzag_encode(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t hrtls_zigzag_decode(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static inline void hrtls_varint_add(struct net_buf_simple *buf, uint32_t value) {
+    while (value >= 0x80) {
+        net_buf_simple_add_u8(buf, (value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    net_buf_simple_add_u8(buf, value);
+}
+
+static inline size_t hrtls_varint_len(uint32_t value) {
+    size_t len = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        len++;
+    }
+    return len;
+}
+
+static inline int hrtls_varint_pull(struct net_buf_simple *buf, uint32_t *out_value) {
+    uint32_t res = 0;
+    for (unsigned shift = 0; shift < 7 * HRTLS_VARINT_MAX_LEN; shift += 7) {
+        if (!buf->len) {
+            return -EINVAL;
+        }
+        uint8_t byte = net_buf_simple_pull_u8(buf);
+        res |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *out_value = res;
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <stdint.h>
+
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+// Log-linear histogram of ms values, every power of two is split into
+// HRTLS_HISTOGRAM_SUB buckets, so percentiles are within 25% of the real value.
+// Values below HRTLS_HISTOGRAM_SUB get exact buckets, values above ~4 min share the last one.
+#define HRTLS_HISTOGRAM_SUB_BITS 2
+#define HRTLS_HISTOGRAM_SUB BIT(HRTLS_HISTOGRAM_SUB_BITS)
+#define HRTLS_HISTOGRAM_POWERS 16
+#define HRTLS_HISTOGRAM_BUCKETS (HRTLS_HISTOGRAM_SUB * (HRTLS_HISTOGRAM_POWERS + 1))
+
+struct hrtls_histogram {
+    atomic_t counts[HRTLS_HISTOGRAM_BUCKETS];
+};
+
+static inline unsigned hrtls_histogram_bucket(uint32_t value) {
+    if (value < HRTLS_HISTOGRAM_SUB) {
+        return value;
+    }
+    unsigned exp = 31 - __builtin_clz(value);
+    unsigned sub = (value >> (exp - HRTLS_HISTOGRAM_SUB_BITS)) & (HRTLS_HISTOGRAM_SUB - 1);
+    unsigned bucket = HRTLS_HISTOGRAM_SUB * (exp - HRTLS_HISTOGRAM_SUB_BITS + 1) + sub;
+    return MIN(bucket, HRTLS_HISTOGRAM_BUCKETS - 1);
+}
+
+// largest value falling into given bucket
+static inline uint32_t hrtls_histogram_bucket_max(unsigned bucket) {
+    if (bucket < HRTLS_HISTOGRAM_SUB) {
+        return bucket;
+    }
+    unsigned shift = bucket / HRTLS_HISTOGRAM_SUB - 1;
+    unsigned sub = bucket % HRTLS_HISTOGRAM_SUB;
+    return ((HRTLS_HISTOGRAM_SUB + sub + 1) << shift) - 1;
+}
+
+// safe to call from any context, a single atomic increment
+static inline void hrtls_histogram_record(struct hrtls_histogram *histogram, uint32_t value) {
+    atomic_inc(&histogram->counts[hrtls_histogram_bucket(value)]);
+}
+
+static inline uint32_t hrtls_histogram_count(const struct hrtls_histogram *histogram) {
+    uint32_t count = 0;
+    for (unsigned i = 0; i < HRTLS_HISTOGRAM_BUCKETS; i++) {
+        count += atomic_get(&histogram->counts[i]);
+    }
+    return count;
+}
+
+// upper bound of the bucket holding given percentile, 0 if nothing was recorded
+static inline uint32_t hrtls_histogram_percentile(const struct hrtls_histogram *histogram, unsigned percent) {
+    const uint32_t count = hrtls_histogram_count(histogram);
+    const uint32_t target = MAX(((uint64_t)count * percent + 99) / 100, 1);
+    uint32_t seen = 0;
+    for (unsigned i = 0; i < HRTLS_HISTOGRAM_BUCKETS; i++) {
+        seen += atomic_get(&histogram->counts[i]);
+        if (seen >= target) {
+            return hrtls_histogram_bucket_max(i);
+        }
+    }
+    return 0;
+}
+
+static inline void hrtls_histogram_reset(struct hrtls_histogram *histogram) {
+    for (unsigned i = 0; i < HRTLS_HISTOGRAM_BUCKETS; i++) {
+        atomic_set(&histogram->counts[i], 0);
+    }
+}
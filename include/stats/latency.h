@@ -0,0 +1,36 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stats/histogram.h>
+
+struct shell;
+
+// Latency histograms of a pipeline, one per stage, in ms. Apps define their
+// stages as an enum and name them with HRTLS_LATENCY_DEFINE().
+struct hrtls_latency {
+    const char *const *names;
+    struct hrtls_histogram *histograms;
+    size_t count;
+};
+
+// stage names are given as designated initializers indexed by the stage enum
+#define HRTLS_LATENCY_DEFINE(_name, ...)                                                  \
+    static const char *const _name##_stage_names[] = { __VA_ARGS__ };                     \
+    static struct hrtls_histogram _name##_histograms[ARRAY_SIZE(_name##_stage_names)];    \
+    const struct hrtls_latency _name = {                                                  \
+        .names = _name##_stage_names,                                                     \
+        .histograms = _name##_histograms,                                                 \
+        .count = ARRAY_SIZE(_name##_stage_names)                                          \
+    }
+
+void hrtls_latency_record(const struct hrtls_latency *latency, unsigned stage, uint32_t duration_ms);
+// ms elapsed since given k_uptime_get_32() timestamp
+void hrtls_latency_record_since(const struct hrtls_latency *latency, unsigned stage, uint32_t start_ms);
+const char *hrtls_latency_stage_name(const struct hrtls_latency *latency, unsigned stage);
+uint32_t hrtls_latency_count(const struct hrtls_latency *latency, unsigned stage);
+uint32_t hrtls_latency_percentile(const struct hrtls_latency *latency, unsigned stage, unsigned percent);
+void hrtls_latency_reset(const struct hrtls_latency *latency);
+void hrtls_latency_print(const struct hrtls_latency *latency, const struct shell *sh);
+// {"<stage>":{"count":n,"p50":ms,"p99":ms},...}, returns length or -ENOMEM
+int hrtls_latency_to_json(const struct hrtls_latency *latency, char *buf, size_t size);
@@ -0,0 +1,54 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/sys/util.h>
+
+// Binary event trace for per-message paths. Recording an event is a few
+// stores into a RAM ring, without formatting or locking, so it's cheap enough
+// for mesh handlers and the UWB loop. Records are decoded by `trace dump`.
+// Events keep their ids across targets, so a dump can be read without knowing
+// which build it came from.
+enum hrtls_trace_event {
+    // gateway
+    HRTLS_TRACE_MQTT_EVT = 1,    // type, result
+    HRTLS_TRACE_MQTT_PUBLISH_RX, // payload length, message id
+    HRTLS_TRACE_MQTT_INPUT,      // result, duration in us
+    HRTLS_TRACE_MQTT_POLL,       // result, revents
+    HRTLS_TRACE_GW_FIX_RX,       // tag addr, fix count, destination (0 for legacy pushes)
+    HRTLS_TRACE_GW_RANGES_RX,    // tag addr, range count, sequence number
+    HRTLS_TRACE_GW_PUBLISH,      // tag addr, payload length
+    // tag
+    HRTLS_TRACE_TAG_FIX_TX,      // gw addr, fix count, result
+    HRTLS_TRACE_TAG_RANGES_TX,   // gw addr, range count, result
+    HRTLS_TRACE_TAG_POSITION,    // x, y, z in mm
+    HRTLS_TRACE_TAG_SLEEP,       // sleep duration in ms
+    // anchor
+    HRTLS_TRACE_ANCHOR_TWR,      // exchange count, result
+    HRTLS_TRACE_EVENTS_COUNT,
+};
+
+struct hrtls_trace_record {
+    // 0 for never written slots, otherwise position in the trace + 1
+    uint32_t seq;
+    uint32_t cycles;
+    uint16_t event;
+    uint32_t args[3];
+};
+
+#if defined(CONFIG_HRTLS_TRACE)
+void hrtls_trace(enum hrtls_trace_event event, uint32_t a, uint32_t b, uint32_t c);
+
+const char *hrtls_trace_event_name(enum hrtls_trace_event event);
+
+// copies records following *cursor into buf, oldest first, and moves cursor past them;
+// records overwritten before they could be read are skipped and counted in *lost
+size_t hrtls_trace_read(uint32_t *cursor, struct hrtls_trace_record *buf, size_t len, uint32_t *lost);
+
+#define HRTLS_TRACE(event, a, b, c) \
+    hrtls_trace((event), (uint32_t)(a), (uint32_t)(b), (uint32_t)(c))
+#else
+// arguments are still evaluated, so variables used only for tracing don't trigger warnings
+#define HRTLS_TRACE(event, a, b, c) \
+    do { ARG_UNUSED(a); ARG_UNUSED(b); ARG_UNUSED(c); } while (0)
+#endif
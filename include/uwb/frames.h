@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <uwb/utils.h>
+
+// IEEE 802.15.4 data frame, PAN ID compression, 16bit addresses
+#define UWB_FRAME_FCTRL_DATA 0x8841
+#define UWB_FRAME_HDR_LEN 10
+
+#define UWB_FRAME_FUNC_SS_POLL 0xE0
+#define UWB_FRAME_FUNC_SS_RESP 0xE1
+
+// Frame definitions, F(frame, field, length in bytes) for every little
+// endian field following the MAC header and function code
+#define UWB_FRAME_SS_POLL_FIELDS(F, frame)
+
+#define UWB_FRAME_SS_RESP_FIELDS(F, frame) \
+    F(frame, poll_rx_ts, 4) \
+    F(frame, resp_tx_ts, 4)
+
+struct uwb_frame_hdr {
+    uint16_t fctrl;
+    uint8_t seq;
+    uint16_t pan_id;
+    uint16_t dst;
+    uint16_t src;
+};
+
+// Header fields compared by uwb_frame_match(), frame control
+// and function code are always compared
+enum uwb_frame_match_fields {
+    UWB_FRAME_MATCH_SEQ = 1 << 0,
+    UWB_FRAME_MATCH_PAN_ID = 1 << 1,
+    UWB_FRAME_MATCH_DST = 1 << 2,
+    UWB_FRAME_MATCH_SRC = 1 << 3
+};
+
+// Header, including function code, split into words compared at once
+struct uwb_frame_matcher {
+    uint64_t lo_expected;
+    uint64_t lo_mask;
+    uint16_t hi_expected;
+    uint16_t hi_mask;
+};
+
+void uwb_frame_hdr_encode(const struct uwb_frame_hdr *hdr, uint8_t func, uint8_t *buf);
+void uwb_frame_hdr_decode(const uint8_t *buf, struct uwb_frame_hdr *out_hdr);
+void uwb_frame_matcher_init(struct uwb_frame_matcher *matcher,
+                            const struct uwb_frame_hdr *expected,
+                            unsigned fields,
+                            uint8_t func);
+int uwb_frame_match(const struct uwb_frame_matcher *matcher, const uint8_t *buf);
+
+#define UWB_FRAME_FIELD_MEMBER(frame, field, len) \
+    uint64_t field;
+
+// every field takes two enumerators, so that the next one starts right after it
+#define UWB_FRAME_FIELD_OFFSET(frame, field, len) \
+    uwb_frame_##frame##_##field##_offset, \
+    uwb_frame_##frame##_##field##_last = uwb_frame_##frame##_##field##_offset + (len) - 1,
+
+#define UWB_FRAME_FIELD_ENCODE(frame, field, len) \
+    u64_to_buf_le(f->field, buf + uwb_frame_##frame##_##field##_offset, len);
+
+#define UWB_FRAME_FIELD_DECODE(frame, field, len) \
+    out_f->field = buf_le_to_u64(buf + uwb_frame_##frame##_##field##_offset, len);
+
+// Generates struct uwb_frame_<frame>, its length uwb_frame_<frame>_len and
+// uwb_frame_<frame>_{encode,decode,matcher_init}() functions
+#define UWB_FRAME_DEFINE(frame, func, FIELDS) \
+    struct uwb_frame_##frame { \
+        struct uwb_frame_hdr hdr; \
+        FIELDS(UWB_FRAME_FIELD_MEMBER, frame) \
+    }; \
+    enum { \
+        uwb_frame_##frame##_hdr_last = UWB_FRAME_HDR_LEN - 1, \
+        FIELDS(UWB_FRAME_FIELD_OFFSET, frame) \
+        uwb_frame_##frame##_len \
+    }; \
+    static inline void uwb_frame_##frame##_encode(const struct uwb_frame_##frame *f, uint8_t *buf) { \
+        uwb_frame_hdr_encode(&f->hdr, func, buf); \
+        FIELDS(UWB_FRAME_FIELD_ENCODE, frame) \
+    } \
+    static inline void uwb_frame_##frame##_decode(const uint8_t *buf, struct uwb_frame_##frame *out_f) { \
+        uwb_frame_hdr_decode(buf, &out_f->hdr); \
+        FIELDS(UWB_FRAME_FIELD_DECODE, frame) \
+    } \
+    static inline void uwb_frame_##frame##_matcher_init(struct uwb_frame_matcher *matcher, \
+                                                        const struct uwb_frame_hdr *expected, \
+                                                        unsigned fields) { \
+        uwb_frame_matcher_init(matcher, expected, fields, func); \
+    }
+
+UWB_FRAME_DEFINE(ss_poll, UWB_FRAME_FUNC_SS_POLL, UWB_FRAME_SS_POLL_FIELDS)
+UWB_FRAME_DEFINE(ss_resp, UWB_FRAME_FUNC_SS_RESP, UWB_FRAME_SS_RESP_FIELDS)
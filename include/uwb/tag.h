@@ -4,4 +4,8 @@
 
 #include <uwb/uwb.h>
 
-int uwb_tag_twr(uint16_t pan_id, uint16_t self_addr, uint16_t target_addr, float *out_distance_m);
+int uwb_tag_twr(uint16_t pan_id,
+                uint16_t self_addr,
+                uint16_t target_addr,
+                int32_t *out_distance_mm,
+                struct uwb_rx_quality *out_quality);
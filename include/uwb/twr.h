@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <dw1000/decadriver/deca_device_api.h>
+#include <uwb/utils.h>
+
+// DW1000 time units per ms, DWT_TIME_UNITS is the same in s^-1
+#define UWB_DWT_TICKS_PER_MS 63897600
+// FREQ_OFFSET_MULTIPLIER * HERTZ_TO_PPM_MULTIPLIER_CHAN_2 / 1e6, which scales the carrier
+// integrator to the anchor's clock offset ratio, is exactly -2^-30
+#define UWB_CARRIER_INTEGRATOR_SHIFT 30
+
+// SS-TWR distance from the tag's round trip and the anchor's reply time,
+// the anchor's clock offset is estimated from the carrier integrator of its response
+static inline float uwb_ss_twr_distance_m(uint32_t tx_to_rx_tag, uint32_t rx_to_tx_anchor, int32_t carrier_integrator) {
+    float clock_offset_ratio = carrier_integrator * (FREQ_OFFSET_MULTIPLIER * HERTZ_TO_PPM_MULTIPLIER_CHAN_2 / 1e6);
+    float tof = ((tx_to_rx_tag - rx_to_tx_anchor * (1 - clock_offset_ratio)) / 2e0) * DWT_TIME_UNITS;
+    return tof * SPEED_OF_LIGHT_M_S;
+}
+
+// uwb_ss_twr_distance_m() in mm, without floating point
+static inline int32_t uwb_ss_twr_distance_mm(uint32_t tx_to_rx_tag, uint32_t rx_to_tx_anchor, int32_t carrier_integrator) {
+    const int64_t offset = (int64_t)rx_to_tx_anchor * carrier_integrator + ((int64_t)1 << (UWB_CARRIER_INTEGRATOR_SHIFT - 1));
+    const int64_t reply = rx_to_tx_anchor + (offset >> UWB_CARRIER_INTEGRATOR_SHIFT);
+    const int64_t tof_x2 = tx_to_rx_tag - reply;
+    // rounded to nearest, division alone would bias every range towards zero
+    const int64_t divisor = 2 * UWB_DWT_TICKS_PER_MS;
+    const int64_t dist_x_divisor = tof_x2 * SPEED_OF_LIGHT_M_S;
+    return (dist_x_divisor + (dist_x_divisor < 0 ? -divisor : divisor) / 2) / divisor;
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #define GET_BYTE(var, i) (((var) >> ((i) * 8)) % 256)
 #define SET_BYTE(var, i) (((uint64_t)(var)) << ((i) * 8))
 
@@ -10,17 +14,9 @@
 
 #define SPEED_OF_LIGHT_M_S 299702547
 #define UUS_TO_DWT_TIME 65536
-#define TX_ANT_DLY 16436
-#define RX_ANT_DLY 16436
-
-#define SS_POLL_LEN 10
-#define SS_RESP_LEN 18
 
-int masked_memcmp(const uint8_t *left,
-                  const uint8_t *right,
-                  const bool *mask,
-                  size_t len);
 uint64_t buf_le_to_u64(const uint8_t *buf, size_t len);
+void u64_to_buf_le(uint64_t value, uint8_t *buf, size_t len);
 uint32_t wait_for_status(uint32_t mask);
 void clear_status(uint32_t mask);
 uint16_t read_frame_len(void);
@@ -1,9 +1,32 @@
 #pragma once
 
+#include <stdint.h>
+
 enum uwb_twr_mode {
     UWB_TWR_MODE_SS,
     UWB_TWR_MODE_DS
 };
 
+struct uwb_rx_quality {
+    // in 0.01 dBm, INT16_MIN when nothing was received
+    int16_t fp_power_cdbm;
+    int16_t rx_power_cdbm;
+    // 0 for clear line-of-sight, UINT8_MAX when the first path is most likely blocked
+    uint8_t nlos;
+};
+
 extern enum uwb_twr_mode uwb_current_mode;
 int uwb_module_initialize(enum uwb_twr_mode mode);
+// puts DW1000 into deep sleep, keeping its configuration in AON memory
+int uwb_sleep(void);
+// no-op if not sleeping, otherwise restores the radio to the configured state
+int uwb_wakeup(void);
+// duration of the last uwb_wakeup() which actually woke the radio up, datasheet value until then
+uint32_t uwb_last_wakeup_us(void);
+// us since the start of the last uwb_wakeup() which woke the radio up, 0 if already taken since
+uint32_t uwb_take_wakeup_elapsed_us(void);
+// antenna delay used for both TX and RX, in DW1000 time units
+uint16_t uwb_antenna_delay(void);
+// applies given antenna delay and persists it in settings
+int uwb_set_antenna_delay(uint16_t ant_dly);
+void uwb_read_rx_quality(struct uwb_rx_quality *out_quality);
@@ -4,6 +4,8 @@
 #include <zephyr.h>
 #include <zephyr/logging/log.h>
 
+#include <metrics/metrics.h>
+#include <trace/trace.h>
 #include <uwb/uwb.h>
 #include <uwb/anchor.h>
 
@@ -20,8 +22,9 @@ void main(void) {
     while (true) {
         count++;
         res = uwb_anchor_twr(CONFIG_HRTLS_PAN_ID, CONFIG_HRTLS_UWB_ADDR);
+        hrtls_metric_inc(res ? HRTLS_METRIC_TWR_ERR(res) : HRTLS_METRIC_TWR_OK);
         if (res != -2) {
-            LOG_INF("%u anchor twr res: %d", count++, res);
+            HRTLS_TRACE(HRTLS_TRACE_ANCHOR_TWR, count, res, 0);
         }
     }
 }
@@ -0,0 +1,25 @@
+#include <zephyr/shell/shell.h>
+
+#include <metrics/metrics.h>
+
+static int cmd_stats(const struct shell *sh, size_t argc, char **argv) {
+    hrtls_metrics_print(sh);
+    return 0;
+}
+
+static int cmd_stats_reset(const struct shell *sh, size_t argc, char **argv) {
+    hrtls_metrics_reset();
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(stats_cmds,
+    SHELL_CMD(reset, NULL, "Clear counters", cmd_stats_reset),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(hrtls_cmds,
+    SHELL_CMD(stats, &stats_cmds, "Print runtime metrics", cmd_stats),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(hrtls, &hrtls_cmds, "HyperRTLS commands", NULL);
@@ -7,11 +7,10 @@
 
 #include <dw1000/decadriver/deca_device_api.h>
 #include <dw1000/decadriver/deca_regs.h>
+#include <uwb/frames.h>
 #include <uwb/utils.h>
 #include <uwb/anchor.h>
 
-#define TARGET_ADDR_OFFSET 7
-
 LOG_MODULE_REGISTER(anchor);
 
 // measured experimentally
@@ -22,30 +21,22 @@ LOG_MODULE_REGISTER(anchor);
 static int ss_poll_verify(uint16_t pan_id,
                           uint16_t self_addr,
                           const uint8_t *frame) {
-    // TODO: consider X-Macroing the following
-    const uint8_t expected[] = {
-        0x41, 0x88, // header
-        0,
-        GET_BYTE(pan_id, 0), GET_BYTE(pan_id, 1),
-        GET_BYTE(self_addr, 0), GET_BYTE(self_addr, 1),
-        0, 0,
-        0xE0 // poll
-    };
-
-    const bool mask[] = {
-        true, true,
-        false,
-        true, true,
-        true, true,
-        false, false,
-        true
-    };
-
-    static_assert(ARRAY_SIZE(expected) == SS_POLL_LEN);
-    static_assert(ARRAY_SIZE(mask) == SS_POLL_LEN);
+    // rebuilt only when own addressing changes
+    static struct uwb_frame_matcher matcher;
+    static struct uwb_frame_hdr matched_header;
+
+    if (!matched_header.fctrl || matched_header.pan_id != pan_id || matched_header.dst != self_addr) {
+        matched_header = (struct uwb_frame_hdr) {
+            .fctrl = UWB_FRAME_FCTRL_DATA,
+            .pan_id = pan_id,
+            .dst = self_addr
+        };
+        uwb_frame_ss_poll_matcher_init(&matcher,
+                                       &matched_header,
+                                       UWB_FRAME_MATCH_PAN_ID | UWB_FRAME_MATCH_DST);
+    }
 
-    return masked_memcmp(expected, frame,
-                         mask, SS_POLL_LEN);
+    return uwb_frame_match(&matcher, frame);
 }
 
 static void ss_response_build(uint16_t pan_id,
@@ -55,22 +46,19 @@ static void ss_response_build(uint16_t pan_id,
                               uint64_t resp_tx_ts,
                               uint8_t frame_seq_nb,
                               uint8_t *frame) {
-    const uint8_t response[] = {
-        0x41, 0x88, // header
-        frame_seq_nb,
-        GET_BYTE(pan_id, 0), GET_BYTE(pan_id, 1),
-        GET_BYTE(target_addr, 0), GET_BYTE(target_addr, 1),
-        GET_BYTE(self_addr, 0), GET_BYTE(self_addr, 1),
-        0xE1, // response
-        GET_BYTE(poll_rx_ts, 0), GET_BYTE(poll_rx_ts, 1),
-        GET_BYTE(poll_rx_ts, 2), GET_BYTE(poll_rx_ts, 3),
-        GET_BYTE(resp_tx_ts, 0), GET_BYTE(resp_tx_ts, 1),
-        GET_BYTE(resp_tx_ts, 2), GET_BYTE(resp_tx_ts, 3)
+    const struct uwb_frame_ss_resp response = {
+        .hdr = {
+            .fctrl = UWB_FRAME_FCTRL_DATA,
+            .seq = frame_seq_nb,
+            .pan_id = pan_id,
+            .dst = target_addr,
+            .src = self_addr
+        },
+        .poll_rx_ts = poll_rx_ts,
+        .resp_tx_ts = resp_tx_ts
     };
 
-    static_assert(sizeof(response) == SS_RESP_LEN);
-
-    memcpy(frame, response, SS_RESP_LEN);
+    uwb_frame_ss_resp_encode(&response, frame);
 }
 
 static int uwb_anchor_twr_ss(uint16_t pan_id, uint16_t self_addr) {
@@ -84,7 +72,7 @@ static int uwb_anchor_twr_ss(uint16_t pan_id, uint16_t self_addr) {
         return -2;
     }
 
-    uint8_t poll_buf[SS_POLL_LEN];
+    uint8_t poll_buf[uwb_frame_ss_poll_len];
     if (read_frame(poll_buf, ARRAY_SIZE(poll_buf))) {
         return -3;
     }
@@ -92,20 +80,22 @@ static int uwb_anchor_twr_ss(uint16_t pan_id, uint16_t self_addr) {
         return -4;
     }
 
-    uint16_t target_addr = (uint16_t)buf_le_to_u64(poll_buf + TARGET_ADDR_OFFSET, 2);
+    struct uwb_frame_hdr poll_header;
+    uwb_frame_hdr_decode(poll_buf, &poll_header);
+    uint16_t target_addr = poll_header.src;
 
     uint8_t poll_rx_ts_buf[5];
     dwt_readrxtimestamp(poll_rx_ts_buf);
 
     uint64_t poll_rx_ts = buf_le_to_u64(poll_rx_ts_buf, ARRAY_SIZE(poll_rx_ts_buf));
     uint32_t resp_tx_dt = TS_TO_DT(poll_rx_ts + UUS_TO_DWT_TIME * SS_POLL_RX_RESP_TX_DLY_UUS);
-    uint64_t resp_tx_ts = DT_TO_TS(resp_tx_dt) + TX_ANT_DLY;
+    uint64_t resp_tx_ts = DT_TO_TS(resp_tx_dt) + uwb_antenna_delay();
 
     dwt_setdelayedtrxtime(resp_tx_dt);
 
-    uint8_t response_buf[SS_RESP_LEN];
+    uint8_t response_buf[uwb_frame_ss_resp_len];
     ss_response_build(pan_id, self_addr, target_addr, poll_rx_ts, resp_tx_ts, frame_seq_nb, response_buf);
-    if (send_frame_ack(DWT_START_TX_DELAYED, response_buf, SS_RESP_LEN)) {
+    if (send_frame_ack(DWT_START_TX_DELAYED, response_buf, ARRAY_SIZE(response_buf))) {
         return -5;
     }
     frame_seq_nb++;
@@ -0,0 +1,284 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <zephyr/data/json.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "anchor_map.h"
+
+LOG_MODULE_REGISTER(anchor_map);
+
+#define CONFIG_TOPIC_PREFIX "gateways/gateway_1/anchors/"
+// unicast mesh addresses are 0x0001..0x7fff
+#define ADDR_MAX 0x7fff
+
+// {"x":2340,"y":1570,"z":4310,"bias_mm":120} in mm, bias is optional,
+// an empty payload removes the anchor
+struct anchor_json {
+    int32_t x;
+    int32_t y;
+    int32_t z;
+    int32_t bias_mm;
+};
+
+static const struct json_obj_descr anchor_json_descr[] = {
+    JSON_OBJ_DESCR_PRIM(struct anchor_json, x, JSON_TOK_NUMBER),
+    JSON_OBJ_DESCR_PRIM(struct anchor_json, y, JSON_TOK_NUMBER),
+    JSON_OBJ_DESCR_PRIM(struct anchor_json, z, JSON_TOK_NUMBER),
+    JSON_OBJ_DESCR_PRIM(struct anchor_json, bias_mm, JSON_TOK_NUMBER),
+};
+
+struct region {
+    struct hrtls_map_region_ref ref;
+    size_t count;
+    struct hrtls_map_anchor anchors[HRTLS_MAP_REGION_ANCHORS_MAX];
+    // range bias of every anchor, only used by the gateway itself
+    int32_t bias_mm[HRTLS_MAP_REGION_ANCHORS_MAX];
+};
+
+static const struct hrtls_map_anchor default_anchors[] = {
+    { .addr = 1, .x = 2340, .y = 1570, .z = 4310 }, // shelf
+    { .addr = 2, .x = 270, .y = 2310, .z = 5010 },  // corner of window
+    { .addr = 3, .x = 2560, .y = 2360, .z = 580 },  // wardrobe
+    { .addr = 4, .x = 140, .y = 50, .z = 20 },      // door
+};
+
+// regions are never freed, so that their versions keep growing even when they get emptied
+static struct region regions[CONFIG_HRTLS_GW_MAP_REGIONS];
+static size_t regions_count;
+// 0 is reserved for "unknown" on both map and region level
+static uint16_t map_version = 1;
+static K_MUTEX_DEFINE(lock);
+
+static uint16_t next_version(uint16_t version) {
+    return version == UINT16_MAX ? 1 : version + 1;
+}
+
+static struct region *find_region(struct hrtls_map_region_id id) {
+    for (size_t i = 0; i < regions_count; i++) {
+        if (hrtls_map_region_eq(regions[i].ref.id, id)) {
+            return &regions[i];
+        }
+    }
+    return NULL;
+}
+
+static struct region *find_anchor(uint16_t addr, size_t *out_index) {
+    for (size_t i = 0; i < regions_count; i++) {
+        for (size_t j = 0; j < regions[i].count; j++) {
+            if (regions[i].anchors[j].addr == addr) {
+                *out_index = j;
+                return &regions[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+static void bump_version(struct region *region) {
+    region->ref.version = next_version(region->ref.version);
+    map_version = next_version(map_version);
+}
+
+static void remove_anchor(struct region *region, size_t index) {
+    region->count--;
+    region->anchors[index] = region->anchors[region->count];
+    region->bias_mm[index] = region->bias_mm[region->count];
+    bump_version(region);
+}
+
+void anchor_map_initialize(void) {
+    for (size_t i = 0; i < ARRAY_SIZE(default_anchors); i++) {
+        int err = anchor_map_set(&default_anchors[i]);
+        if (err) {
+            LOG_ERR("Couldn't add anchor %" PRIu16 ", %d", default_anchors[i].addr, err);
+        }
+    }
+}
+
+int anchor_map_set(const struct hrtls_map_anchor *anchor) {
+    const struct hrtls_map_region_id id = hrtls_map_region_of(anchor->x, anchor->y);
+
+    k_mutex_lock(&lock, K_FOREVER);
+
+    int res = 0;
+    size_t index;
+    struct region *prev_region = find_anchor(anchor->addr, &index);
+    struct region *region = find_region(id);
+    if (prev_region == region && region) {
+        // retained configuration comes again on every reconnect, it mustn't make tags resync
+        const struct hrtls_map_anchor *prev = &region->anchors[index];
+        if (prev->x != anchor->x || prev->y != anchor->y || prev->z != anchor->z) {
+            region->anchors[index] = *anchor;
+            bump_version(region);
+        }
+        goto out;
+    }
+
+    if (!region) {
+        if (regions_count == ARRAY_SIZE(regions)) {
+            res = -ENOMEM;
+            goto out;
+        }
+        region = &regions[regions_count++];
+        *region = (struct region) {
+            .ref.id = id
+        };
+    }
+    if (region->count == ARRAY_SIZE(region->anchors)) {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    int32_t bias_mm = 0;
+    if (prev_region) {
+        bias_mm = prev_region->bias_mm[index];
+        remove_anchor(prev_region, index);
+    }
+    region->anchors[region->count] = *anchor;
+    region->bias_mm[region->count] = bias_mm;
+    region->count++;
+    bump_version(region);
+
+out:
+    k_mutex_unlock(&lock);
+    return res;
+}
+
+static int parse_config_addr(const char *topic, size_t topic_len, uint16_t *out_addr) {
+    char addr_str[sizeof("7fff")];
+    const size_t prefix_len = strlen(CONFIG_TOPIC_PREFIX);
+    const size_t addr_len = topic_len - prefix_len;
+    if (!addr_len || addr_len >= sizeof(addr_str)) {
+        return -EINVAL;
+    }
+    memcpy(addr_str, topic + prefix_len, addr_len);
+    addr_str[addr_len] = '\0';
+
+    char *end;
+    const unsigned long addr = strtoul(addr_str, &end, 16);
+    if (*end || !addr || addr > ADDR_MAX) {
+        return -EINVAL;
+    }
+    *out_addr = addr;
+    return 0;
+}
+
+int anchor_map_handle_publish(const char *topic, size_t topic_len, uint8_t *payload, size_t len) {
+    const size_t prefix_len = strlen(CONFIG_TOPIC_PREFIX);
+    if (topic_len < prefix_len || memcmp(topic, CONFIG_TOPIC_PREFIX, prefix_len)) {
+        return -ENOENT;
+    }
+
+    uint16_t addr;
+    int err = parse_config_addr(topic, topic_len, &addr);
+    if (err) {
+        LOG_WRN("Invalid anchor address: %.*s", (int)topic_len, topic);
+        return err;
+    }
+
+    // clearing the retained message takes the anchor out of the map
+    if (!len) {
+        err = anchor_map_remove(addr);
+        if (!err) {
+            LOG_INF("Anchor 0x%04" PRIx16 " removed", addr);
+        }
+        return err == -ENOENT ? 0 : err;
+    }
+
+    struct anchor_json json = { 0 };
+    int64_t fields = json_obj_parse((char *)payload, len, anchor_json_descr, ARRAY_SIZE(anchor_json_descr), &json);
+    if (fields < 0 || (fields & BIT_MASK(3)) != BIT_MASK(3)) {
+        LOG_WRN("Invalid configuration of anchor 0x%04" PRIx16 ", %d", addr, (int)fields);
+        return fields < 0 ? fields : -EINVAL;
+    }
+
+    const struct hrtls_map_anchor anchor = {
+        .addr = addr,
+        .x = json.x,
+        .y = json.y,
+        .z = json.z
+    };
+    err = anchor_map_set(&anchor);
+    if (err) {
+        LOG_WRN("Couldn't set anchor 0x%04" PRIx16 ", %d", addr, err);
+        return err;
+    }
+    // a missing bias clears the previous one, the retained message describes the whole anchor
+    err = anchor_map_set_bias(addr, json.bias_mm);
+    if (err) {
+        return err;
+    }
+
+    LOG_INF("Anchor 0x%04" PRIx16 " at %" PRId32 ", %" PRId32 ", %" PRId32 " mm, bias %" PRId32 " mm",
+            addr, json.x, json.y, json.z, json.bias_mm);
+    return 0;
+}
+
+int anchor_map_remove(uint16_t addr) {
+    k_mutex_lock(&lock, K_FOREVER);
+
+    size_t index;
+    struct region *region = find_anchor(addr, &index);
+    if (region) {
+        remove_anchor(region, index);
+    }
+
+    k_mutex_unlock(&lock);
+    return region ? 0 : -ENOENT;
+}
+
+int anchor_map_set_bias(uint16_t addr, int32_t bias_mm) {
+    k_mutex_lock(&lock, K_FOREVER);
+
+    size_t index;
+    struct region *region = find_anchor(addr, &index);
+    if (region) {
+        region->bias_mm[index] = bias_mm;
+    }
+
+    k_mutex_unlock(&lock);
+    return region ? 0 : -ENOENT;
+}
+
+int anchor_map_find(uint16_t addr, struct hrtls_map_anchor *out_anchor, int32_t *out_bias_mm) {
+    k_mutex_lock(&lock, K_FOREVER);
+
+    size_t index;
+    const struct region *region = find_anchor(addr, &index);
+    if (region) {
+        *out_anchor = region->anchors[index];
+        *out_bias_mm = region->bias_mm[index];
+    }
+
+    k_mutex_unlock(&lock);
+    return region ? 0 : -ENOENT;
+}
+
+uint16_t anchor_map_version(void) {
+    k_mutex_lock(&lock, K_FOREVER);
+    uint16_t res = map_version;
+    k_mutex_unlock(&lock);
+    return res;
+}
+
+size_t anchor_map_region(struct hrtls_map_region_ref *region,
+                         struct hrtls_map_anchor out_anchors[HRTLS_MAP_REGION_ANCHORS_MAX]) {
+    k_mutex_lock(&lock, K_FOREVER);
+
+    size_t count = 0;
+    const struct region *found = find_region(region->id);
+    region->version = found ? found->ref.version : 0;
+    if (found) {
+        count = found->count;
+        memcpy(out_anchors, found->anchors, count * sizeof(*out_anchors));
+    }
+
+    k_mutex_unlock(&lock);
+    return count;
+}
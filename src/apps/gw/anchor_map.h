@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <models/anchor_map.h>
+
+// retained configuration of single anchors by their hex mesh address, see anchor_map.c for the format
+#define ANCHOR_MAP_CONFIG_TOPIC "gateways/gateway_1/anchors/+"
+
+// loads the initial anchor map
+void anchor_map_initialize(void);
+// adds, moves or removes the anchor published on ANCHOR_MAP_CONFIG_TOPIC,
+// returns -ENOENT if it's a different topic
+int anchor_map_handle_publish(const char *topic, size_t topic_len, uint8_t *payload, size_t len);
+// adds or moves an anchor, bumping versions of affected regions
+int anchor_map_set(const struct hrtls_map_anchor *anchor);
+int anchor_map_remove(uint16_t addr);
+// bias is subtracted from raw ranges to the anchor, it's not part of the distributed map
+int anchor_map_set_bias(uint16_t addr, int32_t bias_mm);
+int anchor_map_find(uint16_t addr, struct hrtls_map_anchor *out_anchor, int32_t *out_bias_mm);
+uint16_t anchor_map_version(void);
+// fills in current version of region->id, 0 if it has never held anchors,
+// and copies its anchors into out_anchors, returns their count
+size_t anchor_map_region(struct hrtls_map_region_ref *region,
+                         struct hrtls_map_anchor out_anchors[HRTLS_MAP_REGION_ANCHORS_MAX]);
@@ -0,0 +1,75 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "dedup.h"
+#include "registry.h"
+
+LOG_MODULE_REGISTER(dedup);
+
+// number of sequence numbers up to the newest one checked for relayed copies
+#define WINDOW_LEN 32
+// relayed copies arrive well within that, a longer silence means the tag
+// may have rebooted or skipped past half of the sequence number space
+#define RESET_GAP_MS 2000
+
+struct source {
+    // generation of the registry slot the window belongs to
+    uint16_t generation;
+    uint8_t last_seq;
+    uint32_t window;
+    uint32_t last_ms;
+};
+
+// indexed by registry slots, accessed from mesh RX context only
+static struct source sources[CONFIG_HRTLS_GW_TRACKED_TAGS];
+
+bool dedup_is_duplicate(uint16_t sender_addr, uint8_t seq) {
+    const struct registry_slot slot = registry_lookup(sender_addr);
+    struct source *source = &sources[slot.index];
+    const uint32_t now = k_uptime_get_32();
+    const int8_t diff = (int8_t)(seq - source->last_seq);
+
+    // a jump back past the window is a restarted sequence rather than a copy that old
+    if (source->generation != slot.generation || !source->window
+        || now - source->last_ms > RESET_GAP_MS || diff <= -WINDOW_LEN) {
+        *source = (struct source) {
+            .generation = slot.generation,
+            .last_seq = seq,
+            .window = BIT(0),
+            .last_ms = now
+        };
+        return false;
+    }
+    source->last_ms = now;
+
+    if (diff > 0) {
+        source->window = diff < WINDOW_LEN ? (source->window << diff) | BIT(0) : BIT(0);
+        source->last_seq = seq;
+        return false;
+    }
+
+    unsigned offset = -diff;
+    if (source->window & BIT(offset)) {
+        return true;
+    }
+
+    source->window |= BIT(offset);
+    return false;
+}
+
+// Kconfig ranges can't refer to each other, a gateway past the count would own no tags
+BUILD_ASSERT(CONFIG_HRTLS_GW_INDEX < CONFIG_HRTLS_GW_COUNT,
+             "CONFIG_HRTLS_GW_INDEX must be below CONFIG_HRTLS_GW_COUNT");
+
+bool dedup_is_owned(uint16_t sender_addr) {
+    if (CONFIG_HRTLS_GW_COUNT == 1) {
+        return true;
+    }
+
+    // Fibonacci hashing, so that consecutive addresses spread evenly
+    uint32_t hash = ((uint32_t)sender_addr * 2654435761u) >> 16;
+    return hash % CONFIG_HRTLS_GW_COUNT == CONFIG_HRTLS_GW_INDEX;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// records given fix, returns true if it has been seen already
+bool dedup_is_duplicate(uint16_t sender_addr, uint8_t seq);
+// deterministic split of tags between CONFIG_HRTLS_GW_COUNT gateways
+bool dedup_is_owned(uint16_t sender_addr);
@@ -0,0 +1,209 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <zephyr/bluetooth/mesh.h>
+#include <zephyr/data/json.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <models/common.h>
+#include <models/tag.h>
+
+#include "mesh/mesh.h"
+#include "downlink.h"
+
+LOG_MODULE_REGISTER(downlink);
+
+#define TOPIC_PREFIX "gateways/gateway_1/"
+#define TOPIC_TAGS "tags/"
+#define TOPIC_GROUPS "groups/"
+#define TOPIC_SUFFIX "/cmd"
+#define TOPIC_ALL_TAGS "all"
+
+#define DOWNLINK_QUEUE_LEN 8
+
+struct downlink_cmd {
+    uint16_t addr;
+    struct hrtls_model_tag_cmd cmd;
+};
+
+// {"period_ms":500,"uplink":"ranges","group":3}, all fields optional
+struct cmd_json {
+    int32_t period_ms;
+    const char *uplink;
+    int32_t group;
+};
+
+static const struct json_obj_descr cmd_json_descr[] = {
+    JSON_OBJ_DESCR_PRIM(struct cmd_json, period_ms, JSON_TOK_NUMBER),
+    JSON_OBJ_DESCR_PRIM(struct cmd_json, uplink, JSON_TOK_STRING),
+    JSON_OBJ_DESCR_PRIM(struct cmd_json, group, JSON_TOK_NUMBER),
+};
+
+static void downlink_work_handler(struct k_work *work);
+static K_WORK_DEFINE(downlink_work, downlink_work_handler);
+K_MSGQ_DEFINE(downlink_queue, sizeof(struct downlink_cmd), DOWNLINK_QUEUE_LEN, 4);
+
+static void downlink_work_handler(struct k_work *work) {
+    struct downlink_cmd downlink_cmd;
+    while (!k_msgq_get(&downlink_queue, &downlink_cmd, K_NO_WAIT)) {
+        int err = mesh_send_tag_cmd(downlink_cmd.addr, &downlink_cmd.cmd);
+        if (err) {
+            LOG_WRN("Command to addr 0x%04" PRIx16 " failed, %d", downlink_cmd.addr, err);
+        }
+        else {
+            LOG_INF("Command sent to addr 0x%04" PRIx16, downlink_cmd.addr);
+        }
+    }
+}
+
+static bool consume(const char **str, size_t *len, const char *token) {
+    size_t token_len = strlen(token);
+    if (*len < token_len || memcmp(*str, token, token_len)) {
+        return false;
+    }
+    *str += token_len;
+    *len -= token_len;
+    return true;
+}
+
+static int parse_number(const char *str, size_t len, unsigned base, uint32_t max, uint32_t *out) {
+    if (!len || len > 8) {
+        return -EINVAL;
+    }
+
+    uint32_t value = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = str[i];
+        unsigned digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        }
+        else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        }
+        else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        }
+        else {
+            return -EINVAL;
+        }
+        if (digit >= base) {
+            return -EINVAL;
+        }
+        value = value * base + digit;
+    }
+
+    if (value > max) {
+        return -ERANGE;
+    }
+    *out = value;
+    return 0;
+}
+
+// resolves "tags/<addr>/cmd" or "groups/<n>/cmd" into a mesh destination
+static int parse_topic(const char *topic, size_t len, uint16_t *out_addr) {
+    if (!consume(&topic, &len, TOPIC_PREFIX)) {
+        return -ENOENT;
+    }
+
+    bool group = false;
+    if (consume(&topic, &len, TOPIC_GROUPS)) {
+        group = true;
+    }
+    else if (!consume(&topic, &len, TOPIC_TAGS)) {
+        return -ENOENT;
+    }
+
+    const size_t suffix_len = strlen(TOPIC_SUFFIX);
+    if (len < suffix_len || memcmp(topic + len - suffix_len, TOPIC_SUFFIX, suffix_len)) {
+        return -ENOENT;
+    }
+    len -= suffix_len;
+
+    uint32_t value;
+    if (group) {
+        if (parse_number(topic, len, 10, HRTLS_TAG_USER_GROUPS - 1, &value)) {
+            return -EINVAL;
+        }
+        *out_addr = HRTLS_TAG_USER_GROUP_BASE_ADDR + value;
+        return 0;
+    }
+
+    if (len == strlen(TOPIC_ALL_TAGS) && !memcmp(topic, TOPIC_ALL_TAGS, len)) {
+        *out_addr = HRTLS_TAG_GROUP_ADDR;
+        return 0;
+    }
+
+    if (parse_number(topic, len, 16, UINT16_MAX, &value) || !BT_MESH_ADDR_IS_UNICAST(value)) {
+        return -EINVAL;
+    }
+    *out_addr = value;
+    return 0;
+}
+
+static int parse_payload(uint8_t *payload, size_t len, struct hrtls_model_tag_cmd *out_cmd) {
+    struct cmd_json json = { 0 };
+    int64_t fields = json_obj_parse((char *)payload, len, cmd_json_descr, ARRAY_SIZE(cmd_json_descr), &json);
+    if (fields < 0) {
+        return fields;
+    }
+
+    *out_cmd = (struct hrtls_model_tag_cmd) { 0 };
+
+    if (fields & BIT(0)) {
+        if (json.period_ms <= 0 || json.period_ms > UINT16_MAX) {
+            return -ERANGE;
+        }
+        out_cmd->period_ms = json.period_ms;
+    }
+
+    if (fields & BIT(1)) {
+        if (!strcmp(json.uplink, "fix")) {
+            out_cmd->uplink = HRTLS_MODEL_TAG_UPLINK_FIX;
+        }
+        else if (!strcmp(json.uplink, "ranges")) {
+            out_cmd->uplink = HRTLS_MODEL_TAG_UPLINK_RANGES;
+        }
+        else {
+            return -EINVAL;
+        }
+    }
+
+    if (fields & BIT(2)) {
+        if (json.group < 0 || json.group >= HRTLS_TAG_USER_GROUPS) {
+            return -ERANGE;
+        }
+        out_cmd->group_addr = HRTLS_TAG_USER_GROUP_BASE_ADDR + json.group;
+    }
+
+    return 0;
+}
+
+int downlink_handle_publish(const char *topic, size_t topic_len, uint8_t *payload, size_t len) {
+    struct downlink_cmd downlink_cmd;
+
+    int err = parse_topic(topic, topic_len, &downlink_cmd.addr);
+    if (err) {
+        if (err != -ENOENT) {
+            LOG_WRN("Invalid command destination: %.*s", (int)topic_len, topic);
+        }
+        return err;
+    }
+
+    err = parse_payload(payload, len, &downlink_cmd.cmd);
+    if (err) {
+        LOG_WRN("Invalid command payload, %d", err);
+        return err;
+    }
+
+    if (k_msgq_put(&downlink_queue, &downlink_cmd, K_NO_WAIT)) {
+        LOG_WRN("Couldn't fit command into queue");
+        return -ENOMEM;
+    }
+    k_work_submit(&downlink_work);
+    return 0;
+}
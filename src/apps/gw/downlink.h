@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// commands for a single tag (hex mesh address) or for all of them ("all")
+#define DOWNLINK_TAG_TOPIC "gateways/gateway_1/tags/+/cmd"
+// commands for tags assigned to user group 0..HRTLS_TAG_USER_GROUPS-1
+#define DOWNLINK_GROUP_TOPIC "gateways/gateway_1/groups/+/cmd"
+
+// parses a command published on one of downlink topics and queues it for
+// sending over mesh, returns -ENOENT if the topic isn't a downlink one
+int downlink_handle_publish(const char *topic, size_t topic_len, uint8_t *payload, size_t len);
@@ -0,0 +1,16 @@
+#include <zephyr/kernel.h>
+
+#include <stats/latency.h>
+
+#include "latency.h"
+
+HRTLS_LATENCY_DEFINE(latency,
+    [LATENCY_TAG] = "tag",
+    [LATENCY_SOLVE] = "solve",
+    [LATENCY_TRACK] = "track",
+    [LATENCY_QUEUE] = "queue",
+    [LATENCY_PUBLISH] = "publish",
+    [LATENCY_TOTAL] = "total"
+);
+
+BUILD_ASSERT(ARRAY_SIZE(latency_stage_names) == LATENCY_STAGES_COUNT);
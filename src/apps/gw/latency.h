@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stats/latency.h>
+
+enum latency_stage {
+    // fix measured by the tag until received over mesh
+    LATENCY_TAG,
+    // raw ranges received until solved
+    LATENCY_SOLVE,
+    // fix received until its track got updated
+    LATENCY_TRACK,
+    // track updated until picked by the publish scheduler
+    LATENCY_QUEUE,
+    // single MQTT publish call
+    LATENCY_PUBLISH,
+    // fix received until published
+    LATENCY_TOTAL,
+    LATENCY_STAGES_COUNT
+};
+
+// published periodically by stats_initialize()
+extern const struct hrtls_latency latency;
@@ -1,7 +1,4 @@
-#include <assert.h>
 #include <stdint.h>
-#include <stdio.h>
-#include <inttypes.h>
 
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/drivers/hwinfo.h>
@@ -9,56 +6,27 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/logging/log_ctrl.h>
 
-#include <models/gw.h>
-
 #include "mesh/mesh.h"
+#include "anchor_map.h"
+#include "downlink.h"
 #include "main.h"
 #include "mqtt.h"
+#include "net.h"
+#include "pipeline.h"
+#include "startup.h"
+#include "zones.h"
 
 LOG_MODULE_REGISTER(main);
 
-#define POSITION_FORMAT "{\"position\":[%f,%f,%f]}"
-
 uint8_t dev_uuid[16];
 
-static void mqtt_loc_push_work_handler(struct k_work *work);
-static K_WORK_DEFINE(mqtt_loc_push_work, mqtt_loc_push_work_handler);
-K_MSGQ_DEFINE(locs_queue, sizeof(struct hrtls_model_gw_location), 3, 1);
-
-static void mqtt_loc_push_work_handler(struct k_work *work) {
-    struct hrtls_model_gw_location loc;
-    while (!k_msgq_get(&locs_queue, &loc, K_NO_WAIT)) {
-        static uint8_t msg_buf[256];
-        int res = snprintf(msg_buf, sizeof(msg_buf), POSITION_FORMAT, (((float)loc.x) / 1000), (((float)loc.y) / 1000), (((float)loc.z) / 1000));
-        assert(res > 0);
-        res = gw_mqtt_client_try_publishing("gateways/gateway_1/tags/tag_1/position", msg_buf, res);
-        if (res) {
-            LOG_WRN("Loc push failed with res: %d", res);
-        }
-        else {
-            LOG_INF("Loc push successful");
-        }
-    }
-}
-
-static void pub_handler(const uint8_t *buffer, size_t len) {
-    LOG_HEXDUMP_INF(buffer, len, "pub_handler");
-}
-
-void loc_push_handler(uint16_t sender_addr, const struct hrtls_model_gw_location *location) {
-    LOG_INF("addr %" PRIu16 "sent location", sender_addr);
-    if (k_msgq_put(&locs_queue, location, K_NO_WAIT)) {
-        LOG_WRN("Couldn't fit location into queue");
-    }
-    k_work_submit(&mqtt_loc_push_work);
-}
-
 void hrtls_fail(void) {
     log_panic();
     k_fatal_halt(0);
 }
 
 void main(void) {
+    startup_mark(STARTUP_MAIN);
     LOG_INF("Initializing...");
 
     // FIXME: Why this fails for qemu_x86 target? lol
@@ -70,17 +38,22 @@ void main(void) {
         }
     }
 
+    pipeline_initialize();
+
+    // mesh comes up in the background, while MQTT client waits for the network
+    gw_net_initialize();
+
     if ((err = bt_enable(bt_ready))) {
         LOG_ERR("Bluetooth init failed, %d", err);
         hrtls_fail();
     }
 
-    // TODO: debug why this delay is needed when using E1000 driver on qemu_x86
-    // TI Stellaris on qemu_cortex_m3 does not have this problem, but is
-    // incompatible with BT unix socket proxy
-    k_sleep(K_SECONDS(5));
-
-    const char *const topics[] = {};
+    const char *const topics[] = {
+        DOWNLINK_TAG_TOPIC,
+        DOWNLINK_GROUP_TOPIC,
+        ZONES_CONFIG_TOPIC,
+        ANCHOR_MAP_CONFIG_TOPIC
+    };
 
     const struct gw_mqtt_client_config client_config = {
         .server_addr = "192.0.2.2",
@@ -89,7 +62,8 @@ void main(void) {
         .password = "pwd",
         .topics = topics,
         .topics_len = ARRAY_SIZE(topics),
-        .pub_handler = pub_handler
+        .pub_handler = pipeline_pub_handler,
+        .connected_handler = pipeline_connected_handler
     };
 
     gw_mqtt_client_run(&client_config);
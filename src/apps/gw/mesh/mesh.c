@@ -1,15 +1,22 @@
+#include <stdbool.h>
 #include <stdint.h>
 #include <inttypes.h>
 
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/mesh.h>
+#include <zephyr/bluetooth/mesh/cfg.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
 #include <zephyr/sys/byteorder.h>
 
 #include <models/gw.h>
+#include <models/tag.h>
 
+#include "../anchor_map.h"
 #include "../main.h"
+#include "../pipeline.h"
+#include "../startup.h"
 #include "mesh.h"
 
 LOG_MODULE_REGISTER(mesh_mesh);
@@ -24,8 +31,13 @@ static void attention_off(struct bt_mesh_model *mod)
     LOG_INF("Attention off");
 }
 
+static void map_get_handler(uint16_t sender_addr, const struct hrtls_map_region_ref refs[], size_t count);
+
 static struct hrtls_model_gw_handlers gw_handlers = {
-    .push = loc_push_handler
+    .push = loc_push_handler,
+    .fix_push = fix_push_handler,
+    .ranges_push = ranges_push_handler,
+    .map_get = map_get_handler
 };
 
 static struct bt_mesh_health_srv health_srv = {
@@ -100,8 +112,70 @@ static void self_provision(void) {
     if (err) {
         LOG_ERR("App key add failed, %d", err);
     }
+}
 
+// bindings aren't made through the configuration server, so they aren't persisted
+static void configure_models(void) {
     vnd_models[0].keys[0] = 0;
+    vnd_models[0].groups[0] = HRTLS_GW_GROUP_ADDR;
+}
+
+static void map_get_handler(uint16_t sender_addr, const struct hrtls_map_region_ref refs[], size_t count) {
+    const uint16_t map_version = anchor_map_version();
+    struct hrtls_map_anchor anchors[HRTLS_MAP_REGION_ANCHORS_MAX];
+
+    // tags count the regions of a response, so that they can tell whether some got lost
+    bool stale[HRTLS_MAP_NEIGHBOURHOOD_REGIONS];
+    uint8_t parts = 0;
+    for (size_t i = 0; i < count; i++) {
+        struct hrtls_map_region_ref region = {
+            .id = refs[i].id
+        };
+        anchor_map_region(&region, anchors);
+        stale[i] = region.version != refs[i].version;
+        parts += stale[i];
+    }
+
+    // a tag that is up to date still gets the last region back, to learn the map version
+    if (!parts && count) {
+        stale[count - 1] = true;
+        parts = 1;
+    }
+
+    uint8_t part = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!stale[i]) {
+            continue;
+        }
+
+        struct hrtls_map_region_ref region = {
+            .id = refs[i].id
+        };
+        size_t anchors_count = anchor_map_region(&region, anchors);
+        int err = hrtls_model_gw_map_update(&vnd_models[0], sender_addr, map_version, part++, parts,
+                                            &region, anchors, anchors_count);
+        if (err) {
+            LOG_WRN("Map update to addr 0x%04" PRIx16 " failed, %d", sender_addr, err);
+        }
+    }
+}
+
+static void announce_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(announce_work, announce_work_handler);
+
+static void announce_work_handler(struct k_work *work) {
+    int err = hrtls_model_gw_announce(&vnd_models[0],
+                                      bt_mesh_default_ttl_get(),
+                                      CONFIG_HRTLS_GW_ANNOUNCE_PERIOD_MS,
+                                      anchor_map_version());
+    if (err) {
+        LOG_WRN("Gateway announcement failed, %d", err);
+    }
+    k_work_schedule(&announce_work, K_MSEC(CONFIG_HRTLS_GW_ANNOUNCE_PERIOD_MS));
+}
+
+int mesh_send_tag_cmd(uint16_t addr, const struct hrtls_model_tag_cmd *cmd) {
+    return hrtls_model_gw_tag_cmd(&vnd_models[0], addr, cmd);
 }
 
 void bt_ready(int err) {
@@ -111,6 +185,7 @@ void bt_ready(int err) {
     }
 
     LOG_INF("Bluetooth initialized");
+    startup_mark(STARTUP_BT_READY);
 
     err = bt_mesh_init(&prov, &comp);
     if (err) {
@@ -118,10 +193,27 @@ void bt_ready(int err) {
         hrtls_fail();
     }
 
-    err = bt_mesh_prov_enable(BT_MESH_PROV_ADV | BT_MESH_PROV_GATT);
-    if (err) {
-        LOG_ERR("Can't enable provisioning, %d", err);
+    // restores provisioning data, IV index and sequence number stored by the mesh stack
+    if (IS_ENABLED(CONFIG_BT_SETTINGS)) {
+        err = settings_load();
+        if (err) {
+            LOG_WRN("Settings load failed, %d", err);
+        }
+    }
+
+    if (bt_mesh_is_provisioned()) {
+        LOG_INF("Restored provisioning data");
+    }
+    else {
+        err = bt_mesh_prov_enable(BT_MESH_PROV_ADV | BT_MESH_PROV_GATT);
+        if (err) {
+            LOG_ERR("Can't enable provisioning, %d", err);
+        }
+
+        self_provision();
     }
+    configure_models();
+    startup_mark(STARTUP_MESH_READY);
 
-    self_provision();
+    k_work_schedule(&announce_work, K_NO_WAIT);
 }
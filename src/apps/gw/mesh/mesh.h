@@ -1,8 +1,11 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <models/gw.h>
 
 void bt_ready(int err);
-void loc_push_handler(uint16_t sender_addr, const struct hrtls_model_gw_location *location);
+
+struct hrtls_model_tag_cmd;
+int mesh_send_tag_cmd(uint16_t addr, const struct hrtls_model_tag_cmd *cmd);
@@ -1,9 +1,15 @@
+#include <errno.h>
 #include <string.h>
 
 #include <zephyr/bluetooth/mesh.h>
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 
+#include <metrics/metrics.h>
 #include <models/gw.h>
+#include <models/tag.h>
+
+#include "latency.h"
 
 LOG_MODULE_REGISTER(gw_impl);
 
@@ -11,6 +17,7 @@ static int handle_message_loc_push(struct bt_mesh_model *model,
                                     struct bt_mesh_msg_ctx *ctx,
                                     struct net_buf_simple *buf) {
     struct hrtls_model_gw_handlers *handlers = model->user_data;
+    hrtls_metric_inc(HRTLS_METRIC_MESH_RX);
     struct hrtls_model_gw_location location;
 
     if (buf->len != sizeof(location)) {
@@ -18,8 +25,6 @@ static int handle_message_loc_push(struct bt_mesh_model *model,
         return -1;
     }
 
-    LOG_INF("Loc push message received");
-
     memcpy(&location, net_buf_simple_pull_mem(buf, sizeof(location)), sizeof(location));
     if (handlers->push) {
         handlers->push(ctx->addr, &location);
@@ -28,7 +33,219 @@ static int handle_message_loc_push(struct bt_mesh_model *model,
     return 0;
 }
 
+static int handle_message_loc_push_v2(struct bt_mesh_model *model,
+                                      struct bt_mesh_msg_ctx *ctx,
+                                      struct net_buf_simple *buf) {
+    struct hrtls_model_gw_handlers *handlers = model->user_data;
+    hrtls_metric_inc(HRTLS_METRIC_MESH_RX);
+
+    struct hrtls_model_gw_fix fix;
+    uint32_t age_ms;
+    hrtls_model_gw_loc_v2_unpack(net_buf_simple_pull_le64(buf), &fix, &age_ms);
+    fix.rx_ms = k_uptime_get_32();
+    fix.timestamp_ms = fix.rx_ms - age_ms;
+    hrtls_latency_record(&latency, LATENCY_TAG, age_ms);
+
+    if (handlers->fix_push) {
+        handlers->fix_push(ctx->addr, ctx->recv_dst, &fix, 1);
+    }
+
+    return 0;
+}
+
+static int pull_delta(struct net_buf_simple *buf, int32_t *value) {
+    uint32_t delta;
+    int res = hrtls_varint_pull(buf, &delta);
+    if (!res) {
+        *value += hrtls_zigzag_decode(delta);
+    }
+    return res;
+}
+
+BUILD_ASSERT(HRTLS_MODEL_GW_LOC_BATCH_SEGMENTS <= CONFIG_BT_MESH_RX_SEG_MAX,
+             "Location batches don't fit into RX segments");
+
+static int handle_message_loc_batch_push(struct bt_mesh_model *model,
+                                         struct bt_mesh_msg_ctx *ctx,
+                                         struct net_buf_simple *buf) {
+    struct hrtls_model_gw_handlers *handlers = model->user_data;
+    hrtls_metric_inc(HRTLS_METRIC_MESH_RX);
+
+    const uint32_t rx_ms = k_uptime_get_32();
+    uint8_t seq = net_buf_simple_pull_u8(buf);
+    // same as for v2, fixes are timestamped with the receiver's clock
+    uint32_t timestamp_ms = rx_ms - net_buf_simple_pull_le32(buf);
+    uint8_t count = net_buf_simple_pull_u8(buf);
+    if (count > HRTLS_MODEL_GW_LOC_BATCH_MAX) {
+        LOG_ERR("Loc batch push has too many fixes: %" PRIu8, count);
+        return -1;
+    }
+
+    struct hrtls_model_gw_fix fixes[HRTLS_MODEL_GW_LOC_BATCH_MAX];
+    int32_t x = 0, y = 0, z = 0, err = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        uint32_t timestamp_delta;
+        if (hrtls_varint_pull(buf, &timestamp_delta)
+            || pull_delta(buf, &x)
+            || pull_delta(buf, &y)
+            || pull_delta(buf, &z)
+            || pull_delta(buf, &err)) {
+            LOG_ERR("Loc batch push is truncated at fix %" PRIu8, i);
+            return -1;
+        }
+        timestamp_ms += timestamp_delta;
+        hrtls_latency_record(&latency, LATENCY_TAG, rx_ms - timestamp_ms);
+
+        fixes[i] = (struct hrtls_model_gw_fix) {
+            .seq = seq + i,
+            .timestamp_ms = timestamp_ms,
+            .rx_ms = rx_ms,
+            .x = x,
+            .y = y,
+            .z = z,
+            .err = err
+        };
+    }
+
+    if (buf->len) {
+        LOG_ERR("Loc batch push has %" PRIu16 " trailing bytes", buf->len);
+        return -1;
+    }
+
+    if (handlers->fix_push) {
+        handlers->fix_push(ctx->addr, ctx->recv_dst, fixes, count);
+    }
+
+    return 0;
+}
+
+static int handle_message_ranges_push(struct bt_mesh_model *model,
+                                      struct bt_mesh_msg_ctx *ctx,
+                                      struct net_buf_simple *buf) {
+    struct hrtls_model_gw_handlers *handlers = model->user_data;
+    hrtls_metric_inc(HRTLS_METRIC_MESH_RX);
+
+    uint8_t seq = net_buf_simple_pull_u8(buf);
+    uint8_t count = net_buf_simple_pull_u8(buf);
+    if (count > HRTLS_MODEL_GW_RANGES_MAX || buf->len != count * HRTLS_MODEL_GW_RANGE_LEN) {
+        LOG_ERR("Ranges push has unexpected length: %" PRIu16 " for %" PRIu8 " ranges", buf->len, count);
+        return -1;
+    }
+
+    struct hrtls_model_gw_range ranges[HRTLS_MODEL_GW_RANGES_MAX];
+    for (uint8_t i = 0; i < count; i++) {
+        ranges[i].anchor_addr = net_buf_simple_pull_le16(buf);
+        ranges[i].distance_mm = net_buf_simple_pull_le16(buf) * 10;
+        ranges[i].nlos = net_buf_simple_pull_u8(buf);
+    }
+
+    if (handlers->ranges_push) {
+        handlers->ranges_push(ctx->addr, ctx->recv_dst, seq, ranges, count);
+    }
+
+    return 0;
+}
+
+static int handle_message_map_get(struct bt_mesh_model *model,
+                                  struct bt_mesh_msg_ctx *ctx,
+                                  struct net_buf_simple *buf) {
+    struct hrtls_model_gw_handlers *handlers = model->user_data;
+    hrtls_metric_inc(HRTLS_METRIC_MESH_RX);
+
+    size_t count = buf->len / HRTLS_MAP_REGION_REF_LEN;
+    if (buf->len % HRTLS_MAP_REGION_REF_LEN || count > HRTLS_MAP_NEIGHBOURHOOD_REGIONS) {
+        LOG_ERR("Map get has unexpected length: %" PRIu16, buf->len);
+        return -1;
+    }
+
+    struct hrtls_map_region_ref refs[HRTLS_MAP_NEIGHBOURHOOD_REGIONS];
+    for (size_t i = 0; i < count; i++) {
+        refs[i].id.x = net_buf_simple_pull_u8(buf);
+        refs[i].id.y = net_buf_simple_pull_u8(buf);
+        refs[i].version = net_buf_simple_pull_le16(buf);
+    }
+
+    if (handlers->map_get) {
+        handlers->map_get(ctx->addr, refs, count);
+    }
+
+    return 0;
+}
+
 const struct bt_mesh_model_op hrtls_model_gw_ops[] = {
     { HRTLS_MODEL_GW_LOC_PUSH_OPCODE, BT_MESH_LEN_EXACT(HRTLS_MODEL_GW_LOC_PUSH_LEN), handle_message_loc_push},
+    { HRTLS_MODEL_GW_LOC_PUSH_V2_OPCODE, BT_MESH_LEN_EXACT(HRTLS_MODEL_GW_LOC_PUSH_V2_LEN), handle_message_loc_push_v2},
+    { HRTLS_MODEL_GW_LOC_BATCH_PUSH_OPCODE, BT_MESH_LEN_MIN(HRTLS_MODEL_GW_LOC_BATCH_HDR_LEN), handle_message_loc_batch_push},
+    { HRTLS_MODEL_GW_RANGES_PUSH_OPCODE, BT_MESH_LEN_MIN(HRTLS_MODEL_GW_RANGES_HDR_LEN), handle_message_ranges_push},
+    { HRTLS_MODEL_GW_MAP_GET_OPCODE, BT_MESH_LEN_MIN(HRTLS_MAP_REGION_REF_LEN), handle_message_map_get},
     BT_MESH_MODEL_OP_END
 };
+
+int hrtls_model_gw_announce(struct bt_mesh_model *gw_model, uint8_t ttl, uint16_t period_ms, uint16_t map_version) {
+    struct bt_mesh_msg_ctx ctx = {
+        .addr = HRTLS_GW_GROUP_ADDR,
+        .app_idx = gw_model->keys[0],
+        .send_ttl = ttl
+    };
+
+    BT_MESH_MODEL_BUF_DEFINE(buf, HRTLS_MODEL_TAG_GW_ANNOUNCE_OPCODE, HRTLS_MODEL_TAG_GW_ANNOUNCE_LEN);
+    bt_mesh_model_msg_init(&buf, HRTLS_MODEL_TAG_GW_ANNOUNCE_OPCODE);
+    net_buf_simple_add_u8(&buf, ttl);
+    net_buf_simple_add_le16(&buf, period_ms);
+    net_buf_simple_add_le16(&buf, map_version);
+
+    return bt_mesh_model_send(gw_model, &ctx, &buf, NULL, NULL);
+}
+
+int hrtls_model_gw_tag_cmd(struct bt_mesh_model *gw_model, uint16_t addr, const struct hrtls_model_tag_cmd *cmd) {
+    struct bt_mesh_msg_ctx ctx = {
+        .addr = addr,
+        .app_idx = gw_model->keys[0],
+        .send_ttl = BT_MESH_TTL_DEFAULT
+    };
+
+    BT_MESH_MODEL_BUF_DEFINE(buf, HRTLS_MODEL_TAG_CMD_OPCODE, HRTLS_MODEL_TAG_CMD_LEN);
+    bt_mesh_model_msg_init(&buf, HRTLS_MODEL_TAG_CMD_OPCODE);
+    net_buf_simple_add_le16(&buf, cmd->period_ms);
+    net_buf_simple_add_u8(&buf, cmd->uplink);
+    net_buf_simple_add_le16(&buf, cmd->group_addr);
+
+    return bt_mesh_model_send(gw_model, &ctx, &buf, NULL, NULL);
+}
+
+int hrtls_model_gw_map_update(struct bt_mesh_model *gw_model,
+                              uint16_t addr,
+                              uint16_t map_version,
+                              uint8_t part,
+                              uint8_t parts,
+                              const struct hrtls_map_region_ref *region,
+                              const struct hrtls_map_anchor anchors[],
+                              size_t count) {
+    if (count > HRTLS_MAP_REGION_ANCHORS_MAX || part >= parts) {
+        return -EINVAL;
+    }
+
+    struct bt_mesh_msg_ctx ctx = {
+        .addr = addr,
+        .app_idx = gw_model->keys[0],
+        .send_ttl = BT_MESH_TTL_DEFAULT
+    };
+
+    BT_MESH_MODEL_BUF_DEFINE(buf, HRTLS_MODEL_TAG_CONF_UPDATE_OPCODE, HRTLS_MODEL_TAG_CONF_UPDATE_MAX_LEN);
+    bt_mesh_model_msg_init(&buf, HRTLS_MODEL_TAG_CONF_UPDATE_OPCODE);
+    net_buf_simple_add_le16(&buf, map_version);
+    net_buf_simple_add_u8(&buf, part);
+    net_buf_simple_add_u8(&buf, parts);
+    net_buf_simple_add_u8(&buf, region->id.x);
+    net_buf_simple_add_u8(&buf, region->id.y);
+    net_buf_simple_add_le16(&buf, region->version);
+    net_buf_simple_add_u8(&buf, count);
+    for (size_t i = 0; i < count; i++) {
+        net_buf_simple_add_le16(&buf, anchors[i].addr);
+        net_buf_simple_add_le32(&buf, anchors[i].x);
+        net_buf_simple_add_le32(&buf, anchors[i].y);
+        net_buf_simple_add_le32(&buf, anchors[i].z);
+    }
+
+    return bt_mesh_model_send(gw_model, &ctx, &buf, NULL, NULL);
+}
@@ -11,8 +11,12 @@
 #include <zephyr/net/net_ip.h>
 #include <zephyr/net/socket.h>
 
+#include <metrics/metrics.h>
+#include <trace/trace.h>
+
 #include "mqtt.h"
 #include "gai.h"
+#include "net.h"
 
 LOG_MODULE_REGISTER(mqtt);
 
@@ -40,7 +44,8 @@ struct client_wrapper {
     // TODO: reverse evt_err logic?
     int evt_err;
 
-    bool running;
+    // written under wrapper_ext_access_mutex, but also read without it from the mesh RX path
+    atomic_bool running;
 };
 
 // FIXME: this being global isn't really elegant
@@ -89,14 +94,14 @@ static void evt_cb_handler_suback(const struct mqtt_evt *evt) {
 
 static void evt_cb_handler_default(const struct mqtt_evt *evt) {
     // TODO: more sophisticated event handling
-    LOG_INF("Received evt %d", (int) evt->type);
+    HRTLS_TRACE(HRTLS_TRACE_MQTT_EVT, evt->type, evt->result, 0);
 
     if (evt->type != MQTT_EVT_PUBLISH) {
         return;
     }
 
     uint32_t len = evt->param.publish.message.payload.len;
-    LOG_INF("Received %" PRIu32 " bytes of payload", len);
+    HRTLS_TRACE(HRTLS_TRACE_MQTT_PUBLISH_RX, len, evt->param.publish.message_id, 0);
 
     static uint8_t incoming_publish_buf[BUF_SIZE];
     if (len > sizeof(incoming_publish_buf)) {
@@ -112,7 +117,8 @@ static void evt_cb_handler_default(const struct mqtt_evt *evt) {
         return;
     }
 
-    wrapper.config->pub_handler(incoming_publish_buf, len);
+    const struct mqtt_utf8 *topic = &evt->param.publish.message.topic.topic;
+    wrapper.config->pub_handler((const char *)topic->utf8, topic->size, incoming_publish_buf, len);
 }
 
 static void mqtt_evt_cb(struct mqtt_client *const client,
@@ -183,9 +189,9 @@ static int do_input(evt_cb_handler_t *evt_cb_handler) {
     wrapper.overrided_evt_cb_handler = evt_cb_handler;
     wrapper.evt_err = 0;
 
-    LOG_INF("pre input");
+    uint32_t start = k_cycle_get_32();
     int res = mqtt_input(&wrapper.client);
-    LOG_INF("after input");
+    HRTLS_TRACE(HRTLS_TRACE_MQTT_INPUT, res, k_cyc_to_us_floor32(k_cycle_get_32() - start), 0);
     if (res || wrapper.evt_err) {
         LOG_WRN("do_input failed with res: %d, evt_err: %d", res, wrapper.evt_err);
     }
@@ -281,12 +287,18 @@ static int run_cycle(const struct gw_mqtt_client_config *config) {
     }
 
     k_mutex_lock(&wrapper_ext_access_mutex, K_FOREVER);
-    wrapper.running = true;
+    atomic_store(&wrapper.running, true);
     k_mutex_unlock(&wrapper_ext_access_mutex);
+    hrtls_metric_inc(HRTLS_METRIC_MQTT_CONNECTS);
+    hrtls_metric_set(HRTLS_METRIC_MQTT_CONNECTED, 1);
+
+    if (config->connected_handler) {
+        config->connected_handler();
+    }
 
     while (true) {
         res = do_poll(mqtt_keepalive_time_left(&wrapper.client));
-        LOG_INF("Poll res: %d, revents: %hd", res, wrapper.poll_fd.revents);
+        HRTLS_TRACE(HRTLS_TRACE_MQTT_POLL, res, wrapper.poll_fd.revents, 0);
         if (res < 0) {
             LOG_WRN("Poll failed: %d", res);
             break;
@@ -310,16 +322,17 @@ static int run_cycle(const struct gw_mqtt_client_config *config) {
     }
 
     k_mutex_lock(&wrapper_ext_access_mutex, K_FOREVER);
-    wrapper.running = false;
+    atomic_store(&wrapper.running, false);
     res = mqtt_disconnect(&wrapper.client);
     k_mutex_unlock(&wrapper_ext_access_mutex);
+    hrtls_metric_set(HRTLS_METRIC_MQTT_CONNECTED, 0);
 
     LOG_INF("Disconnect with res: %d", res);
     return 0;
 }
 
 static int gw_mqtt_client_try_publishing_unlocked(const char *topic, const uint8_t *message, size_t len) {
-    if (!wrapper.running) {
+    if (!atomic_load(&wrapper.running)) {
         return -EAGAIN;
     }
 
@@ -342,6 +355,10 @@ static int gw_mqtt_client_try_publishing_unlocked(const char *topic, const uint8
     return mqtt_publish(&wrapper.client, &param);
 }
 
+bool gw_mqtt_client_is_connected(void) {
+    return atomic_load(&wrapper.running);
+}
+
 int gw_mqtt_client_try_publishing(const char *topic, const uint8_t *message, size_t len) {
     int res;
     k_mutex_lock(&wrapper_ext_access_mutex, K_FOREVER);
@@ -358,7 +375,11 @@ void gw_mqtt_client_run(const struct gw_mqtt_client_config *config) {
     assert(config->topics_len > 0);
     assert(config->pub_handler);
     int err;
-    while ((err = run_cycle(config)) != FATAL_ERROR) {
+    while (true) {
+        gw_net_await_connected();
+        if ((err = run_cycle(config)) == FATAL_ERROR) {
+            break;
+        }
         LOG_WRN("MQTT client resets due to transient errors");
         k_sleep(RETRY_PERIOD);
     }
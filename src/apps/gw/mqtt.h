@@ -1,9 +1,13 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
-typedef void gw_mqtt_client_pub_handler_t(const uint8_t *buffer, size_t len);
+// topic points into the client's receive buffer and isn't NUL terminated,
+// payload may be modified in place by the handler
+typedef void gw_mqtt_client_pub_handler_t(const char *topic, size_t topic_len, uint8_t *payload, size_t len);
+typedef void gw_mqtt_client_connected_handler_t(void);
 
 struct gw_mqtt_client_config {
     const char *server_addr;
@@ -13,7 +17,11 @@ struct gw_mqtt_client_config {
     const char *const *topics;
     size_t topics_len;
     gw_mqtt_client_pub_handler_t *pub_handler;
+    // called once the client is ready to publish, optional
+    gw_mqtt_client_connected_handler_t *connected_handler;
 };
 
+bool gw_mqtt_client_is_connected(void);
 int gw_mqtt_client_try_publishing(const char *topic, const uint8_t *message, size_t len);
+// connects whenever the network is up, never returns unless there's a fatal error
 void gw_mqtt_client_run(const struct gw_mqtt_client_config *config);
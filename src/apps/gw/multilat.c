@@ -0,0 +1,282 @@
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <metrics/metrics.h>
+
+#include "anchor_map.h"
+#include "multilat.h"
+
+LOG_MODULE_REGISTER(multilat);
+
+// reference anchor and three more for a 3D position
+#define MIN_RANGES 4
+#define NLOS_REJECT_THRESHOLD (CONFIG_HRTLS_GW_NLOS_REJECT_PERCENT * UINT8_MAX / 100)
+// anchors closer to being coplanar than that can't be solved for all three coordinates
+#define MIN_DETERMINANT 1e-6f
+
+struct job {
+    uint16_t addr;
+    uint8_t seq;
+    uint32_t timestamp_ms;
+    size_t count;
+    struct hrtls_model_gw_range ranges[HRTLS_MODEL_GW_RANGES_MAX];
+};
+
+struct problem_range {
+    uint16_t anchor_addr;
+    uint8_t nlos;
+    // in m, relative to the first anchor
+    float pos[3];
+    float distance;
+};
+
+// job with ranges resolved against the anchor map, sorted by anchor address,
+// so that tags ranging with the same anchors end up next to each other
+struct problem {
+    const struct job *job;
+    float origin[3];
+    size_t count;
+    struct problem_range ranges[HRTLS_MODEL_GW_RANGES_MAX];
+};
+
+static void solve_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(solve_work, solve_work_handler);
+K_MSGQ_DEFINE(jobs_queue, sizeof(struct job), 2 * CONFIG_HRTLS_GW_MULTILAT_BATCH, 4);
+
+static multilat_fix_handler_t *fix_handler;
+
+static struct job jobs[CONFIG_HRTLS_GW_MULTILAT_BATCH];
+static struct problem problems[CONFIG_HRTLS_GW_MULTILAT_BATCH];
+static const struct problem *sorted_problems[CONFIG_HRTLS_GW_MULTILAT_BATCH];
+
+static int range_nlos_cmp(const void *a, const void *b) {
+    return ((const struct problem_range *)a)->nlos - ((const struct problem_range *)b)->nlos;
+}
+
+static int range_addr_cmp(const void *a, const void *b) {
+    return ((const struct problem_range *)a)->anchor_addr - ((const struct problem_range *)b)->anchor_addr;
+}
+
+static int problem_cmp(const void *a, const void *b) {
+    const struct problem *pa = *(const struct problem **)a;
+    const struct problem *pb = *(const struct problem **)b;
+    if (pa->count != pb->count) {
+        return pa->count < pb->count ? -1 : 1;
+    }
+    for (size_t i = 0; i < pa->count; i++) {
+        if (pa->ranges[i].anchor_addr != pb->ranges[i].anchor_addr) {
+            return range_addr_cmp(&pa->ranges[i], &pb->ranges[i]);
+        }
+    }
+    return 0;
+}
+
+static int prepare_problem(const struct job *job, struct problem *problem) {
+    problem->job = job;
+    problem->count = 0;
+    for (size_t i = 0; i < job->count; i++) {
+        struct hrtls_map_anchor anchor;
+        int32_t bias_mm;
+        if (anchor_map_find(job->ranges[i].anchor_addr, &anchor, &bias_mm)) {
+            LOG_DBG("Anchor %" PRIu16 " isn't in the map", job->ranges[i].anchor_addr);
+            continue;
+        }
+        problem->ranges[problem->count++] = (struct problem_range) {
+            .anchor_addr = anchor.addr,
+            .nlos = job->ranges[i].nlos,
+            .pos = { anchor.x / 1000.0f, anchor.y / 1000.0f, anchor.z / 1000.0f },
+            .distance = ((int32_t)job->ranges[i].distance_mm - bias_mm) / 1000.0f
+        };
+    }
+
+    // leave out likely NLOS ranges, as long as the position is still determined
+    qsort(problem->ranges, problem->count, sizeof(problem->ranges[0]), range_nlos_cmp);
+    size_t kept = MIN(problem->count, MIN_RANGES);
+    while (kept < problem->count && problem->ranges[kept].nlos <= NLOS_REJECT_THRESHOLD) {
+        kept++;
+    }
+    problem->count = kept;
+    if (problem->count < MIN_RANGES) {
+        return -EINVAL;
+    }
+
+    qsort(problem->ranges, problem->count, sizeof(problem->ranges[0]), range_addr_cmp);
+    for (size_t i = 0; i < ARRAY_SIZE(problem->origin); i++) {
+        problem->origin[i] = problem->ranges[0].pos[i];
+    }
+    for (size_t i = 0; i < problem->count; i++) {
+        for (size_t j = 0; j < ARRAY_SIZE(problem->origin); j++) {
+            problem->ranges[i].pos[j] -= problem->origin[j];
+        }
+    }
+    return 0;
+}
+
+// Subtracting the first anchor's sphere equation from the others gives a linear system
+// 2 * a_i * p = |a_i|^2 - d_i^2 + d_0^2 with anchors relative to the first one. Its least squares
+// solution (A^T A)^-1 A^T b depends on the ranges only through b, so the projection matrix
+// is computed once for an anchor set and applied to every tag which ranged with it.
+static int compute_projection(const struct problem *problem, float out[3][HRTLS_MODEL_GW_RANGES_MAX - 1]) {
+    const size_t rows = problem->count - 1;
+    const struct problem_range *ranges = &problem->ranges[1];
+
+    float ata[3][3] = { 0 };
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t j = 0; j < 3; j++) {
+            for (size_t k = 0; k < rows; k++) {
+                ata[i][j] += 4 * ranges[k].pos[i] * ranges[k].pos[j];
+            }
+        }
+    }
+
+    float cof[3][3];
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t j = 0; j < 3; j++) {
+            const size_t r0 = (i + 1) % 3, r1 = (i + 2) % 3;
+            const size_t c0 = (j + 1) % 3, c1 = (j + 2) % 3;
+            cof[i][j] = ata[r0][c0] * ata[r1][c1] - ata[r0][c1] * ata[r1][c0];
+        }
+    }
+    const float det = ata[0][0] * cof[0][0] + ata[0][1] * cof[0][1] + ata[0][2] * cof[0][2];
+    if (fabsf(det) < MIN_DETERMINANT) {
+        return -EDOM;
+    }
+
+    // A^T A is symmetric, so is its cofactor matrix
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t k = 0; k < rows; k++) {
+            float sum = 0;
+            for (size_t j = 0; j < 3; j++) {
+                sum += cof[i][j] * 2 * ranges[k].pos[j];
+            }
+            out[i][k] = sum / det;
+        }
+    }
+    return 0;
+}
+
+static void solve_problem(const struct problem *problem, const float projection[3][HRTLS_MODEL_GW_RANGES_MAX - 1]) {
+    const size_t rows = problem->count - 1;
+    const struct problem_range *ranges = problem->ranges;
+    const float d0_pow2 = ranges[0].distance * ranges[0].distance;
+
+    float b[HRTLS_MODEL_GW_RANGES_MAX - 1];
+    for (size_t k = 0; k < rows; k++) {
+        const float *a = ranges[k + 1].pos;
+        b[k] = a[0] * a[0] + a[1] * a[1] + a[2] * a[2]
+               - ranges[k + 1].distance * ranges[k + 1].distance + d0_pow2;
+    }
+
+    float pos[3];
+    for (size_t i = 0; i < 3; i++) {
+        pos[i] = 0;
+        for (size_t k = 0; k < rows; k++) {
+            pos[i] += projection[i][k] * b[k];
+        }
+    }
+
+    float residual_pow2 = 0;
+    for (size_t i = 0; i < problem->count; i++) {
+        const float *a = ranges[i].pos;
+        float residual = sqrtf(powf(pos[0] - a[0], 2) + powf(pos[1] - a[1], 2) + powf(pos[2] - a[2], 2))
+                         - ranges[i].distance;
+        residual_pow2 += residual * residual / problem->count;
+    }
+
+    const struct hrtls_model_gw_fix fix = {
+        .seq = problem->job->seq,
+        .timestamp_ms = problem->job->timestamp_ms,
+        .rx_ms = problem->job->timestamp_ms,
+        .x = (pos[0] + problem->origin[0]) * 1000,
+        .y = (pos[1] + problem->origin[1]) * 1000,
+        .z = (pos[2] + problem->origin[2]) * 1000,
+        .err = sqrtf(residual_pow2) * 1000
+    };
+    fix_handler(problem->job->addr, &fix);
+}
+
+static void solve_group(const struct problem *group[], size_t n) {
+    float projection[3][HRTLS_MODEL_GW_RANGES_MAX - 1];
+    int err = compute_projection(group[0], projection);
+    if (err) {
+        LOG_WRN("Anchor set of %zu tags is degenerate, %d", n, err);
+        hrtls_metric_add(HRTLS_METRIC_SOLVER_FAIL, n);
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        solve_problem(group[i], projection);
+    }
+}
+
+static void solve_work_handler(struct k_work *work) {
+    const uint32_t start = k_cycle_get_32();
+
+    size_t n = 0;
+    while (n < ARRAY_SIZE(jobs) && !k_msgq_get(&jobs_queue, &jobs[n], K_NO_WAIT)) {
+        if (prepare_problem(&jobs[n], &problems[n])) {
+            LOG_WRN("Not enough usable ranges from addr %" PRIu16, jobs[n].addr);
+            hrtls_metric_inc(HRTLS_METRIC_SOLVER_FAIL);
+            continue;
+        }
+        sorted_problems[n] = &problems[n];
+        n++;
+    }
+
+    qsort(sorted_problems, n, sizeof(sorted_problems[0]), problem_cmp);
+
+    size_t groups = 0;
+    for (size_t i = 0; i < n; groups++) {
+        size_t end = i + 1;
+        while (end < n && !problem_cmp(&sorted_problems[i], &sorted_problems[end])) {
+            end++;
+        }
+        solve_group(&sorted_problems[i], end - i);
+        i = end;
+    }
+
+    const uint32_t duration_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    if (n) {
+        hrtls_metric_record(HRTLS_METRIC_MULTILAT_US, duration_us);
+    }
+    LOG_DBG("Solved %zu tags with %zu anchor sets in %" PRIu32 " us", n, groups, duration_us);
+
+    if (k_msgq_num_used_get(&jobs_queue)) {
+        k_work_reschedule(&solve_work, K_NO_WAIT);
+    }
+}
+
+void multilat_initialize(multilat_fix_handler_t *handler) {
+    fix_handler = handler;
+}
+
+int multilat_submit(uint16_t addr, uint8_t seq, const struct hrtls_model_gw_range ranges[], size_t count) {
+    struct job job = {
+        .addr = addr,
+        .seq = seq,
+        .timestamp_ms = k_uptime_get_32(),
+        .count = MIN(count, ARRAY_SIZE(job.ranges))
+    };
+    memcpy(job.ranges, ranges, job.count * sizeof(*ranges));
+
+    int res = k_msgq_put(&jobs_queue, &job, K_NO_WAIT);
+    if (res) {
+        return res;
+    }
+
+    // give other tags a moment to join the batch, unless it's full already
+    if (k_msgq_num_used_get(&jobs_queue) >= CONFIG_HRTLS_GW_MULTILAT_BATCH) {
+        k_work_reschedule(&solve_work, K_NO_WAIT);
+    }
+    else {
+        k_work_schedule(&solve_work, K_MSEC(CONFIG_HRTLS_GW_MULTILAT_DELAY_MS));
+    }
+    return 0;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <models/gw.h>
+
+typedef void multilat_fix_handler_t(uint16_t addr, const struct hrtls_model_gw_fix *fix);
+
+void multilat_initialize(multilat_fix_handler_t *handler);
+// queues raw ranges of a tag, they're solved in batches together with other tags
+int multilat_submit(uint16_t addr, uint8_t seq, const struct hrtls_model_gw_range ranges[], size_t count);
@@ -0,0 +1,67 @@
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/conn_mgr.h>
+#include <zephyr/net/net_event.h>
+#include <zephyr/net/net_mgmt.h>
+
+#include "net.h"
+#include "startup.h"
+
+LOG_MODULE_REGISTER(gw_net);
+
+#define IF_EVENTS (NET_EVENT_IF_UP | NET_EVENT_IF_DOWN)
+#define L4_EVENTS (NET_EVENT_L4_CONNECTED | NET_EVENT_L4_DISCONNECTED)
+
+static struct net_mgmt_event_callback if_cb;
+static struct net_mgmt_event_callback l4_cb;
+static K_MUTEX_DEFINE(lock);
+static K_CONDVAR_DEFINE(connected_changed);
+static bool connected;
+
+static void set_connected(bool new_connected) {
+    k_mutex_lock(&lock, K_FOREVER);
+    connected = new_connected;
+    k_condvar_broadcast(&connected_changed);
+    k_mutex_unlock(&lock);
+}
+
+static void event_handler(struct net_mgmt_event_callback *cb, uint32_t mgmt_event, struct net_if *iface) {
+    switch (mgmt_event) {
+    case NET_EVENT_IF_UP:
+        LOG_INF("Interface up");
+        startup_mark(STARTUP_IFACE_UP);
+        break;
+    case NET_EVENT_IF_DOWN:
+        LOG_INF("Interface down");
+        break;
+    case NET_EVENT_L4_CONNECTED:
+        LOG_INF("Network connected");
+        startup_mark(STARTUP_NET_CONNECTED);
+        set_connected(true);
+        break;
+    case NET_EVENT_L4_DISCONNECTED:
+        LOG_WRN("Network disconnected");
+        set_connected(false);
+        break;
+    }
+}
+
+void gw_net_initialize(void) {
+    net_mgmt_init_event_callback(&if_cb, event_handler, IF_EVENTS);
+    net_mgmt_add_event_callback(&if_cb);
+    net_mgmt_init_event_callback(&l4_cb, event_handler, L4_EVENTS);
+    net_mgmt_add_event_callback(&l4_cb);
+
+    // connection manager reports the current state again, in case it was reached before
+    conn_mgr_resend_status();
+}
+
+void gw_net_await_connected(void) {
+    k_mutex_lock(&lock, K_FOREVER);
+    while (!connected) {
+        k_condvar_wait(&connected_changed, &lock, K_FOREVER);
+    }
+    k_mutex_unlock(&lock);
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// starts tracking network connectivity, the interface is brought up by the network stack on its own
+void gw_net_initialize(void);
+// blocks until an interface has an address usable for L4 connections
+void gw_net_await_connected(void);
@@ -0,0 +1,361 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <zephyr/fs/fcb.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/byteorder.h>
+
+#include <metrics/metrics.h>
+
+#include "mqtt.h"
+#include "offline.h"
+
+LOG_MODULE_REGISTER(offline);
+
+#if FLASH_AREA_LABEL_EXISTS(offline)
+#define OFFLINE_AREA_ID FLASH_AREA_ID(offline)
+#endif
+
+#define FCB_MAGIC 0x484f4646
+#define SECTORS_MAX 128
+
+// Tracks of a single tag are stored in chunks, positions as varint encoded,
+// zigzagged deltas to the previous one:
+// addr (le16), base timestamp (le32), count (u8), then count times
+// dt ms (varint), dx mm, dy mm, dz mm (zigzag varints)
+#define CHUNK_HDR_LEN (2 + 4 + 1)
+#define CHUNK_SIZE 128
+#define RECORD_LEN_MAX (4 * 5)
+#define CHUNK_RECORDS_MAX 24
+// partially filled chunks are written out after that, bounding what a reboot loses
+#define CHUNK_FLUSH_MS 5000
+// chunks being filled at the same time, least recently used one is flushed first
+#define OPEN_CHUNKS 8
+
+#define HISTORY_TOPIC_FORMAT "gateways/gateway_1/tags/%04" PRIx16 "/history"
+
+struct chunk {
+    uint16_t addr;
+    uint32_t base_ms;
+    uint32_t last_used;
+    uint8_t count;
+    size_t len;
+    int32_t last[3];
+    uint32_t last_ms;
+    uint8_t buf[CHUNK_SIZE];
+};
+
+static K_MUTEX_DEFINE(offline_mutex);
+static struct fcb fcb;
+static struct flash_sector sectors[SECTORS_MAX];
+static bool initialized;
+
+static struct chunk chunks[OPEN_CHUNKS];
+static uint32_t use_counter;
+// last entry published, entries before it are waiting for their sector to be reclaimed
+static struct fcb_entry drained;
+// bumped whenever storing new chunks drops undrained ones
+static uint32_t drops;
+
+static void flush_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(flush_work, flush_work_handler);
+static void drain_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(drain_work, drain_work_handler);
+
+static size_t put_varint(uint8_t *buf, uint32_t value) {
+    size_t len = 0;
+    while (value >= 0x80) {
+        buf[len++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    buf[len++] = value;
+    return len;
+}
+
+static size_t put_zigzag(uint8_t *buf, int32_t value) {
+    return put_varint(buf, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+static int get_varint(const uint8_t *buf, size_t len, size_t *pos, uint32_t *out) {
+    uint32_t value = 0;
+    for (unsigned shift = 0; shift < 32 && *pos < len; shift += 7) {
+        uint8_t byte = buf[(*pos)++];
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *out = value;
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
+
+static int get_zigzag(const uint8_t *buf, size_t len, size_t *pos, int32_t *out) {
+    uint32_t value;
+    int err = get_varint(buf, len, pos, &value);
+    *out = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+    return err;
+}
+
+// whether the oldest sector still holds entries that weren't published
+static bool oldest_undrained(void) {
+    if (!drained.fe_sector) {
+        return true;
+    }
+    if (drained.fe_sector != fcb.f_oldest) {
+        return false;
+    }
+
+    struct fcb_entry next = drained;
+    return !fcb_getnext(&fcb, &next) && next.fe_sector == fcb.f_oldest;
+}
+
+// frees the oldest sector, restarting drain position if it was there
+static int reclaim_oldest(void) {
+    if (oldest_undrained()) {
+        LOG_WRN("Offline log full, dropping oldest tracks");
+        drops++;
+        hrtls_metric_inc(HRTLS_METRIC_OFFLINE_DROPS);
+    }
+    if (drained.fe_sector == fcb.f_oldest) {
+        drained = (struct fcb_entry) { 0 };
+    }
+    return fcb_rotate(&fcb);
+}
+
+static int chunk_write(struct chunk *chunk) {
+    sys_put_le16(chunk->addr, &chunk->buf[0]);
+    sys_put_le32(chunk->base_ms, &chunk->buf[2]);
+    chunk->buf[6] = chunk->count;
+
+    // flash writes have to be aligned, decoding stops after count records anyway
+    const uint16_t len = ROUND_UP(chunk->len, MAX(fcb.f_align, 1));
+    memset(&chunk->buf[chunk->len], 0, len - chunk->len);
+
+    struct fcb_entry loc;
+    int err = fcb_append(&fcb, len, &loc);
+    if (err == -ENOSPC) {
+        err = reclaim_oldest();
+        if (!err) {
+            err = fcb_append(&fcb, len, &loc);
+        }
+    }
+    if (err) {
+        return err;
+    }
+
+    err = flash_area_write(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), chunk->buf, len);
+    if (err) {
+        return err;
+    }
+    return fcb_append_finish(&fcb, &loc);
+}
+
+static void chunk_flush(struct chunk *chunk) {
+    if (!chunk->count) {
+        return;
+    }
+
+    int err = chunk_write(chunk);
+    if (err) {
+        LOG_WRN("Couldn't store %" PRIu8 " tracks of addr 0x%04" PRIx16 ", %d", chunk->count, chunk->addr, err);
+    }
+    chunk->count = 0;
+}
+
+static struct chunk *chunk_for(uint16_t addr) {
+    struct chunk *lru = &chunks[0];
+    for (size_t i = 0; i < ARRAY_SIZE(chunks); i++) {
+        if (chunks[i].count && chunks[i].addr == addr) {
+            return &chunks[i];
+        }
+        if (!chunks[i].count || (lru->count && chunks[i].last_used < lru->last_used)) {
+            lru = &chunks[i];
+        }
+    }
+    chunk_flush(lru);
+    return lru;
+}
+
+static void flush_work_handler(struct k_work *work) {
+    k_mutex_lock(&offline_mutex, K_FOREVER);
+    for (size_t i = 0; i < ARRAY_SIZE(chunks); i++) {
+        chunk_flush(&chunks[i]);
+    }
+    k_mutex_unlock(&offline_mutex);
+}
+
+int offline_store(uint16_t addr, const struct tracker_track *track) {
+    if (!initialized) {
+        return -ENOTSUP;
+    }
+
+    const struct hrtls_model_gw_fix *fix = &track->fix;
+    const int32_t pos[3] = { fix->x, fix->y, fix->z };
+    const uint32_t now = k_uptime_get_32();
+
+    k_mutex_lock(&offline_mutex, K_FOREVER);
+
+    struct chunk *chunk = chunk_for(addr);
+    if (chunk->count && (chunk->len + RECORD_LEN_MAX > CHUNK_SIZE || chunk->count == CHUNK_RECORDS_MAX)) {
+        chunk_flush(chunk);
+    }
+
+    if (!chunk->count) {
+        chunk->addr = addr;
+        chunk->base_ms = now;
+        chunk->last_ms = now;
+        chunk->len = CHUNK_HDR_LEN;
+        memset(chunk->last, 0, sizeof(chunk->last));
+    }
+    chunk->last_used = ++use_counter;
+
+    chunk->len += put_varint(&chunk->buf[chunk->len], now - chunk->last_ms);
+    for (size_t axis = 0; axis < ARRAY_SIZE(pos); axis++) {
+        chunk->len += put_zigzag(&chunk->buf[chunk->len], pos[axis] - chunk->last[axis]);
+        chunk->last[axis] = pos[axis];
+    }
+    chunk->last_ms = now;
+    chunk->count++;
+
+    k_mutex_unlock(&offline_mutex);
+
+    hrtls_metric_inc(HRTLS_METRIC_OFFLINE_STORED);
+    k_work_schedule(&flush_work, K_MSEC(CHUNK_FLUSH_MS));
+    return 0;
+}
+
+// {"positions":[[x,y,z,age_ms],...]}, oldest first, in m
+static int chunk_to_json(const uint8_t *buf, size_t len, uint16_t *out_addr, char *out, size_t out_size) {
+    if (len < CHUNK_HDR_LEN) {
+        return -EINVAL;
+    }
+
+    *out_addr = sys_get_le16(&buf[0]);
+    uint32_t timestamp_ms = sys_get_le32(&buf[2]);
+    const uint8_t count = buf[6];
+    const uint32_t now = k_uptime_get_32();
+
+    int32_t pos[3] = { 0 };
+    size_t read = CHUNK_HDR_LEN;
+    int written = snprintf(out, out_size, "{\"positions\":[");
+    for (uint8_t i = 0; i < count; i++) {
+        uint32_t dt;
+        int32_t delta[3];
+        if (get_varint(buf, len, &read, &dt)
+            || get_zigzag(buf, len, &read, &delta[0])
+            || get_zigzag(buf, len, &read, &delta[1])
+            || get_zigzag(buf, len, &read, &delta[2])) {
+            return -EINVAL;
+        }
+        timestamp_ms += dt;
+        for (size_t axis = 0; axis < ARRAY_SIZE(pos); axis++) {
+            pos[axis] += delta[axis];
+        }
+
+        written += snprintf(out + written, out_size - MIN(written, out_size), "%s[%.3f,%.3f,%.3f,%" PRIu32 "]",
+                            i ? "," : "", ((float)pos[0]) / 1000, ((float)pos[1]) / 1000, ((float)pos[2]) / 1000,
+                            now - timestamp_ms);
+    }
+    written += snprintf(out + written, out_size - MIN(written, out_size), "]}");
+
+    return written < out_size ? written : -ENOMEM;
+}
+
+static void drain_work_handler(struct k_work *work) {
+    static uint8_t chunk_buf[CHUNK_SIZE];
+    static char msg_buf[1536];
+
+    k_mutex_lock(&offline_mutex, K_FOREVER);
+
+    struct fcb_entry next = drained;
+    if (fcb_getnext(&fcb, &next)) {
+        // all drained, open chunks are left to be flushed and picked up later
+        k_mutex_unlock(&offline_mutex);
+        return;
+    }
+
+    const size_t len = MIN(next.fe_data_len, sizeof(chunk_buf));
+    const uint32_t drops_before = drops;
+    int err = flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(next), chunk_buf, len);
+    k_mutex_unlock(&offline_mutex);
+
+    uint16_t addr;
+    int msg_len = err ? err : chunk_to_json(chunk_buf, len, &addr, msg_buf, sizeof(msg_buf));
+    if (msg_len >= 0) {
+        char topic[64];
+        snprintf(topic, sizeof(topic), HISTORY_TOPIC_FORMAT, addr);
+        err = gw_mqtt_client_try_publishing(topic, (const uint8_t *)msg_buf, msg_len);
+        if (err == -EAGAIN) {
+            // disconnected again, draining resumes on the next connection
+            return;
+        }
+        if (err) {
+            LOG_WRN("History push failed with res: %d", err);
+        }
+    }
+    else {
+        LOG_WRN("Skipping unreadable offline chunk, %d", msg_len);
+    }
+
+    k_mutex_lock(&offline_mutex, K_FOREVER);
+    // unless storing has reclaimed the sector in the meantime, sectors
+    // published in full are freed for new chunks
+    if (drops == drops_before) {
+        drained = next;
+        while (fcb.f_oldest != drained.fe_sector) {
+            if (fcb_rotate(&fcb)) {
+                break;
+            }
+        }
+    }
+    k_mutex_unlock(&offline_mutex);
+
+    k_work_schedule(&drain_work, K_MSEC(CONFIG_HRTLS_GW_OFFLINE_DRAIN_INTERVAL_MS));
+}
+
+void offline_drain_start(void) {
+    if (initialized) {
+        k_work_schedule(&drain_work, K_NO_WAIT);
+    }
+}
+
+int offline_initialize(void) {
+#ifdef OFFLINE_AREA_ID
+    uint32_t sector_count = ARRAY_SIZE(sectors);
+    int err = flash_area_get_sectors(OFFLINE_AREA_ID, &sector_count, sectors);
+    if (err) {
+        LOG_ERR("Couldn't get offline partition layout, %d", err);
+        return err;
+    }
+
+    fcb = (struct fcb) {
+        .f_magic = FCB_MAGIC,
+        .f_sector_cnt = sector_count,
+        .f_sectors = sectors
+    };
+    err = fcb_init(OFFLINE_AREA_ID, &fcb);
+    if (err) {
+        LOG_ERR("Couldn't initialize offline log, %d", err);
+        return err;
+    }
+
+    // timestamps are relative to uptime, so tracks from before a reboot can't be placed in time
+    err = fcb_clear(&fcb);
+    if (err) {
+        LOG_ERR("Couldn't clear offline log, %d", err);
+        return err;
+    }
+
+    initialized = true;
+    return 0;
+#else
+    LOG_INF("No offline partition, tracks are dropped while disconnected");
+    return -ENOTSUP;
+#endif
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "tracker.h"
+
+// prepares the flash log, returns -ENOTSUP if there's no offline partition
+int offline_initialize(void);
+// stores a track that couldn't be queued for publishing
+int offline_store(uint16_t addr, const struct tracker_track *track);
+// starts publishing stored tracks at a throttled rate, stops by itself on disconnection
+void offline_drain_start(void);
@@ -0,0 +1,217 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include <zephyr/bluetooth/mesh.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <metrics/metrics.h>
+#include <models/gw.h>
+#include <trace/trace.h>
+
+#include "anchor_map.h"
+#include "dedup.h"
+#include "downlink.h"
+#include "latency.h"
+#include "mqtt.h"
+#include "multilat.h"
+#include "offline.h"
+#include "pipeline.h"
+#include "scheduler.h"
+#include "startup.h"
+#include "stats.h"
+#include "tracker.h"
+#include "zones.h"
+
+LOG_MODULE_REGISTER(pipeline);
+
+#define POSITION_TOPIC_FORMAT "gateways/gateway_1/tags/%04" PRIx16 "/position"
+#define POSITION_FORMAT "{\"position\":[%f,%f,%f],\"velocity\":[%f,%f,%f]}"
+#define ZONE_EVENT_TOPIC_FORMAT "gateways/gateway_1/tags/%04" PRIx16 "/zones"
+#define ZONE_EVENT_FORMAT "{\"zone\":%" PRIu16 ",\"event\":\"%s\",\"timestamp_ms\":%" PRIu32 "}"
+
+#define ZONE_EVENTS_QUEUE_LEN 32
+
+static void mqtt_loc_push_work_handler(struct k_work *work);
+static K_WORK_DEFINE(mqtt_loc_push_work, mqtt_loc_push_work_handler);
+K_MSGQ_DEFINE(zone_events_queue, sizeof(struct zones_event), ZONE_EVENTS_QUEUE_LEN, 4);
+
+// returns -EAGAIN if the client isn't connected yet
+static int publish_zone_events(void) {
+    struct zones_event event;
+    while (!k_msgq_peek(&zone_events_queue, &event)) {
+        char topic[64];
+        static uint8_t msg_buf[128];
+        snprintf(topic, sizeof(topic), ZONE_EVENT_TOPIC_FORMAT, event.addr);
+        int res = snprintf(msg_buf, sizeof(msg_buf), ZONE_EVENT_FORMAT,
+                           event.zone_id, zones_event_name(event.type), event.timestamp_ms);
+        assert(res > 0);
+        res = gw_mqtt_client_try_publishing(topic, msg_buf, res);
+        if (res == -EAGAIN) {
+            return res;
+        }
+
+        k_msgq_get(&zone_events_queue, &event, K_NO_WAIT);
+        if (res) {
+            LOG_WRN("Zone event push failed with res: %d", res);
+        }
+    }
+    return 0;
+}
+
+static void mqtt_loc_push_work_handler(struct k_work *work) {
+    publish_zone_events();
+}
+
+static int publish_track(uint16_t addr, const struct tracker_track *track) {
+    const uint32_t start_ms = k_uptime_get_32();
+    const struct hrtls_model_gw_fix *loc = &track->fix;
+    char topic[64];
+    static uint8_t msg_buf[256];
+    snprintf(topic, sizeof(topic), POSITION_TOPIC_FORMAT, addr);
+    int len = snprintf(msg_buf, sizeof(msg_buf), POSITION_FORMAT,
+                       (((float)loc->x) / 1000), (((float)loc->y) / 1000), (((float)loc->z) / 1000),
+                       (((float)track->vx) / 1000), (((float)track->vy) / 1000), (((float)track->vz) / 1000));
+    assert(len > 0);
+    int res = gw_mqtt_client_try_publishing(topic, msg_buf, len);
+    if (res) {
+        // not connected tracks are kept by the scheduler and don't count as failures
+        if (res != -EAGAIN) {
+            hrtls_metric_inc(HRTLS_METRIC_PUBLISH_FAIL);
+        }
+        return res;
+    }
+
+    hrtls_metric_inc(HRTLS_METRIC_PUBLISHES);
+    hrtls_metric_record(HRTLS_METRIC_PUBLISH_BYTES, len);
+    hrtls_latency_record(&latency, LATENCY_QUEUE, start_ms - track->tracked_ms);
+    hrtls_latency_record_since(&latency, LATENCY_PUBLISH, start_ms);
+    hrtls_latency_record_since(&latency, LATENCY_TOTAL, loc->rx_ms);
+
+    HRTLS_TRACE(HRTLS_TRACE_GW_PUBLISH, addr, len, 0);
+    startup_mark(STARTUP_FIRST_PUBLISH);
+    return len;
+}
+
+void pipeline_connected_handler(void) {
+    startup_mark(STARTUP_MQTT_CONNECTED);
+    k_work_submit(&mqtt_loc_push_work);
+    scheduler_kick();
+    offline_drain_start();
+}
+
+void pipeline_pub_handler(const char *topic, size_t topic_len, uint8_t *payload, size_t len) {
+    if (downlink_handle_publish(topic, topic_len, payload, len) == -ENOENT
+        && zones_handle_publish(topic, topic_len, payload, len) == -ENOENT
+        && anchor_map_handle_publish(topic, topic_len, payload, len) == -ENOENT) {
+        LOG_WRN("Unexpected publish on topic: %.*s", (int)topic_len, topic);
+    }
+}
+
+static void enqueue_fix(uint16_t sender_addr, const struct hrtls_model_gw_fix *fix) {
+    startup_mark(STARTUP_FIRST_FIX);
+    if (tracker_submit(sender_addr, fix)) {
+        LOG_WRN("Couldn't fit fix into tracker queue");
+        hrtls_metric_inc(HRTLS_METRIC_TRACKER_QUEUE_DROPS);
+    }
+}
+
+static void zone_event_handler(const struct zones_event *event) {
+    if (k_msgq_put(&zone_events_queue, event, K_NO_WAIT)) {
+        LOG_WRN("Couldn't fit zone event into queue");
+        hrtls_metric_inc(HRTLS_METRIC_ZONE_EVENT_DROPS);
+    }
+}
+
+static void track_handler(uint16_t addr, const struct tracker_track *track) {
+    hrtls_latency_record_since(&latency, LATENCY_TRACK, track->fix.rx_ms);
+    zones_update(addr, &track->fix, zone_event_handler);
+
+    if (IS_ENABLED(CONFIG_HRTLS_GW_STREAM_POSITIONS)) {
+        // tracks go straight to flash while the broker is unreachable,
+        // or when the scheduler runs out of room under overload
+        int err = gw_mqtt_client_is_connected() ? scheduler_submit(addr, track) : -ENOTCONN;
+        if (err && offline_store(addr, track)) {
+            LOG_WRN("Couldn't fit location into queue");
+            hrtls_metric_inc(HRTLS_METRIC_TRACK_DROPS);
+        }
+    }
+    k_work_submit(&mqtt_loc_push_work);
+}
+
+void loc_push_handler(uint16_t sender_addr, const struct hrtls_model_gw_location *location) {
+    HRTLS_TRACE(HRTLS_TRACE_GW_FIX_RX, sender_addr, 1, 0);
+    hrtls_metric_inc(HRTLS_METRIC_FIXES_RX);
+    const uint32_t now = k_uptime_get_32();
+    const struct hrtls_model_gw_fix fix = {
+        .timestamp_ms = now,
+        .rx_ms = now,
+        .x = location->x,
+        .y = location->y,
+        .z = location->z,
+        .err = location->err
+    };
+    enqueue_fix(sender_addr, &fix);
+}
+
+void fix_push_handler(uint16_t sender_addr,
+                      uint16_t recv_dst,
+                      const struct hrtls_model_gw_fix fixes[],
+                      size_t count) {
+    HRTLS_TRACE(HRTLS_TRACE_GW_FIX_RX, sender_addr, count, recv_dst);
+    hrtls_metric_add(HRTLS_METRIC_FIXES_RX, count);
+    // fixes unicast to this gateway are always handled here
+    if (BT_MESH_ADDR_IS_GROUP(recv_dst) && !dedup_is_owned(sender_addr)) {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (dedup_is_duplicate(sender_addr, fixes[i].seq)) {
+            LOG_DBG("Dropping duplicate %" PRIu8 " from addr %" PRIu16, fixes[i].seq, sender_addr);
+            hrtls_metric_inc(HRTLS_METRIC_DUPLICATES);
+            continue;
+        }
+        enqueue_fix(sender_addr, &fixes[i]);
+    }
+}
+
+static void solved_fix_handler(uint16_t addr, const struct hrtls_model_gw_fix *fix) {
+    hrtls_latency_record_since(&latency, LATENCY_SOLVE, fix->rx_ms);
+    enqueue_fix(addr, fix);
+}
+
+void ranges_push_handler(uint16_t sender_addr,
+                         uint16_t recv_dst,
+                         uint8_t seq,
+                         const struct hrtls_model_gw_range ranges[],
+                         size_t count) {
+    HRTLS_TRACE(HRTLS_TRACE_GW_RANGES_RX, sender_addr, count, seq);
+    hrtls_metric_inc(HRTLS_METRIC_RANGES_RX);
+    if (BT_MESH_ADDR_IS_GROUP(recv_dst) && !dedup_is_owned(sender_addr)) {
+        return;
+    }
+
+    if (dedup_is_duplicate(sender_addr, seq)) {
+        LOG_DBG("Dropping duplicate %" PRIu8 " from addr %" PRIu16, seq, sender_addr);
+        hrtls_metric_inc(HRTLS_METRIC_DUPLICATES);
+        return;
+    }
+
+    int err = multilat_submit(sender_addr, seq, ranges, count);
+    if (err) {
+        LOG_WRN("Couldn't fit ranges into queue, %d", err);
+        hrtls_metric_inc(HRTLS_METRIC_RANGES_QUEUE_DROPS);
+    }
+}
+
+void pipeline_initialize(void) {
+    anchor_map_initialize();
+    multilat_initialize(solved_fix_handler);
+    tracker_initialize(track_handler);
+    scheduler_initialize(publish_track);
+    offline_initialize();
+    stats_initialize();
+}
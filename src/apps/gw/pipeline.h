@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <models/gw.h>
+
+// Everything between mesh and MQTT: deduplication, multilateration, tracking,
+// zones and publishing. It doesn't touch the radio nor the network itself,
+// so it can be driven by the simulation as well.
+void pipeline_initialize(void);
+
+void pipeline_connected_handler(void);
+void pipeline_pub_handler(const char *topic, size_t topic_len, uint8_t *payload, size_t len);
+
+void loc_push_handler(uint16_t sender_addr, const struct hrtls_model_gw_location *location);
+void fix_push_handler(uint16_t sender_addr,
+                      uint16_t recv_dst,
+                      const struct hrtls_model_gw_fix fixes[],
+                      size_t count);
+void ranges_push_handler(uint16_t sender_addr,
+                         uint16_t recv_dst,
+                         uint8_t seq,
+                         const struct hrtls_model_gw_range ranges[],
+                         size_t count);
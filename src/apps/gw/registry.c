@@ -0,0 +1,99 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "registry.h"
+
+LOG_MODULE_REGISTER(registry);
+
+#define SLOTS CONFIG_HRTLS_GW_TRACKED_TAGS
+// open addressing table kept at most half full, so probe sequences stay short
+#define BUCKETS (2 * SLOTS)
+#define BUCKET_EMPTY UINT16_MAX
+
+static K_MUTEX_DEFINE(registry_mutex);
+
+static uint16_t slot_addrs[SLOTS];
+static uint16_t slot_generations[SLOTS];
+static uint32_t slot_last_used[SLOTS];
+static uint16_t slots_used;
+static uint32_t use_counter;
+
+static uint16_t buckets[BUCKETS];
+static bool initialized;
+
+static size_t bucket_of(uint16_t addr) {
+    // Fibonacci hashing, so that consecutive addresses spread evenly
+    return (((uint32_t)addr * 2654435761u) >> 16) % BUCKETS;
+}
+
+static size_t find_bucket(uint16_t addr) {
+    size_t bucket = bucket_of(addr);
+    while (buckets[bucket] != BUCKET_EMPTY && slot_addrs[buckets[bucket]] != addr) {
+        bucket = (bucket + 1) % BUCKETS;
+    }
+    return bucket;
+}
+
+// backward shift deletion, keeps every remaining entry reachable from its home bucket
+static void remove_bucket(size_t bucket) {
+    size_t next = bucket;
+    while (true) {
+        next = (next + 1) % BUCKETS;
+        if (buckets[next] == BUCKET_EMPTY) {
+            break;
+        }
+        size_t home = bucket_of(slot_addrs[buckets[next]]);
+        bool movable = bucket <= next ? (home <= bucket || home > next) : (home <= bucket && home > next);
+        if (movable) {
+            buckets[bucket] = buckets[next];
+            bucket = next;
+        }
+    }
+    buckets[bucket] = BUCKET_EMPTY;
+}
+
+static uint16_t evict_lru(void) {
+    uint16_t lru = 0;
+    for (uint16_t i = 1; i < SLOTS; i++) {
+        if (slot_last_used[i] < slot_last_used[lru]) {
+            lru = i;
+        }
+    }
+    LOG_DBG("Evicting addr 0x%04" PRIx16 " from slot %" PRIu16, slot_addrs[lru], lru);
+    remove_bucket(find_bucket(slot_addrs[lru]));
+    return lru;
+}
+
+struct registry_slot registry_lookup(uint16_t addr) {
+    k_mutex_lock(&registry_mutex, K_FOREVER);
+
+    if (!initialized) {
+        for (size_t i = 0; i < BUCKETS; i++) {
+            buckets[i] = BUCKET_EMPTY;
+        }
+        initialized = true;
+    }
+
+    size_t bucket = find_bucket(addr);
+    uint16_t index = buckets[bucket];
+    if (index == BUCKET_EMPTY) {
+        index = slots_used < SLOTS ? slots_used++ : evict_lru();
+        slot_addrs[index] = addr;
+        slot_generations[index]++;
+        // eviction may have shifted entries, so the free bucket is looked up again
+        buckets[find_bucket(addr)] = index;
+    }
+    slot_last_used[index] = ++use_counter;
+
+    const struct registry_slot slot = {
+        .index = index,
+        .generation = slot_generations[index]
+    };
+
+    k_mutex_unlock(&registry_mutex);
+    return slot;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+
+// dense slot of a tag, valid until the tag gets evicted to make room for another one
+struct registry_slot {
+    uint16_t index;
+    // changes whenever the slot is handed over to a different tag
+    uint16_t generation;
+};
+
+// finds the slot of given tag, assigning the least recently seen one if it's unknown
+struct registry_slot registry_lookup(uint16_t addr);
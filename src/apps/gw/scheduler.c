@@ -0,0 +1,252 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <metrics/metrics.h>
+
+#include "registry.h"
+#include "scheduler.h"
+
+LOG_MODULE_REGISTER(scheduler);
+
+#define TAGS CONFIG_HRTLS_GW_TRACKED_TAGS
+#define POOL_LEN CONFIG_HRTLS_GW_PUBLISH_QUEUE_LEN
+// tracks a single tag can have waiting, older ones are dropped to make room
+#define TAG_BACKLOG_MAX 4
+// bytes a tag may publish per round, about a single position message
+#define QUANTUM 128
+// buckets hold up to a second worth of tokens, in thousandths of a message
+#define TAG_BUCKET_MAX (CONFIG_HRTLS_GW_TAG_PUBLISH_RATE * 1000)
+#define GLOBAL_BUCKET_MAX (CONFIG_HRTLS_GW_PUBLISH_RATE * 1000)
+#define TOKEN 1000
+#define NONE UINT16_MAX
+
+BUILD_ASSERT(POOL_LEN < NONE && TAGS < NONE);
+
+struct entry {
+    uint16_t next;
+    uint16_t addr;
+    struct tracker_track track;
+};
+
+struct bucket {
+    uint32_t tokens;
+    uint32_t refilled_ms;
+};
+
+// per tag state indexed by registry slots
+static struct {
+    uint16_t generation[TAGS];
+    uint16_t head[TAGS];
+    uint16_t tail[TAGS];
+    uint8_t count[TAGS];
+    bool active[TAGS];
+    int32_t deficit[TAGS];
+    struct bucket bucket[TAGS];
+} tags;
+
+static struct entry pool[POOL_LEN];
+static uint16_t free_head = NONE;
+static bool pool_initialized;
+
+// round robin order of tags with tracks waiting
+static uint16_t ring[TAGS];
+static size_t ring_start;
+static size_t ring_len;
+
+static struct bucket global_bucket;
+
+static K_MUTEX_DEFINE(scheduler_mutex);
+static scheduler_publish_t *publish_handler;
+
+static void publish_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(publish_work, publish_work_handler);
+
+static void bucket_refill(struct bucket *bucket, uint32_t rate, uint32_t max, uint32_t now) {
+    uint32_t elapsed = now - bucket->refilled_ms;
+    bucket->refilled_ms = now;
+    bucket->tokens = MIN((uint64_t)bucket->tokens + (uint64_t)elapsed * rate, max);
+}
+
+static void pool_free(uint16_t index) {
+    pool[index].next = free_head;
+    free_head = index;
+}
+
+static uint16_t tag_pop(uint16_t slot) {
+    uint16_t index = tags.head[slot];
+    tags.head[slot] = pool[index].next;
+    if (!--tags.count[slot]) {
+        tags.tail[slot] = NONE;
+    }
+    return index;
+}
+
+static void tag_push_front(uint16_t slot, uint16_t index) {
+    pool[index].next = tags.head[slot];
+    tags.head[slot] = index;
+    if (!tags.count[slot]++) {
+        tags.tail[slot] = index;
+    }
+}
+
+static void tag_reset(uint16_t slot, uint16_t generation, uint32_t now) {
+    while (tags.count[slot]) {
+        pool_free(tag_pop(slot));
+    }
+    tags.generation[slot] = generation;
+    tags.head[slot] = tags.tail[slot] = NONE;
+    tags.deficit[slot] = 0;
+    tags.bucket[slot] = (struct bucket) {
+        .tokens = TAG_BUCKET_MAX,
+        .refilled_ms = now
+    };
+}
+
+int scheduler_submit(uint16_t addr, const struct tracker_track *track) {
+    const struct registry_slot slot = registry_lookup(addr);
+    const uint16_t s = slot.index;
+    int res = 0;
+
+    k_mutex_lock(&scheduler_mutex, K_FOREVER);
+
+    if (!pool_initialized) {
+        for (uint16_t i = 0; i < POOL_LEN; i++) {
+            pool_free(i);
+        }
+        for (uint16_t i = 0; i < TAGS; i++) {
+            tags.head[i] = tags.tail[i] = NONE;
+        }
+        pool_initialized = true;
+    }
+
+    if (tags.generation[s] != slot.generation) {
+        tag_reset(s, slot.generation, k_uptime_get_32());
+    }
+
+    // a flooding tag only ever displaces its own tracks
+    if (tags.count[s] == TAG_BACKLOG_MAX) {
+        LOG_DBG("Dropping oldest track of addr 0x%04" PRIx16, addr);
+        hrtls_metric_inc(HRTLS_METRIC_SCHEDULER_DROPS);
+        pool_free(tag_pop(s));
+    }
+
+    if (free_head == NONE) {
+        res = -ENOMEM;
+        goto out;
+    }
+
+    const uint16_t index = free_head;
+    free_head = pool[index].next;
+    pool[index] = (struct entry) {
+        .next = NONE,
+        .addr = addr,
+        .track = *track
+    };
+    if (tags.count[s]++) {
+        pool[tags.tail[s]].next = index;
+    }
+    else {
+        tags.head[s] = index;
+    }
+    tags.tail[s] = index;
+
+    if (!tags.active[s]) {
+        tags.active[s] = true;
+        ring[(ring_start + ring_len++) % TAGS] = s;
+    }
+
+out:
+    k_mutex_unlock(&scheduler_mutex);
+    if (!res) {
+        k_work_schedule(&publish_work, K_NO_WAIT);
+    }
+    return res;
+}
+
+static void publish_work_handler(struct k_work *work) {
+    const uint32_t now = k_uptime_get_32();
+    // time until the next token of any visited tag, if nothing could be sent
+    k_timeout_t retry = K_MSEC(1000 / CONFIG_HRTLS_GW_TAG_PUBLISH_RATE + 1);
+    bool sent = false;
+
+    k_mutex_lock(&scheduler_mutex, K_FOREVER);
+    bucket_refill(&global_bucket, CONFIG_HRTLS_GW_PUBLISH_RATE, GLOBAL_BUCKET_MAX, now);
+
+    // a single round over tags active at its start
+    for (size_t visits = ring_len; visits && global_bucket.tokens >= TOKEN; visits--) {
+        const uint16_t s = ring[ring_start];
+        ring_start = (ring_start + 1) % TAGS;
+        ring_len--;
+
+        struct bucket *bucket = &tags.bucket[s];
+        bucket_refill(bucket, CONFIG_HRTLS_GW_TAG_PUBLISH_RATE, TAG_BUCKET_MAX, now);
+        if (tags.count[s] && bucket->tokens >= TOKEN) {
+            tags.deficit[s] += QUANTUM;
+        }
+
+        while (tags.count[s] && tags.deficit[s] > 0 && bucket->tokens >= TOKEN && global_bucket.tokens >= TOKEN) {
+            const uint16_t index = tag_pop(s);
+            k_mutex_unlock(&scheduler_mutex);
+            int res = publish_handler(pool[index].addr, &pool[index].track);
+            k_mutex_lock(&scheduler_mutex, K_FOREVER);
+
+            if (res == -EAGAIN) {
+                // client isn't connected, tracks wait until scheduler_kick()
+                tag_push_front(s, index);
+                ring_start = (ring_start + TAGS - 1) % TAGS;
+                ring[ring_start] = s;
+                ring_len++;
+                k_mutex_unlock(&scheduler_mutex);
+                return;
+            }
+
+            pool_free(index);
+            sent = true;
+            bucket->tokens -= TOKEN;
+            global_bucket.tokens -= TOKEN;
+            if (res < 0) {
+                LOG_WRN("Loc push failed with res: %d", res);
+                continue;
+            }
+            tags.deficit[s] -= res;
+        }
+
+        if (tags.count[s]) {
+            ring[(ring_start + ring_len++) % TAGS] = s;
+        }
+        else {
+            // idle tags don't bank credit
+            tags.active[s] = false;
+            tags.deficit[s] = 0;
+        }
+    }
+
+    if (global_bucket.tokens < TOKEN) {
+        retry = K_MSEC(1000 / CONFIG_HRTLS_GW_PUBLISH_RATE + 1);
+    }
+    else if (sent) {
+        // next round right away, but other work gets a chance to run in between
+        retry = K_NO_WAIT;
+    }
+    const bool pending = ring_len > 0;
+    k_mutex_unlock(&scheduler_mutex);
+
+    if (pending) {
+        k_work_schedule(&publish_work, retry);
+    }
+}
+
+void scheduler_initialize(scheduler_publish_t *publish) {
+    publish_handler = publish;
+    global_bucket.tokens = GLOBAL_BUCKET_MAX;
+    global_bucket.refilled_ms = k_uptime_get_32();
+}
+
+void scheduler_kick(void) {
+    k_work_reschedule(&publish_work, K_NO_WAIT);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "tracker.h"
+
+// returns number of bytes published, -EAGAIN if the client isn't connected
+typedef int scheduler_publish_t(uint16_t addr, const struct tracker_track *track);
+
+void scheduler_initialize(scheduler_publish_t *publish);
+// queues a track for publishing, returns -ENOMEM if there's no room left
+int scheduler_submit(uint16_t addr, const struct tracker_track *track);
+// resumes publishing, e.g. after reconnecting
+void scheduler_kick(void);
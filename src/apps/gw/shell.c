@@ -0,0 +1,61 @@
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <zephyr/shell/shell.h>
+
+#include <metrics/metrics.h>
+
+#include "latency.h"
+#include "startup.h"
+
+static int cmd_startup(const struct shell *sh, size_t argc, char **argv) {
+    for (enum startup_stage stage = 0; stage < STARTUP_STAGES_COUNT; stage++) {
+        int64_t time_ms = startup_stage_time(stage);
+        if (time_ms < 0) {
+            shell_print(sh, "%-16s -", startup_stage_name(stage));
+        }
+        else {
+            shell_print(sh, "%-16s %" PRId64 " ms", startup_stage_name(stage), time_ms);
+        }
+    }
+    return 0;
+}
+
+static int cmd_latency(const struct shell *sh, size_t argc, char **argv) {
+    hrtls_latency_print(&latency, sh);
+    return 0;
+}
+
+static int cmd_latency_reset(const struct shell *sh, size_t argc, char **argv) {
+    hrtls_latency_reset(&latency);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(latency_cmds,
+    SHELL_CMD(reset, NULL, "Clear latency histograms", cmd_latency_reset),
+    SHELL_SUBCMD_SET_END
+);
+
+static int cmd_stats(const struct shell *sh, size_t argc, char **argv) {
+    hrtls_metrics_print(sh);
+    return 0;
+}
+
+static int cmd_stats_reset(const struct shell *sh, size_t argc, char **argv) {
+    hrtls_metrics_reset();
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(stats_cmds,
+    SHELL_CMD(reset, NULL, "Clear counters and histograms", cmd_stats_reset),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(hrtls_cmds,
+    SHELL_CMD(startup, NULL, "Print uptime at which startup stages were reached", cmd_startup),
+    SHELL_CMD(latency, &latency_cmds, "Print latency percentiles of fix pipeline stages", cmd_latency),
+    SHELL_CMD(stats, &stats_cmds, "Print runtime metrics", cmd_stats),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(hrtls, &hrtls_cmds, "HyperRTLS commands", NULL);
@@ -0,0 +1,49 @@
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+
+#include "startup.h"
+
+LOG_MODULE_REGISTER(startup);
+
+static const char *const stage_names[] = {
+    [STARTUP_MAIN] = "main",
+    [STARTUP_BT_READY] = "bt_ready",
+    [STARTUP_MESH_READY] = "mesh_ready",
+    [STARTUP_IFACE_UP] = "iface_up",
+    [STARTUP_NET_CONNECTED] = "net_connected",
+    [STARTUP_MQTT_CONNECTED] = "mqtt_connected",
+    [STARTUP_FIRST_FIX] = "first_fix",
+    [STARTUP_FIRST_PUBLISH] = "first_publish"
+};
+
+BUILD_ASSERT(ARRAY_SIZE(stage_names) == STARTUP_STAGES_COUNT);
+
+static ATOMIC_DEFINE(reached, STARTUP_STAGES_COUNT);
+static uint32_t stage_times_ms[STARTUP_STAGES_COUNT];
+
+void startup_mark(enum startup_stage stage) {
+    if (atomic_test_bit(reached, stage)) {
+        return;
+    }
+
+    // the time is published by setting the bit, atomic operations are full barriers,
+    // threads reaching a stage at the same time store about the same time anyway
+    uint32_t now = k_uptime_get_32();
+    stage_times_ms[stage] = now;
+    if (atomic_test_and_set_bit(reached, stage)) {
+        return;
+    }
+    LOG_INF("Startup stage %s reached at %" PRIu32 " ms", stage_names[stage], now);
+}
+
+int64_t startup_stage_time(enum startup_stage stage) {
+    return atomic_test_bit(reached, stage) ? stage_times_ms[stage] : -1;
+}
+
+const char *startup_stage_name(enum startup_stage stage) {
+    return stage_names[stage];
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+enum startup_stage {
+    STARTUP_MAIN,
+    STARTUP_BT_READY,
+    STARTUP_MESH_READY,
+    STARTUP_IFACE_UP,
+    STARTUP_NET_CONNECTED,
+    STARTUP_MQTT_CONNECTED,
+    STARTUP_FIRST_FIX,
+    STARTUP_FIRST_PUBLISH,
+    STARTUP_STAGES_COUNT
+};
+
+// records uptime of the first time given stage has been reached
+void startup_mark(enum startup_stage stage);
+// ms since boot, negative if the stage hasn't been reached yet
+int64_t startup_stage_time(enum startup_stage stage);
+const char *startup_stage_name(enum startup_stage stage);
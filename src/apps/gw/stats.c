@@ -0,0 +1,58 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <metrics/metrics.h>
+#include <stats/latency.h>
+
+#include "latency.h"
+#include "mqtt.h"
+#include "stats.h"
+
+LOG_MODULE_REGISTER(stats);
+
+struct publisher {
+    const char *topic;
+    uint32_t period_s;
+    int (*to_json)(char *buf, size_t size);
+    struct k_work_delayable work;
+};
+
+static int latency_to_json(char *buf, size_t size) {
+    return hrtls_latency_to_json(&latency, buf, size);
+}
+
+static struct publisher publishers[] = {
+    { "gateways/gateway_1/stats/metrics", CONFIG_HRTLS_GW_METRICS_PERIOD_S, hrtls_metrics_to_json },
+    { "gateways/gateway_1/stats/latency", CONFIG_HRTLS_GW_LATENCY_STATS_PERIOD_S, latency_to_json },
+};
+
+static void publish_work_handler(struct k_work *work) {
+    // all publishers run on the system work queue, so they can share the buffer
+    static char msg_buf[1024];
+    struct publisher *publisher = CONTAINER_OF(k_work_delayable_from_work(work), struct publisher, work);
+
+    int len = publisher->to_json(msg_buf, sizeof(msg_buf));
+    if (len > 0) {
+        int res = gw_mqtt_client_try_publishing(publisher->topic, (const uint8_t *)msg_buf, len);
+        if (res && res != -EAGAIN) {
+            LOG_WRN("Stats push to %s failed with res: %d", publisher->topic, res);
+        }
+    }
+    else {
+        LOG_WRN("Stats for %s don't fit into message buffer", publisher->topic);
+    }
+    k_work_schedule(&publisher->work, K_SECONDS(publisher->period_s));
+}
+
+void stats_initialize(void) {
+    for (size_t i = 0; i < ARRAY_SIZE(publishers); i++) {
+        k_work_init_delayable(&publishers[i].work, publish_work_handler);
+        if (publishers[i].period_s) {
+            k_work_schedule(&publishers[i].work, K_SECONDS(publishers[i].period_s));
+        }
+    }
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// starts periodic publishing of runtime metrics and latency percentiles, if enabled
+void stats_initialize(void);
@@ -0,0 +1,231 @@
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "registry.h"
+#include "tracker.h"
+
+LOG_MODULE_REGISTER(tracker);
+
+#define TRACKS CONFIG_HRTLS_GW_TRACKED_TAGS
+#define BATCH_MAX 32
+#define AXES 3
+
+// tracks not updated for that long start over from the next fix
+#define TRACK_TIMEOUT_S 5.0f
+// fixes without an error estimate are assumed to be that accurate, in m
+#define DEFAULT_FIX_ERR 0.1f
+// initial velocity variance of a new track, in (m/s)^2
+#define INITIAL_VELOCITY_VAR 4.0f
+// white acceleration noise variance, in (m/s^2)^2
+#define ACCEL_VAR (((float)CONFIG_HRTLS_GW_TRACKER_ACCEL_NOISE_MM / 1000) * ((float)CONFIG_HRTLS_GW_TRACKER_ACCEL_NOISE_MM / 1000))
+
+struct tag_fix {
+    uint16_t addr;
+    struct hrtls_model_gw_fix fix;
+};
+
+// Constant velocity filter state of all tracks, in m and s. Axes are
+// filtered independently with the same process and measurement noise,
+// so a single 2x2 covariance [[p_pp, p_pv], [p_pv, p_vv]] serves all three.
+static struct {
+    uint16_t generation[TRACKS];
+    uint32_t timestamp_ms[TRACKS];
+    float pos[AXES][TRACKS];
+    float vel[AXES][TRACKS];
+    float p_pp[TRACKS];
+    float p_pv[TRACKS];
+    float p_vv[TRACKS];
+} tracks;
+
+// fixes of a single batch, each tag appears at most once
+static struct {
+    size_t count;
+    uint16_t addr[BATCH_MAX];
+    uint16_t track[BATCH_MAX];
+    bool fresh[BATCH_MAX];
+    uint8_t seq[BATCH_MAX];
+    uint32_t timestamp_ms[BATCH_MAX];
+    uint32_t rx_ms[BATCH_MAX];
+    float dt[BATCH_MAX];
+    float meas[AXES][BATCH_MAX];
+    float meas_var[BATCH_MAX];
+} batch;
+
+// marks tracks already present in the current batch
+static uint32_t batch_id;
+static uint32_t track_batch_id[TRACKS];
+
+static void track_work_handler(struct k_work *work);
+static K_WORK_DEFINE(track_work, track_work_handler);
+K_MSGQ_DEFINE(fixes_queue, sizeof(struct tag_fix), 2 * BATCH_MAX, 4);
+
+static tracker_track_handler_t *track_handler;
+
+// returns false if the tag is in the batch already and has to wait for the next one
+static bool batch_add(const struct tag_fix *tag_fix) {
+    const struct registry_slot slot = registry_lookup(tag_fix->addr);
+    if (track_batch_id[slot.index] == batch_id) {
+        return false;
+    }
+    track_batch_id[slot.index] = batch_id;
+
+    const size_t i = batch.count++;
+    const struct hrtls_model_gw_fix *fix = &tag_fix->fix;
+    const float err = fix->err ? (float)fix->err / 1000 : DEFAULT_FIX_ERR;
+
+    batch.addr[i] = tag_fix->addr;
+    batch.track[i] = slot.index;
+    batch.seq[i] = fix->seq;
+    batch.timestamp_ms[i] = fix->timestamp_ms;
+    batch.rx_ms[i] = fix->rx_ms;
+    batch.meas[0][i] = (float)fix->x / 1000;
+    batch.meas[1][i] = (float)fix->y / 1000;
+    batch.meas[2][i] = (float)fix->z / 1000;
+    batch.meas_var[i] = err * err;
+
+    // timestamps of the same tag may come from different clocks, anything odd restarts the track
+    batch.dt[i] = (float)(int32_t)(fix->timestamp_ms - tracks.timestamp_ms[slot.index]) / 1000;
+    batch.fresh[i] = tracks.generation[slot.index] != slot.generation
+                     || batch.dt[i] < 0
+                     || batch.dt[i] > TRACK_TIMEOUT_S;
+    tracks.generation[slot.index] = slot.generation;
+    tracks.timestamp_ms[slot.index] = fix->timestamp_ms;
+    return true;
+}
+
+static void batch_start_tracks(void) {
+    for (size_t i = 0; i < batch.count; i++) {
+        if (!batch.fresh[i]) {
+            continue;
+        }
+        const uint16_t t = batch.track[i];
+        for (size_t axis = 0; axis < AXES; axis++) {
+            tracks.pos[axis][t] = batch.meas[axis][i];
+            tracks.vel[axis][t] = 0;
+        }
+        tracks.p_pp[t] = batch.meas_var[i];
+        tracks.p_pv[t] = 0;
+        tracks.p_vv[t] = INITIAL_VELOCITY_VAR;
+        // nothing to predict nor update, first fix is taken as is
+        batch.dt[i] = 0;
+        batch.meas_var[i] = INFINITY;
+    }
+}
+
+static void batch_predict(void) {
+    for (size_t axis = 0; axis < AXES; axis++) {
+        float *pos = tracks.pos[axis];
+        const float *vel = tracks.vel[axis];
+        for (size_t i = 0; i < batch.count; i++) {
+            pos[batch.track[i]] += vel[batch.track[i]] * batch.dt[i];
+        }
+    }
+
+    for (size_t i = 0; i < batch.count; i++) {
+        const uint16_t t = batch.track[i];
+        const float dt = batch.dt[i];
+        const float q = ACCEL_VAR * dt * dt;
+        tracks.p_pp[t] += dt * (2 * tracks.p_pv[t] + dt * tracks.p_vv[t]) + q * dt * dt / 4;
+        tracks.p_pv[t] += dt * tracks.p_vv[t] + q * dt / 2;
+        tracks.p_vv[t] += q;
+    }
+}
+
+static void batch_update(void) {
+    float gain_pos[BATCH_MAX];
+    float gain_vel[BATCH_MAX];
+    for (size_t i = 0; i < batch.count; i++) {
+        const uint16_t t = batch.track[i];
+        if (isinf(batch.meas_var[i])) {
+            gain_pos[i] = 0;
+            gain_vel[i] = 0;
+            continue;
+        }
+        const float innovation_var = tracks.p_pp[t] + batch.meas_var[i];
+        gain_pos[i] = tracks.p_pp[t] / innovation_var;
+        gain_vel[i] = tracks.p_pv[t] / innovation_var;
+    }
+
+    for (size_t axis = 0; axis < AXES; axis++) {
+        float *pos = tracks.pos[axis];
+        float *vel = tracks.vel[axis];
+        const float *meas = batch.meas[axis];
+        for (size_t i = 0; i < batch.count; i++) {
+            const uint16_t t = batch.track[i];
+            const float innovation = meas[i] - pos[t];
+            pos[t] += gain_pos[i] * innovation;
+            vel[t] += gain_vel[i] * innovation;
+        }
+    }
+
+    for (size_t i = 0; i < batch.count; i++) {
+        const uint16_t t = batch.track[i];
+        tracks.p_vv[t] -= gain_vel[i] * tracks.p_pv[t];
+        tracks.p_pv[t] -= gain_pos[i] * tracks.p_pv[t];
+        tracks.p_pp[t] -= gain_pos[i] * tracks.p_pp[t];
+    }
+}
+
+static void batch_publish(void) {
+    const uint32_t now = k_uptime_get_32();
+    for (size_t i = 0; i < batch.count; i++) {
+        const uint16_t t = batch.track[i];
+        const struct tracker_track track = {
+            .fix = {
+                .seq = batch.seq[i],
+                .timestamp_ms = batch.timestamp_ms[i],
+                .rx_ms = batch.rx_ms[i],
+                .x = tracks.pos[0][t] * 1000,
+                .y = tracks.pos[1][t] * 1000,
+                .z = tracks.pos[2][t] * 1000,
+                .err = sqrtf(tracks.p_pp[t]) * 1000
+            },
+            .vx = tracks.vel[0][t] * 1000,
+            .vy = tracks.vel[1][t] * 1000,
+            .vz = tracks.vel[2][t] * 1000,
+            .tracked_ms = now
+        };
+        track_handler(batch.addr[i], &track);
+    }
+}
+
+static void track_work_handler(struct k_work *work) {
+    struct tag_fix tag_fix;
+    while (!k_msgq_peek(&fixes_queue, &tag_fix)) {
+        batch.count = 0;
+        batch_id++;
+        while (batch.count < BATCH_MAX && !k_msgq_peek(&fixes_queue, &tag_fix) && batch_add(&tag_fix)) {
+            k_msgq_get(&fixes_queue, &tag_fix, K_NO_WAIT);
+        }
+
+        batch_start_tracks();
+        batch_predict();
+        batch_update();
+        batch_publish();
+        LOG_DBG("Updated %zu tracks", batch.count);
+    }
+}
+
+void tracker_initialize(tracker_track_handler_t *handler) {
+    track_handler = handler;
+}
+
+int tracker_submit(uint16_t addr, const struct hrtls_model_gw_fix *fix) {
+    const struct tag_fix tag_fix = {
+        .addr = addr,
+        .fix = *fix
+    };
+
+    int res = k_msgq_put(&fixes_queue, &tag_fix, K_NO_WAIT);
+    if (res) {
+        return res;
+    }
+    k_work_submit(&track_work);
+    return 0;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <models/gw.h>
+
+struct tracker_track {
+    // smoothed position, err is its standard deviation
+    struct hrtls_model_gw_fix fix;
+    // in mm/s
+    int32_t vx;
+    int32_t vy;
+    int32_t vz;
+    // receiver's clock when the track got updated, for latency tracing
+    uint32_t tracked_ms;
+};
+
+typedef void tracker_track_handler_t(uint16_t addr, const struct tracker_track *track);
+
+void tracker_initialize(tracker_track_handler_t *handler);
+// queues a fix, tracks of all queued tags are updated together
+int tracker_submit(uint16_t addr, const struct hrtls_model_gw_fix *fix);
@@ -0,0 +1,321 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <zephyr/data/json.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "registry.h"
+#include "zones.h"
+
+LOG_MODULE_REGISTER(zones);
+
+#define ZONES_MAX CONFIG_HRTLS_GW_ZONES
+#define ZONE_VERTICES_MAX 16
+// zones a single tag can be in at the same time
+#define MEMBERSHIPS_MAX 4
+#define GRID_DIM 16
+
+BUILD_ASSERT(ZONES_MAX <= 32, "zone sets of grid cells are 32 bit masks");
+
+// Zones are 2D, in mm, either an axis aligned box or a simple polygon:
+// {"zones":[{"id":1,"box":[x0,y0,x1,y1]},
+//           {"id":2,"polygon":[x0,y0,x1,y1,x2,y2,...],"dwell_ms":30000}]}
+// dwell_ms is optional, 0 or missing disables dwell events of the zone.
+struct zone_json {
+    int32_t id;
+    int32_t box[4];
+    size_t box_len;
+    int32_t polygon[2 * ZONE_VERTICES_MAX];
+    size_t polygon_len;
+    int32_t dwell_ms;
+};
+
+struct zones_json {
+    struct zone_json zones[ZONES_MAX];
+    size_t zones_len;
+};
+
+static const struct json_obj_descr zone_json_descr[] = {
+    JSON_OBJ_DESCR_PRIM(struct zone_json, id, JSON_TOK_NUMBER),
+    JSON_OBJ_DESCR_ARRAY(struct zone_json, box, 4, box_len, JSON_TOK_NUMBER),
+    JSON_OBJ_DESCR_ARRAY(struct zone_json, polygon, 2 * ZONE_VERTICES_MAX, polygon_len, JSON_TOK_NUMBER),
+    JSON_OBJ_DESCR_PRIM(struct zone_json, dwell_ms, JSON_TOK_NUMBER),
+};
+
+static const struct json_obj_descr zones_json_descr[] = {
+    JSON_OBJ_DESCR_OBJ_ARRAY(struct zones_json, zones, ZONES_MAX, zones_len,
+                             zone_json_descr, ARRAY_SIZE(zone_json_descr)),
+};
+
+struct zone {
+    uint16_t id;
+    bool is_box;
+    uint32_t dwell_ms;
+    int32_t min_x;
+    int32_t min_y;
+    int32_t max_x;
+    int32_t max_y;
+    size_t vertices;
+    int32_t xs[ZONE_VERTICES_MAX];
+    int32_t ys[ZONE_VERTICES_MAX];
+};
+
+// zones indexed by a uniform grid spanning all of them, every cell holds
+// the set of zones whose bounding box overlaps it
+struct zone_set {
+    size_t count;
+    struct zone zones[ZONES_MAX];
+    int32_t origin_x;
+    int32_t origin_y;
+    int32_t cell_w;
+    int32_t cell_h;
+    uint32_t cells[GRID_DIM][GRID_DIM];
+};
+
+struct membership {
+    uint16_t zone_id;
+    bool dwell_reported;
+    uint32_t entered_ms;
+};
+
+struct tag_zones {
+    uint16_t generation;
+    size_t count;
+    struct membership memberships[MEMBERSHIPS_MAX];
+};
+
+static K_MUTEX_DEFINE(zones_mutex);
+static struct zone_set zone_set;
+static struct tag_zones tags[CONFIG_HRTLS_GW_TRACKED_TAGS];
+
+static const char *const event_names[] = {
+    [ZONES_EVENT_ENTER] = "enter",
+    [ZONES_EVENT_EXIT] = "exit",
+    [ZONES_EVENT_DWELL] = "dwell"
+};
+
+const char *zones_event_name(enum zones_event_type type) {
+    return type < ARRAY_SIZE(event_names) ? event_names[type] : "unknown";
+}
+
+static int zone_from_json(const struct zone_json *json, struct zone *zone) {
+    if (json->id <= 0 || json->id > UINT16_MAX || json->dwell_ms < 0) {
+        return -EINVAL;
+    }
+
+    *zone = (struct zone) {
+        .id = json->id,
+        .dwell_ms = json->dwell_ms
+    };
+
+    if (json->box_len == 4) {
+        zone->is_box = true;
+        zone->min_x = MIN(json->box[0], json->box[2]);
+        zone->min_y = MIN(json->box[1], json->box[3]);
+        zone->max_x = MAX(json->box[0], json->box[2]);
+        zone->max_y = MAX(json->box[1], json->box[3]);
+        return 0;
+    }
+
+    if (json->polygon_len < 6 || json->polygon_len % 2) {
+        return -EINVAL;
+    }
+
+    zone->vertices = json->polygon_len / 2;
+    zone->min_x = zone->max_x = json->polygon[0];
+    zone->min_y = zone->max_y = json->polygon[1];
+    for (size_t i = 0; i < zone->vertices; i++) {
+        zone->xs[i] = json->polygon[2 * i];
+        zone->ys[i] = json->polygon[2 * i + 1];
+        zone->min_x = MIN(zone->min_x, zone->xs[i]);
+        zone->min_y = MIN(zone->min_y, zone->ys[i]);
+        zone->max_x = MAX(zone->max_x, zone->xs[i]);
+        zone->max_y = MAX(zone->max_y, zone->ys[i]);
+    }
+    return 0;
+}
+
+static size_t cell_of(int32_t v, int32_t origin, int32_t cell_size) {
+    return MIN((size_t)(((int64_t)v - origin) / cell_size), GRID_DIM - 1);
+}
+
+static void index_zones(struct zone_set *set) {
+    memset(set->cells, 0, sizeof(set->cells));
+    if (!set->count) {
+        return;
+    }
+
+    int32_t max_x = set->zones[0].max_x;
+    int32_t max_y = set->zones[0].max_y;
+    set->origin_x = set->zones[0].min_x;
+    set->origin_y = set->zones[0].min_y;
+    for (size_t i = 1; i < set->count; i++) {
+        set->origin_x = MIN(set->origin_x, set->zones[i].min_x);
+        set->origin_y = MIN(set->origin_y, set->zones[i].min_y);
+        max_x = MAX(max_x, set->zones[i].max_x);
+        max_y = MAX(max_y, set->zones[i].max_y);
+    }
+    set->cell_w = ((int64_t)max_x - set->origin_x) / GRID_DIM + 1;
+    set->cell_h = ((int64_t)max_y - set->origin_y) / GRID_DIM + 1;
+
+    for (size_t i = 0; i < set->count; i++) {
+        const struct zone *zone = &set->zones[i];
+        size_t x0 = cell_of(zone->min_x, set->origin_x, set->cell_w);
+        size_t x1 = cell_of(zone->max_x, set->origin_x, set->cell_w);
+        size_t y0 = cell_of(zone->min_y, set->origin_y, set->cell_h);
+        size_t y1 = cell_of(zone->max_y, set->origin_y, set->cell_h);
+        for (size_t x = x0; x <= x1; x++) {
+            for (size_t y = y0; y <= y1; y++) {
+                set->cells[x][y] |= BIT(i);
+            }
+        }
+    }
+}
+
+// ray casting, points exactly on an edge may end up on either side
+static bool zone_contains(const struct zone *zone, int32_t x, int32_t y) {
+    if (x < zone->min_x || x > zone->max_x || y < zone->min_y || y > zone->max_y) {
+        return false;
+    }
+    if (zone->is_box) {
+        return true;
+    }
+
+    bool inside = false;
+    for (size_t i = 0, j = zone->vertices - 1; i < zone->vertices; j = i++) {
+        if ((zone->ys[i] > y) == (zone->ys[j] > y)) {
+            continue;
+        }
+        int64_t cross_x = zone->xs[i] + ((int64_t)zone->xs[j] - zone->xs[i]) * ((int64_t)y - zone->ys[i])
+                                        / ((int64_t)zone->ys[j] - zone->ys[i]);
+        if (x < cross_x) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+static uint32_t zones_at(int32_t x, int32_t y) {
+    const struct zone_set *set = &zone_set;
+    if (!set->count || x < set->origin_x || y < set->origin_y) {
+        return 0;
+    }
+
+    int64_t cx = ((int64_t)x - set->origin_x) / set->cell_w;
+    int64_t cy = ((int64_t)y - set->origin_y) / set->cell_h;
+    if (cx >= GRID_DIM || cy >= GRID_DIM) {
+        return 0;
+    }
+
+    uint32_t candidates = set->cells[cx][cy];
+    uint32_t inside = 0;
+    for (size_t i = 0; i < set->count; i++) {
+        if ((candidates & BIT(i)) && zone_contains(&set->zones[i], x, y)) {
+            inside |= BIT(i);
+        }
+    }
+    return inside;
+}
+
+int zones_handle_publish(const char *topic, size_t topic_len, uint8_t *payload, size_t len) {
+    if (topic_len != strlen(ZONES_CONFIG_TOPIC) || memcmp(topic, ZONES_CONFIG_TOPIC, topic_len)) {
+        return -ENOENT;
+    }
+
+    // only the MQTT thread gets here
+    static struct zones_json json;
+    static struct zone_set set;
+
+    memset(&json, 0, sizeof(json));
+    int64_t fields = json_obj_parse((char *)payload, len, zones_json_descr, ARRAY_SIZE(zones_json_descr), &json);
+    if (fields < 0) {
+        LOG_WRN("Invalid zone configuration, %d", (int)fields);
+        return fields;
+    }
+
+    set.count = json.zones_len;
+    for (size_t i = 0; i < set.count; i++) {
+        int err = zone_from_json(&json.zones[i], &set.zones[i]);
+        if (err) {
+            LOG_WRN("Invalid zone at index %zu, %d", i, err);
+            return err;
+        }
+    }
+    index_zones(&set);
+
+    k_mutex_lock(&zones_mutex, K_FOREVER);
+    zone_set = set;
+    k_mutex_unlock(&zones_mutex);
+
+    LOG_INF("Loaded %zu zones", set.count);
+    return 0;
+}
+
+void zones_update(uint16_t addr, const struct hrtls_model_gw_fix *fix, zones_event_handler_t *handler) {
+    const struct registry_slot slot = registry_lookup(addr);
+    const uint32_t now = k_uptime_get_32();
+    struct zones_event event = {
+        .addr = addr,
+        .timestamp_ms = now
+    };
+
+    k_mutex_lock(&zones_mutex, K_FOREVER);
+
+    struct tag_zones *tag = &tags[slot.index];
+    if (tag->generation != slot.generation) {
+        *tag = (struct tag_zones) { .generation = slot.generation };
+    }
+
+    uint32_t inside = zones_at(fix->x, fix->y);
+
+    for (size_t m = 0; m < tag->count;) {
+        struct membership *membership = &tag->memberships[m];
+        const struct zone *zone = NULL;
+        for (size_t i = 0; i < zone_set.count; i++) {
+            if ((inside & BIT(i)) && zone_set.zones[i].id == membership->zone_id) {
+                zone = &zone_set.zones[i];
+                // still inside, nothing to enter
+                inside &= ~BIT(i);
+                break;
+            }
+        }
+
+        event.zone_id = membership->zone_id;
+        if (!zone) {
+            event.type = ZONES_EVENT_EXIT;
+            handler(&event);
+            *membership = tag->memberships[--tag->count];
+            continue;
+        }
+
+        if (zone->dwell_ms && !membership->dwell_reported && now - membership->entered_ms >= zone->dwell_ms) {
+            membership->dwell_reported = true;
+            event.type = ZONES_EVENT_DWELL;
+            handler(&event);
+        }
+        m++;
+    }
+
+    for (size_t i = 0; i < zone_set.count; i++) {
+        if (!(inside & BIT(i))) {
+            continue;
+        }
+        if (tag->count == MEMBERSHIPS_MAX) {
+            LOG_WRN("Addr 0x%04" PRIx16 " is in too many zones", addr);
+            break;
+        }
+        tag->memberships[tag->count++] = (struct membership) {
+            .zone_id = zone_set.zones[i].id,
+            .entered_ms = now
+        };
+        event.zone_id = zone_set.zones[i].id;
+        event.type = ZONES_EVENT_ENTER;
+        handler(&event);
+    }
+
+    k_mutex_unlock(&zones_mutex);
+}
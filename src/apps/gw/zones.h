@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <models/gw.h>
+
+// retained zone configuration, see zones.c for the format
+#define ZONES_CONFIG_TOPIC "gateways/gateway_1/zones"
+
+enum zones_event_type {
+    ZONES_EVENT_ENTER,
+    ZONES_EVENT_EXIT,
+    // tag stayed in the zone for longer than its dwell time, reported once per visit
+    ZONES_EVENT_DWELL
+};
+
+struct zones_event {
+    uint16_t addr;
+    uint16_t zone_id;
+    uint8_t type;
+    uint32_t timestamp_ms;
+};
+
+typedef void zones_event_handler_t(const struct zones_event *event);
+
+// replaces all zones with the ones published on ZONES_CONFIG_TOPIC,
+// returns -ENOENT if it's a different topic
+int zones_handle_publish(const char *topic, size_t topic_len, uint8_t *payload, size_t len);
+// updates zone membership of a tag, calling handler for every transition
+void zones_update(uint16_t addr, const struct hrtls_model_gw_fix *fix, zones_event_handler_t *handler);
+const char *zones_event_name(enum zones_event_type type);
@@ -0,0 +1,222 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <stats/histogram.h>
+#include <uwb/twr.h>
+
+#include "host_time.h"
+#include "bench.h"
+#include "tags.h"
+#include "world.h"
+
+LOG_MODULE_REGISTER(bench);
+
+#define MIN_Z_M 0.5f
+#define MAX_Z_M 2.5f
+// how far the last solved position is from the truth, it only drives anchor selection
+#define LAST_POS_NOISE_M 1.0f
+// anchor's reply delay of SS-TWR, as set up by the anchor firmware
+#define TWR_REPLY_TICKS ((330 + 800) * UUS_TO_DWT_TIME)
+// carrier integrator values of clock offsets within about +-30 ppm
+#define TWR_MAX_CARRIER_INTEGRATOR (1 << 15)
+
+struct bench_dataset {
+    const char *name;
+    struct world_channel channel;
+    size_t measurements;
+};
+
+static const struct bench_dataset datasets[] = {
+    { "ideal/4", { 0, 0 }, RTLS_MIN_MEASUREMENTS },
+    { "ideal/8", { 0, 0 }, RTLS_MAX_MEASUREMENTS },
+    { "noisy/4", { CONFIG_HRTLS_SIM_RANGE_NOISE_MM, 0 }, RTLS_MIN_MEASUREMENTS },
+    { "noisy/8", { CONFIG_HRTLS_SIM_RANGE_NOISE_MM, 0 }, RTLS_MAX_MEASUREMENTS },
+    { "nlos/4", { CONFIG_HRTLS_SIM_RANGE_NOISE_MM, CONFIG_HRTLS_SIM_NLOS_PERCENT }, RTLS_MIN_MEASUREMENTS },
+    { "nlos/8", { CONFIG_HRTLS_SIM_RANGE_NOISE_MM, CONFIG_HRTLS_SIM_NLOS_PERCENT }, RTLS_MAX_MEASUREMENTS },
+};
+
+enum bench_solver {
+    BENCH_SOLVER_FLOAT,
+    BENCH_SOLVER_FIXED,
+    BENCH_SOLVERS_COUNT
+};
+
+static const struct {
+    const char *name;
+    int (*find_position)(const struct rtls_measurement measurements[], size_t n, struct rtls_result *out_result);
+} solvers[] = {
+    [BENCH_SOLVER_FLOAT] = { "float", rtls_find_position },
+    [BENCH_SOLVER_FIXED] = { "fixed", rtls_find_position_fixed },
+};
+
+BUILD_ASSERT(ARRAY_SIZE(solvers) == BENCH_SOLVERS_COUNT);
+
+struct bench_solver_result {
+    uint32_t failures;
+    uint64_t solve_ns_total;
+    struct hrtls_histogram error_mm;
+    struct hrtls_histogram solve_ns;
+};
+
+struct bench_result {
+    uint32_t selection_mismatches;
+    // distance between positions of both solvers, when both succeeded
+    struct hrtls_histogram solvers_diff_mm;
+    struct bench_solver_result solvers[BENCH_SOLVERS_COUNT];
+};
+
+static int64_t dist_pow2_mm(const struct rtls_pos *a, const struct rtls_pos *b) {
+    const int64_t dx = a->x - b->x;
+    const int64_t dy = a->y - b->y;
+    const int64_t dz = a->z - b->z;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// selected anchors have to be sorted by distance and none of the others can be nearer
+static bool selection_is_nearest(const struct rtls_anchor anchors[], size_t n, const struct rtls_pos *pos,
+                                 const size_t indices[], size_t count) {
+    bool selected[CONFIG_HRTLS_SIM_ANCHORS] = { false };
+    int64_t farthest = 0;
+    for (size_t i = 0; i < count; i++) {
+        const int64_t d = dist_pow2_mm(&anchors[indices[i]].pos, pos);
+        if (d < farthest || selected[indices[i]]) {
+            return false;
+        }
+        farthest = d;
+        selected[indices[i]] = true;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (!selected[i] && dist_pow2_mm(&anchors[i].pos, pos) < farthest) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void run_fix(const struct bench_dataset *dataset, struct bench_result *result) {
+    const float area = CONFIG_HRTLS_SIM_AREA_MM / 1000.0f;
+    const struct world_pos truth = {
+        .x = world_uniform() * area,
+        .y = world_uniform() * area,
+        .z = MIN_Z_M + world_uniform() * (MAX_Z_M - MIN_Z_M)
+    };
+    const struct world_pos last_pos = {
+        .x = truth.x + world_gaussian() * LAST_POS_NOISE_M,
+        .y = truth.y + world_gaussian() * LAST_POS_NOISE_M,
+        .z = truth.z
+    };
+
+    const struct rtls_anchor *anchors;
+    const size_t anchors_count = world_anchors(&anchors);
+    const struct rtls_pos last_pos_mm = world_pos_to_mm(&last_pos);
+    size_t indices[RTLS_MAX_MEASUREMENTS];
+    rtls_select_nearby_anchors(anchors, anchors_count, last_pos_mm, indices, dataset->measurements);
+    if (!selection_is_nearest(anchors, anchors_count, &last_pos_mm, indices, dataset->measurements)) {
+        result->selection_mismatches++;
+    }
+
+    struct rtls_measurement measurements[RTLS_MAX_MEASUREMENTS];
+    for (size_t i = 0; i < dataset->measurements; i++) {
+        const struct rtls_anchor *anchor = &anchors[indices[i]];
+        float nlos_likelihood;
+        measurements[i] = (struct rtls_measurement) {
+            .anchor_pos = anchor->pos,
+            .distance = world_twr_over(&dataset->channel, &truth, anchor, &nlos_likelihood) * 1000,
+            .weight = MAX((1 - nlos_likelihood) * UINT8_MAX, SIM_MIN_MEASUREMENT_WEIGHT)
+        };
+    }
+
+    struct world_pos solved[BENCH_SOLVERS_COUNT];
+    bool ok[BENCH_SOLVERS_COUNT];
+    for (enum bench_solver solver = 0; solver < BENCH_SOLVERS_COUNT; solver++) {
+        struct bench_solver_result *solver_result = &result->solvers[solver];
+        struct rtls_result rtls_result;
+        const uint64_t start = host_time_ns();
+        int err = solvers[solver].find_position(measurements, dataset->measurements, &rtls_result);
+        const uint64_t solve_ns = host_time_ns() - start;
+        solver_result->solve_ns_total += solve_ns;
+        hrtls_histogram_record(&solver_result->solve_ns, solve_ns);
+
+        ok[solver] = !err;
+        if (err) {
+            solver_result->failures++;
+            continue;
+        }
+        solved[solver] = world_pos_from_mm(&rtls_result.pos);
+        hrtls_histogram_record(&solver_result->error_mm, world_distance(&solved[solver], &truth) * 1000);
+    }
+
+    if (ok[BENCH_SOLVER_FLOAT] && ok[BENCH_SOLVER_FIXED]) {
+        hrtls_histogram_record(&result->solvers_diff_mm,
+                               world_distance(&solved[BENCH_SOLVER_FLOAT], &solved[BENCH_SOLVER_FIXED]) * 1000);
+    }
+}
+
+static void run_dataset(const struct bench_dataset *dataset) {
+    static struct bench_result result;
+    result = (struct bench_result) { 0 };
+
+    for (uint32_t i = 0; i < CONFIG_HRTLS_SIM_BENCH_FIXES; i++) {
+        run_fix(dataset, &result);
+    }
+
+    LOG_INF("%-8s selection mismatches: %" PRIu32 ", solvers differ by mm p50: %" PRIu32 ", p99: %" PRIu32,
+            dataset->name, result.selection_mismatches,
+            hrtls_histogram_percentile(&result.solvers_diff_mm, 50),
+            hrtls_histogram_percentile(&result.solvers_diff_mm, 99));
+
+    for (enum bench_solver solver = 0; solver < BENCH_SOLVERS_COUNT; solver++) {
+        const struct bench_solver_result *solver_result = &result.solvers[solver];
+        LOG_INF("%-8s %s failures: %" PRIu32 ", error mm p50: %" PRIu32 ", p95: %" PRIu32 ", p99: %" PRIu32
+                ", solve ns mean: %" PRIu64 ", p99: %" PRIu32,
+                dataset->name, solvers[solver].name, solver_result->failures,
+                hrtls_histogram_percentile(&solver_result->error_mm, 50),
+                hrtls_histogram_percentile(&solver_result->error_mm, 95),
+                hrtls_histogram_percentile(&solver_result->error_mm, 99),
+                solver_result->solve_ns_total / CONFIG_HRTLS_SIM_BENCH_FIXES,
+                hrtls_histogram_percentile(&solver_result->solve_ns, 99));
+    }
+}
+
+// SS-TWR distances over random ranges and clock offsets, in um from the exact value
+static void run_twr(void) {
+    static struct hrtls_histogram float_error_um;
+    static struct hrtls_histogram fixed_error_um;
+    const float diagonal = sqrtf(2) * CONFIG_HRTLS_SIM_AREA_MM / 1000.0f;
+
+    for (uint32_t i = 0; i < CONFIG_HRTLS_SIM_BENCH_FIXES; i++) {
+        const double distance = world_uniform() * diagonal;
+        const int32_t carrier_integrator = (int32_t)(world_rand() % (2 * TWR_MAX_CARRIER_INTEGRATOR + 1))
+            - TWR_MAX_CARRIER_INTEGRATOR;
+        const double clock_offset_ratio = -carrier_integrator / (double)(1 << UWB_CARRIER_INTEGRATOR_SHIFT);
+        const uint32_t reply = TWR_REPLY_TICKS;
+        const uint32_t round_trip = lround(reply * (1 - clock_offset_ratio)
+                                           + 2 * distance / SPEED_OF_LIGHT_M_S / DWT_TIME_UNITS);
+
+        const double exact = (round_trip - reply * (1 - clock_offset_ratio)) / 2 * DWT_TIME_UNITS * SPEED_OF_LIGHT_M_S;
+        const double float_m = uwb_ss_twr_distance_m(round_trip, reply, carrier_integrator);
+        const double fixed_m = uwb_ss_twr_distance_mm(round_trip, reply, carrier_integrator) / 1000.0;
+        hrtls_histogram_record(&float_error_um, fabs(float_m - exact) * 1e6);
+        hrtls_histogram_record(&fixed_error_um, fabs(fixed_m - exact) * 1e6);
+    }
+
+    LOG_INF("twr      float error um p50: %" PRIu32 ", p99: %" PRIu32 ", fixed error um p50: %" PRIu32 ", p99: %" PRIu32,
+            hrtls_histogram_percentile(&float_error_um, 50), hrtls_histogram_percentile(&float_error_um, 99),
+            hrtls_histogram_percentile(&fixed_error_um, 50), hrtls_histogram_percentile(&fixed_error_um, 99));
+}
+
+void bench_solver_run(void) {
+    LOG_INF("Benchmarking the solver over %d fixes per dataset, %d anchors, seed %d",
+            CONFIG_HRTLS_SIM_BENCH_FIXES, CONFIG_HRTLS_SIM_ANCHORS, CONFIG_HRTLS_SIM_SEED);
+
+    for (size_t i = 0; i < ARRAY_SIZE(datasets); i++) {
+        run_dataset(&datasets[i]);
+    }
+    run_twr();
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// Runs the tag's positioning math over generated datasets with known ground truth
+// and prints accuracy and run time of both the float and the fixed-point solver for each,
+// then the error of SS-TWR distances of both. This is the throughput harness, accuracy
+// is asserted per fix by the tests/rtls suite.
+void bench_solver_run(void);
@@ -0,0 +1,139 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <stats/histogram.h>
+
+#include "gw/mqtt.h"
+#include "gw/pipeline.h"
+#include "gw/zones.h"
+#include "broker.h"
+#include "tags.h"
+#include "world.h"
+
+LOG_MODULE_REGISTER(broker);
+
+#define POSITION_TOPIC_FORMAT "gateways/gateway_1/tags/%4" SCNx16 "/position"
+#define POSITION_FORMAT "{\"position\":[%f,%f,%f]"
+
+// a single zone covering the bottom left quarter of the area
+#define ZONES_FORMAT "{\"zones\":[{\"id\":1,\"box\":[0,0,%d,%d],\"dwell_ms\":10000}]}"
+
+enum topic_kind {
+    TOPIC_POSITION,
+    TOPIC_ZONES,
+    TOPIC_HISTORY,
+    TOPIC_STATS,
+    TOPIC_OTHER,
+    TOPIC_KINDS_COUNT
+};
+
+static const char *const kind_names[] = {
+    [TOPIC_POSITION] = "position",
+    [TOPIC_ZONES] = "zones",
+    [TOPIC_HISTORY] = "history",
+    [TOPIC_STATS] = "stats",
+    [TOPIC_OTHER] = "other"
+};
+
+BUILD_ASSERT(ARRAY_SIZE(kind_names) == TOPIC_KINDS_COUNT);
+
+static K_MUTEX_DEFINE(broker_mutex);
+static bool connected;
+static uint32_t messages[TOPIC_KINDS_COUNT];
+static uint64_t bytes[TOPIC_KINDS_COUNT];
+// distance between published and true position, in mm
+static struct hrtls_histogram error_mm;
+
+static bool ends_with(const char *str, const char *suffix) {
+    const size_t len = strlen(str);
+    const size_t suffix_len = strlen(suffix);
+    return len >= suffix_len && !strcmp(str + len - suffix_len, suffix);
+}
+
+static enum topic_kind classify(const char *topic) {
+    if (ends_with(topic, "/position")) {
+        return TOPIC_POSITION;
+    }
+    if (ends_with(topic, "/zones")) {
+        return TOPIC_ZONES;
+    }
+    if (ends_with(topic, "/history")) {
+        return TOPIC_HISTORY;
+    }
+    if (strstr(topic, "/stats/")) {
+        return TOPIC_STATS;
+    }
+    return TOPIC_OTHER;
+}
+
+static void check_position(const char *topic, const uint8_t *message, size_t len) {
+    char buf[128];
+    uint16_t addr;
+    struct world_pos published;
+    struct world_pos truth;
+
+    memcpy(buf, message, MIN(len, sizeof(buf) - 1));
+    buf[MIN(len, sizeof(buf) - 1)] = '\0';
+    if (sscanf(topic, POSITION_TOPIC_FORMAT, &addr) != 1
+        || sscanf(buf, POSITION_FORMAT, &published.x, &published.y, &published.z) != 3
+        || !tags_true_position(addr, &truth)) {
+        LOG_WRN("Unexpected position on %s", topic);
+        return;
+    }
+    hrtls_histogram_record(&error_mm, world_distance(&published, &truth) * 1000);
+}
+
+bool gw_mqtt_client_is_connected(void) {
+    return connected;
+}
+
+int gw_mqtt_client_try_publishing(const char *topic, const uint8_t *message, size_t len) {
+    if (!connected) {
+        return -EAGAIN;
+    }
+
+    const enum topic_kind kind = classify(topic);
+    if (kind == TOPIC_POSITION) {
+        check_position(topic, message, len);
+    }
+
+    k_mutex_lock(&broker_mutex, K_FOREVER);
+    messages[kind]++;
+    bytes[kind] += len;
+    k_mutex_unlock(&broker_mutex);
+    return 0;
+}
+
+void broker_publish(const char *topic, const char *payload) {
+    static uint8_t buf[512];
+    const size_t len = MIN(strlen(payload), sizeof(buf));
+    // handlers may modify the payload in place
+    memcpy(buf, payload, len);
+    pipeline_pub_handler(topic, strlen(topic), buf, len);
+}
+
+void broker_initialize(void) {
+    connected = true;
+    pipeline_connected_handler();
+
+    char zones[128];
+    snprintf(zones, sizeof(zones), ZONES_FORMAT, CONFIG_HRTLS_SIM_AREA_MM / 2, CONFIG_HRTLS_SIM_AREA_MM / 2);
+    broker_publish(ZONES_CONFIG_TOPIC, zones);
+}
+
+void broker_print_report(void) {
+    const uint32_t seconds = MAX(k_uptime_get_32() / 1000, 1);
+    for (enum topic_kind kind = 0; kind < TOPIC_KINDS_COUNT; kind++) {
+        LOG_INF("%-8s messages: %" PRIu32 " (%" PRIu32 "/s), bytes: %" PRIu64,
+                kind_names[kind], messages[kind], messages[kind] / seconds, bytes[kind]);
+    }
+    LOG_INF("published error mm p50: %" PRIu32 ", p99: %" PRIu32,
+            hrtls_histogram_percentile(&error_mm, 50), hrtls_histogram_percentile(&error_mm, 99));
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Local stand-in for the MQTT broker, implements the gateway's MQTT client API,
+// so that the pipeline publishes into it, and checks published positions
+// against the true positions of simulated tags.
+void broker_initialize(void);
+// delivers a message to the pipeline as if it came from the broker
+void broker_publish(const char *topic, const char *payload);
+void broker_print_report(void);
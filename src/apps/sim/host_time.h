@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
+// Monotonic host time, for measuring how long code takes to run.
+// Kernel clocks can't be used for that, simulated time only moves while threads sleep.
+uint64_t host_time_ns(void);
@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/logging/log_ctrl.h>
+
+#include <metrics/metrics.h>
+
+#include "gw/latency.h"
+#include "gw/pipeline.h"
+#include "bench.h"
+#include "broker.h"
+#include "tags.h"
+#include "world.h"
+
+#include <posix_board_if.h>
+
+LOG_MODULE_REGISTER(main);
+
+#define REPORT_PERIOD_MS 10000
+
+static void print_report(void) {
+    LOG_INF("--- %" PRIu32 " s of simulated time, seed %d", k_uptime_get_32() / 1000, CONFIG_HRTLS_SIM_SEED);
+    tags_print_report();
+    broker_print_report();
+    for (enum latency_stage stage = 0; stage < LATENCY_STAGES_COUNT; stage++) {
+        LOG_INF("latency %-8s count: %" PRIu32 ", p50: %" PRIu32 " ms, p99: %" PRIu32 " ms",
+                hrtls_latency_stage_name(&latency, stage), hrtls_latency_count(&latency, stage),
+                hrtls_latency_percentile(&latency, stage, 50), hrtls_latency_percentile(&latency, stage, 99));
+    }
+    for (enum hrtls_metric metric = 0; metric < HRTLS_METRICS_COUNT; metric++) {
+        if (hrtls_metric_get(metric)) {
+            LOG_INF("metric %s: %" PRIu32, hrtls_metric_name(metric), hrtls_metric_get(metric));
+        }
+    }
+}
+
+void main(void) {
+    if (IS_ENABLED(CONFIG_HRTLS_SIM_SOLVER_BENCH)) {
+        world_initialize();
+        bench_solver_run();
+        log_panic();
+        posix_exit(0);
+    }
+
+    LOG_INF("Simulating %d tags and %d anchors for %d s",
+            CONFIG_HRTLS_SIM_TAGS, CONFIG_HRTLS_SIM_ANCHORS, CONFIG_HRTLS_SIM_DURATION_S);
+
+    pipeline_initialize();
+    world_initialize();
+    tags_initialize();
+    broker_initialize();
+
+    const int64_t end_ms = (int64_t)CONFIG_HRTLS_SIM_DURATION_S * 1000;
+    int64_t report_ms = REPORT_PERIOD_MS;
+    while (true) {
+        const int64_t next_ms = MIN(tags_next_ms(), end_ms);
+        const int64_t now_ms = k_uptime_get();
+        if (next_ms > now_ms) {
+            // lets the gateway's work queue catch up in between
+            k_sleep(K_MSEC(next_ms - now_ms));
+        }
+
+        if (k_uptime_get() >= end_ms) {
+            break;
+        }
+        tags_run_due(k_uptime_get());
+
+        if (k_uptime_get() >= report_ms) {
+            print_report();
+            report_ms += REPORT_PERIOD_MS;
+        }
+    }
+
+    // let the pipeline drain what's in flight
+    k_sleep(K_SECONDS(1));
+    print_report();
+    log_panic();
+    posix_exit(0);
+}
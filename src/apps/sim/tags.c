@@ -0,0 +1,232 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <zephyr/bluetooth/mesh.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <models/common.h>
+#include <models/gw.h>
+#include <models/tag.h>
+#include <stats/histogram.h>
+
+#include "gw/mesh/mesh.h"
+#include "gw/pipeline.h"
+#include "host_time.h"
+#include "tags.h"
+#include "world.h"
+
+LOG_MODULE_REGISTER(tags);
+
+#define MAX_SPEED_M_S 1.5f
+#define ACCEL_M_S2 0.5f
+#define TAG_Z_M 1.2f
+
+struct sim_tag {
+    uint16_t addr;
+    uint16_t group_addr;
+    struct world_pos pos;
+    float vx;
+    float vy;
+    // last solved position, used for anchor selection
+    struct rtls_pos last_pos;
+    uint8_t seq;
+    bool raw_ranges;
+    uint32_t period_ms;
+    int64_t next_ms;
+    int64_t moved_ms;
+};
+
+static struct sim_tag tags[CONFIG_HRTLS_SIM_TAGS];
+
+static uint32_t fixes_sent;
+static uint32_t ranges_sent;
+static uint32_t solver_failures;
+static uint32_t commands;
+// distance between solved and true position, in mm
+static struct hrtls_histogram error_mm;
+// solver run time on the host
+static struct hrtls_histogram solve_ns;
+
+static void move(struct sim_tag *tag, int64_t now_ms) {
+    const float dt = (now_ms - tag->moved_ms) / 1000.0f;
+    const float area = CONFIG_HRTLS_SIM_AREA_MM / 1000.0f;
+    tag->moved_ms = now_ms;
+
+    tag->vx = CLAMP(tag->vx + world_gaussian() * ACCEL_M_S2 * dt, -MAX_SPEED_M_S, MAX_SPEED_M_S);
+    tag->vy = CLAMP(tag->vy + world_gaussian() * ACCEL_M_S2 * dt, -MAX_SPEED_M_S, MAX_SPEED_M_S);
+    tag->pos.x += tag->vx * dt;
+    tag->pos.y += tag->vy * dt;
+
+    // bounce off the walls
+    if (tag->pos.x < 0 || tag->pos.x > area) {
+        tag->vx = -tag->vx;
+        tag->pos.x = CLAMP(tag->pos.x, 0, area);
+    }
+    if (tag->pos.y < 0 || tag->pos.y > area) {
+        tag->vy = -tag->vy;
+        tag->pos.y = CLAMP(tag->pos.y, 0, area);
+    }
+}
+
+static size_t measure(struct sim_tag *tag, struct rtls_measurement out_measurements[], uint16_t out_addrs[]) {
+    const struct rtls_anchor *anchors;
+    const size_t anchors_count = world_anchors(&anchors);
+    const size_t count = MIN(anchors_count, RTLS_MAX_MEASUREMENTS);
+    size_t indices[RTLS_MAX_MEASUREMENTS];
+    rtls_select_nearby_anchors(anchors, anchors_count, tag->last_pos, indices, count);
+
+    for (size_t i = 0; i < count; i++) {
+        const struct rtls_anchor *anchor = &anchors[indices[i]];
+        float nlos_likelihood;
+        out_measurements[i] = (struct rtls_measurement) {
+            .anchor_pos = anchor->pos,
+            .distance = world_twr(&tag->pos, anchor, &nlos_likelihood) * 1000,
+            .weight = MAX((1 - nlos_likelihood) * UINT8_MAX, SIM_MIN_MEASUREMENT_WEIGHT)
+        };
+        out_addrs[i] = anchor->addr;
+    }
+    return count;
+}
+
+static void send_ranges(struct sim_tag *tag, const struct rtls_measurement measurements[],
+                        const uint16_t addrs[], size_t count) {
+    struct hrtls_model_gw_range ranges[RTLS_MAX_MEASUREMENTS];
+    for (size_t i = 0; i < count; i++) {
+        ranges[i] = (struct hrtls_model_gw_range) {
+            .anchor_addr = addrs[i],
+            .distance_mm = MAX(measurements[i].distance, 0),
+            .nlos = UINT8_MAX - measurements[i].weight
+        };
+    }
+    ranges_push_handler(tag->addr, SIM_GW_ADDR, tag->seq++, ranges, count);
+    ranges_sent++;
+
+    // the tag doesn't know where it is, the true position stands in for anchor selection
+    tag->last_pos = world_pos_to_mm(&tag->pos);
+}
+
+static void send_fix(struct sim_tag *tag, const struct rtls_measurement measurements[], size_t count) {
+    struct rtls_result result;
+    const uint64_t start = host_time_ns();
+    int err = IS_ENABLED(CONFIG_HRTLS_TAG_FIXED_POINT)
+        ? rtls_find_position_fixed(measurements, count, &result)
+        : rtls_find_position(measurements, count, &result);
+    hrtls_histogram_record(&solve_ns, host_time_ns() - start);
+    if (err) {
+        solver_failures++;
+        return;
+    }
+
+    tag->last_pos = result.pos;
+    const struct world_pos solved = world_pos_from_mm(&result.pos);
+    hrtls_histogram_record(&error_mm, world_distance(&solved, &tag->pos) * 1000);
+
+    const uint32_t now = k_uptime_get_32();
+    const struct hrtls_model_gw_fix fix = {
+        .seq = tag->seq++,
+        .timestamp_ms = now,
+        .rx_ms = now,
+        .x = result.pos.x,
+        .y = result.pos.y,
+        .z = result.pos.z,
+        .err = result.error
+    };
+    fix_push_handler(tag->addr, SIM_GW_ADDR, &fix, 1);
+    fixes_sent++;
+}
+
+static void run(struct sim_tag *tag, int64_t now_ms) {
+    move(tag, now_ms);
+
+    struct rtls_measurement measurements[RTLS_MAX_MEASUREMENTS];
+    uint16_t addrs[RTLS_MAX_MEASUREMENTS];
+    const size_t count = measure(tag, measurements, addrs);
+    if (tag->raw_ranges) {
+        send_ranges(tag, measurements, addrs, count);
+    }
+    else {
+        send_fix(tag, measurements, count);
+    }
+
+    tag->next_ms += tag->period_ms;
+}
+
+void tags_initialize(void) {
+    const float area = CONFIG_HRTLS_SIM_AREA_MM / 1000.0f;
+    for (size_t i = 0; i < ARRAY_SIZE(tags); i++) {
+        struct sim_tag *tag = &tags[i];
+        *tag = (struct sim_tag) {
+            .addr = SIM_TAG_ADDR_BASE + i,
+            .pos = {
+                .x = world_uniform() * area,
+                .y = world_uniform() * area,
+                .z = TAG_Z_M
+            },
+            .vx = world_gaussian() * MAX_SPEED_M_S / 2,
+            .vy = world_gaussian() * MAX_SPEED_M_S / 2,
+            .raw_ranges = world_rand() % 100 < CONFIG_HRTLS_SIM_RAW_RANGE_PERCENT,
+            .period_ms = CONFIG_HRTLS_SIM_PERIOD_MS,
+            // spread tags evenly over the first period
+            .next_ms = (int64_t)i * CONFIG_HRTLS_SIM_PERIOD_MS / ARRAY_SIZE(tags)
+        };
+        tag->last_pos = world_pos_to_mm(&tag->pos);
+    }
+}
+
+int64_t tags_next_ms(void) {
+    int64_t next_ms = INT64_MAX;
+    for (size_t i = 0; i < ARRAY_SIZE(tags); i++) {
+        next_ms = MIN(next_ms, tags[i].next_ms);
+    }
+    return next_ms;
+}
+
+void tags_run_due(int64_t now_ms) {
+    for (size_t i = 0; i < ARRAY_SIZE(tags); i++) {
+        if (tags[i].next_ms <= now_ms) {
+            run(&tags[i], now_ms);
+        }
+    }
+}
+
+bool tags_true_position(uint16_t addr, struct world_pos *out_pos) {
+    if (addr < SIM_TAG_ADDR_BASE || addr - SIM_TAG_ADDR_BASE >= ARRAY_SIZE(tags)) {
+        return false;
+    }
+    *out_pos = tags[addr - SIM_TAG_ADDR_BASE].pos;
+    return true;
+}
+
+// simulated mesh downlink, commands reach their tags right away
+int mesh_send_tag_cmd(uint16_t addr, const struct hrtls_model_tag_cmd *cmd) {
+    for (size_t i = 0; i < ARRAY_SIZE(tags); i++) {
+        struct sim_tag *tag = &tags[i];
+        if (addr != tag->addr && addr != HRTLS_TAG_GROUP_ADDR && addr != tag->group_addr) {
+            continue;
+        }
+
+        commands++;
+        if (cmd->group_addr) {
+            tag->group_addr = cmd->group_addr;
+        }
+        if (cmd->period_ms) {
+            tag->period_ms = cmd->period_ms;
+        }
+        if (cmd->uplink != HRTLS_MODEL_TAG_UPLINK_KEEP) {
+            tag->raw_ranges = cmd->uplink == HRTLS_MODEL_TAG_UPLINK_RANGES;
+        }
+    }
+    return 0;
+}
+
+void tags_print_report(void) {
+    LOG_INF("tags: %zu, fixes sent: %" PRIu32 ", ranges sent: %" PRIu32 ", solver failures: %" PRIu32
+            ", commands: %" PRIu32,
+            ARRAY_SIZE(tags), fixes_sent, ranges_sent, solver_failures, commands);
+    LOG_INF("tag error mm p50: %" PRIu32 ", p99: %" PRIu32 ", solve ns p50: %" PRIu32 ", p99: %" PRIu32,
+            hrtls_histogram_percentile(&error_mm, 50), hrtls_histogram_percentile(&error_mm, 99),
+            hrtls_histogram_percentile(&solve_ns, 50), hrtls_histogram_percentile(&solve_ns, 99));
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tag/rtls/rtls.h"
+#include "world.h"
+
+#define SIM_GW_ADDR 0x0001
+#define SIM_TAG_ADDR_BASE 0x2000
+// keeps blocked anchors from zeroing out the normal equations, as on the tag
+#define SIM_MIN_MEASUREMENT_WEIGHT (UINT8_MAX / 20)
+
+// Simulated tags, each one moves around the area, ranges with nearby anchors
+// and sends either a solved fix or raw ranges to the gateway pipeline,
+// just like the tag firmware does over mesh.
+void tags_initialize(void);
+// uptime of the next positioning of any tag
+int64_t tags_next_ms(void);
+// runs positioning of every tag due at given uptime
+void tags_run_due(int64_t now_ms);
+// true position of given tag, false if there's no such tag
+bool tags_true_position(uint16_t addr, struct world_pos *out_pos);
+void tags_print_report(void);
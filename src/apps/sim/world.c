@@ -0,0 +1,120 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "gw/anchor_map.h"
+#include "world.h"
+
+LOG_MODULE_REGISTER(world);
+
+#define ANCHOR_ADDR_BASE 0x0100
+// anchors alternate between two heights, with all of them in one plane z would be ambiguous
+#define ANCHOR_LOW_Z_M 0.5f
+#define ANCHOR_HIGH_Z_M 2.5f
+// positive bias added to ranges through obstacles, drawn uniformly
+#define NLOS_BIAS_MIN_M 0.2f
+#define NLOS_BIAS_MAX_M 1.5f
+
+static struct rtls_anchor anchors[CONFIG_HRTLS_SIM_ANCHORS];
+static uint32_t rand_state;
+
+uint32_t world_rand(void) {
+    // xorshift32
+    uint32_t x = rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rand_state = x;
+    return x;
+}
+
+float world_uniform(void) {
+    return (world_rand() >> 8) / (float)(1 << 24);
+}
+
+float world_gaussian(void) {
+    // Box-Muller, the second value is thrown away to keep the state simple
+    const float u = 1.0f - world_uniform();
+    const float v = world_uniform();
+    return sqrtf(-2.0f * logf(u)) * cosf(2.0f * (float)M_PI * v);
+}
+
+float world_distance(const struct world_pos *a, const struct world_pos *b) {
+    const float dx = a->x - b->x;
+    const float dy = a->y - b->y;
+    const float dz = a->z - b->z;
+    return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+float world_twr_over(const struct world_channel *channel,
+                     const struct world_pos *tag_pos,
+                     const struct rtls_anchor *anchor,
+                     float *out_nlos_likelihood) {
+    const struct world_pos anchor_pos = world_pos_from_mm(&anchor->pos);
+    float distance = world_distance(tag_pos, &anchor_pos);
+    distance += world_gaussian() * channel->noise_mm / 1000.0f;
+
+    // the tag's estimate is right most of the time, but not always
+    const bool nlos = world_rand() % 100 < channel->nlos_percent;
+    if (nlos) {
+        distance += NLOS_BIAS_MIN_M + world_uniform() * (NLOS_BIAS_MAX_M - NLOS_BIAS_MIN_M);
+    }
+    const float likelihood = (nlos ? 0.7f : 0.1f) + 0.2f * (world_uniform() - 0.5f);
+    *out_nlos_likelihood = CLAMP(likelihood, 0.0f, 1.0f);
+
+    return MAX(distance, 0.0f);
+}
+
+float world_twr(const struct world_pos *tag_pos, const struct rtls_anchor *anchor, float *out_nlos_likelihood) {
+    static const struct world_channel channel = {
+        .noise_mm = CONFIG_HRTLS_SIM_RANGE_NOISE_MM,
+        .nlos_percent = CONFIG_HRTLS_SIM_NLOS_PERCENT
+    };
+    return world_twr_over(&channel, tag_pos, anchor, out_nlos_likelihood);
+}
+
+size_t world_anchors(const struct rtls_anchor **out_anchors) {
+    *out_anchors = anchors;
+    return ARRAY_SIZE(anchors);
+}
+
+void world_initialize(void) {
+    // 0 is a fixed point of xorshift
+    rand_state = CONFIG_HRTLS_SIM_SEED ? CONFIG_HRTLS_SIM_SEED : 1;
+
+    size_t side = 1;
+    while (side * side < ARRAY_SIZE(anchors)) {
+        side++;
+    }
+    const float spacing = CONFIG_HRTLS_SIM_AREA_MM / 1000.0f / side;
+
+    for (size_t i = 0; i < ARRAY_SIZE(anchors); i++) {
+        const size_t row = i / side;
+        const size_t col = i % side;
+        const struct world_pos pos = {
+            .x = (col + 0.5f) * spacing,
+            .y = (row + 0.5f) * spacing,
+            .z = (row + col) % 2 ? ANCHOR_HIGH_Z_M : ANCHOR_LOW_Z_M
+        };
+        anchors[i] = (struct rtls_anchor) {
+            .addr = ANCHOR_ADDR_BASE + i,
+            .pos = world_pos_to_mm(&pos)
+        };
+
+        const struct hrtls_map_anchor map_anchor = {
+            .addr = anchors[i].addr,
+            .x = anchors[i].pos.x,
+            .y = anchors[i].pos.y,
+            .z = anchors[i].pos.z
+        };
+        int err = anchor_map_set(&map_anchor);
+        if (err) {
+            LOG_ERR("Couldn't add anchor %" PRIu16 " to the map, %d", anchors[i].addr, err);
+        }
+    }
+    LOG_INF("%zu anchors placed every %.1f m", ARRAY_SIZE(anchors), (double)spacing);
+}
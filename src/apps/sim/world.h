@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tag/rtls/rtls.h"
+
+// Simulated physical world: anchors placed on a grid covering the area,
+// and UWB ranging between them and tags. All randomness comes from a single
+// PRNG seeded with CONFIG_HRTLS_SIM_SEED, so runs are reproducible.
+
+// true position of a simulated object, in m
+struct world_pos {
+    float x;
+    float y;
+    float z;
+};
+
+static inline struct world_pos world_pos_from_mm(const struct rtls_pos *pos) {
+    return (struct world_pos) { pos->x / 1000.0f, pos->y / 1000.0f, pos->z / 1000.0f };
+}
+
+static inline struct rtls_pos world_pos_to_mm(const struct world_pos *pos) {
+    return (struct rtls_pos) { pos->x * 1000, pos->y * 1000, pos->z * 1000 };
+}
+
+// places anchors and registers them in the gateway's anchor map
+void world_initialize(void);
+size_t world_anchors(const struct rtls_anchor **out_anchors);
+
+uint32_t world_rand(void);
+// uniform in [0, 1)
+float world_uniform(void);
+// standard normal
+float world_gaussian(void);
+
+// ranging conditions between tags and anchors
+struct world_channel {
+    // standard deviation of ranging noise
+    uint32_t noise_mm;
+    // share of ranges with a positive NLOS bias
+    uint32_t nlos_percent;
+};
+
+// single TWR exchange between a tag at given position and an anchor, returns measured
+// distance in m, NLOS likelihood as estimated by the tag from signal quality is set
+// in *out_nlos_likelihood
+float world_twr_over(const struct world_channel *channel,
+                     const struct world_pos *tag_pos,
+                     const struct rtls_anchor *anchor,
+                     float *out_nlos_likelihood);
+// world_twr_over() with conditions set by CONFIG_HRTLS_SIM_RANGE_NOISE_MM and CONFIG_HRTLS_SIM_NLOS_PERCENT
+float world_twr(const struct world_pos *tag_pos, const struct rtls_anchor *anchor, float *out_nlos_likelihood);
+float world_distance(const struct world_pos *a, const struct world_pos *b);
@@ -0,0 +1,170 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <models/tag.h>
+
+#include "anchor_map.h"
+
+LOG_MODULE_REGISTER(anchor_map);
+
+// neighbourhood is a 3x3 grid of regions centered at the one the tag is in
+#define NEIGHBOURHOOD_SIDE 3
+// gateway might have missed the request or its response might have got lost
+#define SYNC_RETRY_MS 1000
+
+BUILD_ASSERT(NEIGHBOURHOOD_SIDE * NEIGHBOURHOOD_SIDE == HRTLS_MAP_NEIGHBOURHOOD_REGIONS);
+
+struct region {
+    struct hrtls_map_region_ref ref;
+    size_t count;
+    struct hrtls_map_anchor anchors[HRTLS_MAP_REGION_ANCHORS_MAX];
+};
+
+// indexed by position relative to the center, version 0 marks regions not fetched yet
+static struct region regions[HRTLS_MAP_NEIGHBOURHOOD_REGIONS];
+static struct hrtls_map_region_id center;
+static bool centered;
+// 0 until known
+static uint16_t announced_version;
+static uint16_t synced_version;
+static int64_t last_request_at = -SYNC_RETRY_MS;
+// parts of the response to the last request received so far, the map is synced once all of them are
+static uint8_t response_parts;
+static uint16_t response_received;
+static K_MUTEX_DEFINE(lock);
+
+static struct hrtls_map_region_id neighbour_id(struct hrtls_map_region_id center, size_t index) {
+    return (struct hrtls_map_region_id) {
+        .x = CLAMP(center.x + (int)(index % NEIGHBOURHOOD_SIDE) - 1, INT8_MIN, INT8_MAX),
+        .y = CLAMP(center.y + (int)(index / NEIGHBOURHOOD_SIDE) - 1, INT8_MIN, INT8_MAX)
+    };
+}
+
+static struct region *find_region(struct hrtls_map_region_id id) {
+    for (size_t i = 0; i < ARRAY_SIZE(regions); i++) {
+        if (hrtls_map_region_eq(neighbour_id(center, i), id)) {
+            return &regions[i];
+        }
+    }
+    return NULL;
+}
+
+// keeps regions shared by both neighbourhoods, the rest has to be fetched
+static void recenter(struct hrtls_map_region_id new_center) {
+    static struct region new_regions[HRTLS_MAP_NEIGHBOURHOOD_REGIONS];
+    for (size_t i = 0; i < ARRAY_SIZE(new_regions); i++) {
+        const struct hrtls_map_region_id id = neighbour_id(new_center, i);
+        const struct region *region = centered ? find_region(id) : NULL;
+        if (region) {
+            new_regions[i] = *region;
+        }
+        else {
+            new_regions[i] = (struct region) {
+                .ref.id = id
+            };
+        }
+    }
+
+    LOG_INF("Moving to region %" PRId8 "/%" PRId8, new_center.x, new_center.y);
+    memcpy(regions, new_regions, sizeof(regions));
+    center = new_center;
+    centered = true;
+    synced_version = 0;
+}
+
+void anchor_map_announced(uint16_t map_version) {
+    k_mutex_lock(&lock, K_FOREVER);
+    announced_version = map_version;
+    k_mutex_unlock(&lock);
+}
+
+void anchor_map_update(uint16_t gw_addr,
+                       uint16_t map_version,
+                       uint8_t part,
+                       uint8_t parts,
+                       const struct hrtls_map_region_ref *region,
+                       const struct hrtls_map_anchor anchors[],
+                       size_t count) {
+    k_mutex_lock(&lock, K_FOREVER);
+
+    // response to a request sent before moving to another region
+    struct region *slot = find_region(region->id);
+    if (slot) {
+        if (slot->ref.version != region->version) {
+            LOG_INF("Region %" PRId8 "/%" PRId8 " updated to version %" PRIu16 " with %zu anchors",
+                    region->id.x, region->id.y, region->version, count);
+        }
+        slot->ref = *region;
+        slot->count = MIN(count, ARRAY_SIZE(slot->anchors));
+        memcpy(slot->anchors, anchors, slot->count * sizeof(*anchors));
+
+        if (parts != response_parts) {
+            response_parts = parts;
+            response_received = 0;
+        }
+        response_received |= BIT(part);
+        // missing regions keep the map stale, so they're requested again, received ones are up to date by then
+        if (response_received == BIT_MASK(parts)) {
+            synced_version = map_version;
+        }
+    }
+
+    k_mutex_unlock(&lock);
+}
+
+int anchor_map_sync(struct bt_mesh_model *tag_model, uint16_t gw_addr, const struct rtls_pos *pos) {
+    const struct hrtls_map_region_id pos_region = hrtls_map_region_of(pos->x, pos->y);
+    const int64_t now = k_uptime_get();
+
+    k_mutex_lock(&lock, K_FOREVER);
+
+    if (!centered || !hrtls_map_region_eq(pos_region, center)) {
+        recenter(pos_region);
+    }
+
+    bool stale = !synced_version || (announced_version && announced_version != synced_version);
+    if (!stale || now - last_request_at < SYNC_RETRY_MS) {
+        k_mutex_unlock(&lock);
+        return 0;
+    }
+    last_request_at = now;
+    response_parts = 0;
+    response_received = 0;
+
+    struct hrtls_map_region_ref refs[HRTLS_MAP_NEIGHBOURHOOD_REGIONS];
+    for (size_t i = 0; i < ARRAY_SIZE(refs); i++) {
+        refs[i] = regions[i].ref;
+    }
+
+    k_mutex_unlock(&lock);
+
+    LOG_INF("Requesting anchor map from addr 0x%04" PRIx16, gw_addr);
+    return hrtls_model_tag_map_get(tag_model, gw_addr, refs, ARRAY_SIZE(refs));
+}
+
+size_t anchor_map_anchors(struct rtls_anchor out_anchors[ANCHOR_MAP_ANCHORS_MAX]) {
+    k_mutex_lock(&lock, K_FOREVER);
+
+    size_t count = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(regions); i++) {
+        for (size_t j = 0; j < regions[i].count; j++) {
+            const struct hrtls_map_anchor *anchor = &regions[i].anchors[j];
+            out_anchors[count++] = (struct rtls_anchor) {
+                .addr = anchor->addr,
+                .pos = {
+                    .x = anchor->x,
+                    .y = anchor->y,
+                    .z = anchor->z
+                }
+            };
+        }
+    }
+
+    k_mutex_unlock(&lock);
+    return count;
+}
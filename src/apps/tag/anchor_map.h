@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/bluetooth/mesh.h>
+
+#include <models/anchor_map.h>
+
+#include "rtls/rtls.h"
+
+#define ANCHOR_MAP_ANCHORS_MAX (HRTLS_MAP_NEIGHBOURHOOD_REGIONS * HRTLS_MAP_REGION_ANCHORS_MAX)
+
+void anchor_map_announced(uint16_t map_version);
+// part-th of parts regions the gateway responded with to the last request
+void anchor_map_update(uint16_t gw_addr,
+                       uint16_t map_version,
+                       uint8_t part,
+                       uint8_t parts,
+                       const struct hrtls_map_region_ref *region,
+                       const struct hrtls_map_anchor anchors[],
+                       size_t count);
+// requests regions around pos from the gateway, unless they're known to be up to date
+int anchor_map_sync(struct bt_mesh_model *tag_model, uint16_t gw_addr, const struct rtls_pos *pos);
+// copies anchors of the neighbourhood, returns their count
+size_t anchor_map_anchors(struct rtls_anchor out_anchors[ANCHOR_MAP_ANCHORS_MAX]);
@@ -0,0 +1,116 @@
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <models/common.h>
+
+#include "gateways.h"
+
+LOG_MODULE_REGISTER(gateways);
+
+// a gateway is considered gone after that many missed announcements
+#define MISSED_ANNOUNCEMENTS_MAX 3
+// RSSI advantage needed to switch between gateways at the same distance
+#define RSSI_HYSTERESIS_DB 6
+
+struct gateway {
+    uint16_t addr;
+    uint8_t hops;
+    int8_t rssi;
+    int64_t expires_at;
+};
+
+static struct gateway gateways[CONFIG_HRTLS_TAG_GW_TABLE_SIZE];
+static uint16_t current_addr = HRTLS_GW_GROUP_ADDR;
+static struct k_spinlock lock;
+
+static bool is_live(const struct gateway *gw, int64_t now) {
+    return gw->addr && gw->expires_at > now;
+}
+
+// fewer hops first, stronger signal breaks ties
+static bool is_closer(const struct gateway *a, const struct gateway *b, int rssi_margin) {
+    if (a->hops != b->hops) {
+        return a->hops < b->hops;
+    }
+    return a->rssi > b->rssi + rssi_margin;
+}
+
+void gateways_update(uint16_t gw_addr, uint8_t hops, int8_t rssi, uint16_t period_ms) {
+    int64_t now = k_uptime_get();
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    struct gateway *slot = NULL;
+    for (size_t i = 0; i < ARRAY_SIZE(gateways); i++) {
+        if (gateways[i].addr == gw_addr) {
+            slot = &gateways[i];
+            break;
+        }
+        if (!is_live(&gateways[i], now) && !slot) {
+            slot = &gateways[i];
+        }
+    }
+
+    const struct gateway gw = {
+        .addr = gw_addr,
+        .hops = hops,
+        .rssi = rssi,
+        .expires_at = now + MISSED_ANNOUNCEMENTS_MAX * period_ms
+    };
+
+    if (!slot) {
+        // table full, replace the farthest gateway if this one is closer
+        slot = &gateways[0];
+        for (size_t i = 1; i < ARRAY_SIZE(gateways); i++) {
+            if (is_closer(slot, &gateways[i], 0)) {
+                slot = &gateways[i];
+            }
+        }
+        if (!is_closer(&gw, slot, 0)) {
+            slot = NULL;
+        }
+    }
+
+    if (slot) {
+        *slot = gw;
+    }
+
+    k_spin_unlock(&lock, key);
+}
+
+uint16_t gateways_best(void) {
+    int64_t now = k_uptime_get();
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    const struct gateway *current = NULL;
+    const struct gateway *best = NULL;
+    for (size_t i = 0; i < ARRAY_SIZE(gateways); i++) {
+        if (!is_live(&gateways[i], now)) {
+            continue;
+        }
+        if (gateways[i].addr == current_addr) {
+            current = &gateways[i];
+        }
+        if (!best || is_closer(&gateways[i], best, 0)) {
+            best = &gateways[i];
+        }
+    }
+
+    uint16_t prev_addr = current_addr;
+    if (!best) {
+        current_addr = HRTLS_GW_GROUP_ADDR;
+    }
+    else if (!current || is_closer(best, current, RSSI_HYSTERESIS_DB)) {
+        current_addr = best->addr;
+    }
+    uint16_t res = current_addr;
+
+    k_spin_unlock(&lock, key);
+
+    if (res != prev_addr) {
+        LOG_INF("Switching gateway 0x%04" PRIx16 " -> 0x%04" PRIx16, prev_addr, res);
+    }
+    return res;
+}
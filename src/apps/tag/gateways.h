@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
+void gateways_update(uint16_t gw_addr, uint8_t hops, int8_t rssi, uint16_t period_ms);
+// closest live gateway, HRTLS_GW_GROUP_ADDR if none is known
+uint16_t gateways_best(void);
@@ -0,0 +1,13 @@
+#include <zephyr/kernel.h>
+
+#include <stats/latency.h>
+
+#include "latency.h"
+
+HRTLS_LATENCY_DEFINE(latency,
+    [LATENCY_POSITIONING] = "positioning",
+    [LATENCY_QUEUE] = "queue",
+    [LATENCY_MESH_TX] = "mesh_tx"
+);
+
+BUILD_ASSERT(ARRAY_SIZE(latency_stage_names) == LATENCY_STAGES_COUNT);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stats/latency.h>
+
+enum latency_stage {
+    // single positioning or ranging cycle
+    LATENCY_POSITIONING,
+    // fix computed until handed over to mesh
+    LATENCY_QUEUE,
+    // mesh message handed over until fully transmitted
+    LATENCY_MESH_TX,
+    LATENCY_STAGES_COUNT
+};
+
+extern const struct hrtls_latency latency;
@@ -1,4 +1,6 @@
+#include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 #include <inttypes.h>
 
 #include <zephyr/bluetooth/bluetooth.h>
@@ -6,11 +8,17 @@
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/logging/log_ctrl.h>
+#include <zephyr/sys/atomic.h>
 
+#include <metrics/metrics.h>
 #include <models/tag.h>
+#include <trace/trace.h>
 #include <uwb/uwb.h>
 
 #include "mesh/mesh.h"
+#include "anchor_map.h"
+#include "gateways.h"
+#include "latency.h"
 #include "rtls/rtls.h"
 #include "main.h"
 #include "positioning.h"
@@ -24,34 +32,316 @@ static struct bt_mesh_model *tag_model;
 static void mesh_loc_push_work_handler(struct k_work *work);
 
 static K_WORK_DEFINE(mesh_loc_push_work, mesh_loc_push_work_handler);
-K_MSGQ_DEFINE(rtls_result_queue, sizeof(struct rtls_result), 3, 1);
+K_MSGQ_DEFINE(loc_queue, sizeof(struct hrtls_model_gw_fix), 3, 4);
+K_MSGQ_DEFINE(calibration_queue, sizeof(struct rtls_pos), 1, 4);
 
-static void mesh_loc_push_work_handler(struct k_work *work) {
-    // TODO: temporarily hardcoded
-    static const uint16_t gw_addr = 0x0100;
+struct tag_ranges {
+    uint8_t seq;
+    size_t count;
+    struct hrtls_model_gw_range ranges[RTLS_MAX_MEASUREMENTS];
+};
 
-    struct rtls_result rtls_result;
-    while (!k_msgq_get(&rtls_result_queue, &rtls_result, K_NO_WAIT)) {
-        struct hrtls_model_gw_location loc = {
-            .x = rtls_result.pos.x * 1000,
-            .y = rtls_result.pos.y * 1000,
-            .z = rtls_result.pos.z * 1000,
-            .err = rtls_result.error * 1000
+// only the newest ranges are worth sending
+K_MSGQ_DEFINE(ranges_queue, sizeof(struct tag_ranges), 1, 4);
+
+#define CALIBRATION_REPETITIONS 50
+#define DEFAULT_PERIOD_MS 200
+
+// both can be changed at runtime by gateway commands
+static atomic_t period_ms = ATOMIC_INIT(DEFAULT_PERIOD_MS);
+static atomic_t raw_range_uplink = ATOMIC_INIT(IS_ENABLED(CONFIG_HRTLS_RAW_RANGE_UPLINK));
+
+// messages handed over to the mesh stack, but not yet fully transmitted
+static atomic_t in_flight;
+
+static void loc_send_start(uint16_t duration, int err, void *cb_data) {
+    if (err) {
+        // end callback won't be called
+        LOG_WRN("Location send failed to start, %d", err);
+        hrtls_metric_inc(HRTLS_METRIC_MESH_TX_FAIL);
+        hrtls_metric_set(HRTLS_METRIC_MESH_TX_IN_FLIGHT, atomic_dec(&in_flight) - 1);
+        k_work_submit(&mesh_loc_push_work);
+    }
+}
+
+static void loc_send_end(int err, void *cb_data) {
+    hrtls_latency_record_since(&latency, LATENCY_MESH_TX, (uint32_t)(uintptr_t)cb_data);
+    hrtls_metric_set(HRTLS_METRIC_MESH_TX_IN_FLIGHT, atomic_dec(&in_flight) - 1);
+    k_work_submit(&mesh_loc_push_work);
+}
+
+static const struct bt_mesh_send_cb loc_send_cb = {
+    .start = loc_send_start,
+    .end = loc_send_end
+};
+
+// passed as send callback data, so that transmission time can be traced
+static void *send_timestamp(void) {
+    return (void *)(uintptr_t)k_uptime_get_32();
+}
+
+static int track_send(int res) {
+    if (!res) {
+        hrtls_metric_set(HRTLS_METRIC_MESH_TX_IN_FLIGHT, atomic_inc(&in_flight) + 1);
+    }
+    else {
+        hrtls_metric_inc(HRTLS_METRIC_MESH_TX_FAIL);
+    }
+    return res;
+}
+
+static bool tx_window_full(void) {
+    return atomic_get(&in_flight) >= CONFIG_HRTLS_LOC_TX_WINDOW;
+}
+
+static int push_fix(uint16_t gw_addr, const struct hrtls_model_gw_fix *fix) {
+    const uint32_t age_ms = k_uptime_get_32() - fix->timestamp_ms;
+    // v2 age saturates, a batch of one keeps the exact age of fixes held up for longer
+    int res = track_send(age_ms > HRTLS_LOC_V2_AGE_MAX_MS
+        ? hrtls_model_tag_loc_batch_push(tag_model, gw_addr, fix, 1, age_ms, &loc_send_cb, send_timestamp())
+        : hrtls_model_tag_loc_push(tag_model, gw_addr, fix, age_ms, &loc_send_cb, send_timestamp()));
+    HRTLS_TRACE(HRTLS_TRACE_TAG_FIX_TX, gw_addr, 1, res);
+    return res;
+}
+
+static struct hrtls_model_gw_fix batch[CONFIG_HRTLS_LOC_BATCH_SIZE];
+static size_t batch_len;
+static size_t batch_pdu_len = HRTLS_MODEL_GW_LOC_BATCH_HDR_LEN;
+
+BUILD_ASSERT(CONFIG_HRTLS_LOC_BATCH_SIZE <= HRTLS_MODEL_GW_LOC_BATCH_MAX);
+
+static void batch_flush_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(batch_flush_work, batch_flush_work_handler);
+
+static int flush_batch(uint16_t gw_addr) {
+    k_work_cancel_delayable(&batch_flush_work);
+    int res = track_send(hrtls_model_tag_loc_batch_push(tag_model,
+                                                        gw_addr,
+                                                        batch,
+                                                        batch_len,
+                                                        k_uptime_get_32() - batch[0].timestamp_ms,
+                                                        &loc_send_cb,
+                                                        send_timestamp()));
+    HRTLS_TRACE(HRTLS_TRACE_TAG_FIX_TX, gw_addr, batch_len, res);
+    batch_len = 0;
+    batch_pdu_len = HRTLS_MODEL_GW_LOC_BATCH_HDR_LEN;
+    return res;
+}
+
+// fixes stop arriving when positioning fails, the last ones shouldn't wait for it indefinitely
+static void batch_flush_work_handler(struct k_work *work) {
+    if (batch_len) {
+        flush_batch(gateways_best());
+    }
+}
+
+static int push_batched_fix(uint16_t gw_addr, const struct hrtls_model_gw_fix *fix) {
+    int res = 0;
+    // sequence numbers within a batch are implied, so a gap flushes it early, as does a fix which wouldn't fit
+    if (batch_len && ((uint8_t)(batch[batch_len - 1].seq + 1) != fix->seq
+                      || batch_pdu_len + hrtls_model_gw_loc_batch_fix_len(fix, &batch[batch_len - 1])
+                         > HRTLS_MODEL_GW_LOC_BATCH_PUSH_MAX_LEN)) {
+        res = flush_batch(gw_addr);
+    }
+
+    if (batch_len) {
+        batch_pdu_len += hrtls_model_gw_loc_batch_fix_len(fix, &batch[batch_len - 1]);
+    }
+    else {
+        const struct hrtls_model_gw_fix base = {
+            .timestamp_ms = fix->timestamp_ms
         };
+        batch_pdu_len += hrtls_model_gw_loc_batch_fix_len(fix, &base);
+        k_work_schedule(&batch_flush_work, K_MSEC(CONFIG_HRTLS_LOC_BATCH_HOLD_MS));
+    }
+    batch[batch_len++] = *fix;
+
+    if (batch_len < ARRAY_SIZE(batch)) {
+        return res;
+    }
+    return flush_batch(gw_addr);
+}
+
+static void mesh_loc_push_work_handler(struct k_work *work) {
+    const uint16_t gw_addr = gateways_best();
 
-        LOG_INF("Sending location to addr 0x%04" PRIx16, gw_addr);
-        int res = hrtls_model_tag_loc_push(tag_model, gw_addr, &loc);
-        LOG_INF("Send res: %d", res);
+    struct tag_ranges ranges;
+    if (!tx_window_full() && !k_msgq_get(&ranges_queue, &ranges, K_NO_WAIT)) {
+        int res = track_send(hrtls_model_tag_ranges_push(tag_model,
+                                                         gw_addr,
+                                                         ranges.seq,
+                                                         ranges.ranges,
+                                                         ranges.count,
+                                                         &loc_send_cb,
+                                                         send_timestamp()));
+        HRTLS_TRACE(HRTLS_TRACE_TAG_RANGES_TX, gw_addr, ranges.count, res);
+    }
+
+    struct hrtls_model_gw_fix fix;
+    while (!tx_window_full() && !k_msgq_get(&loc_queue, &fix, K_NO_WAIT)) {
+        hrtls_latency_record_since(&latency, LATENCY_QUEUE, fix.timestamp_ms);
+        if (CONFIG_HRTLS_LOC_BATCH_SIZE > 1) {
+            push_batched_fix(gw_addr, &fix);
+        }
+        else {
+            push_fix(gw_addr, &fix);
+        }
+    }
+
+    // bearer can't keep up, only the newest fix is worth sending once it frees up,
+    // the work gets resubmitted by send end callback
+    while (k_msgq_num_used_get(&loc_queue) > 1) {
+        k_msgq_get(&loc_queue, &fix, K_NO_WAIT);
+        LOG_DBG("Coalescing location %" PRIu8, fix.seq);
+        hrtls_metric_inc(HRTLS_METRIC_LOC_COALESCED);
     }
 }
 
+// shared by fixes and raw ranges, gateway deduplicates both the same way
+static uint8_t next_seq;
+
 static void send_location(const struct rtls_result *rtls_result) {
-    if (k_msgq_put(&rtls_result_queue, rtls_result, K_NO_WAIT)) {
-        LOG_WRN("Couldn't fit location into queue");
+    const struct hrtls_model_gw_fix fix = {
+        .seq = next_seq++,
+        .timestamp_ms = k_uptime_get_32(),
+        .x = rtls_result->pos.x,
+        .y = rtls_result->pos.y,
+        .z = rtls_result->pos.z,
+        .err = rtls_result->error
+    };
+
+    while (k_msgq_put(&loc_queue, &fix, K_NO_WAIT)) {
+        struct hrtls_model_gw_fix oldest;
+        LOG_WRN("Couldn't fit location into queue, dropping the oldest one");
+        hrtls_metric_inc(HRTLS_METRIC_LOC_QUEUE_DROPS);
+        k_msgq_get(&loc_queue, &oldest, K_NO_WAIT);
+    }
+    k_work_submit(&mesh_loc_push_work);
+}
+
+static void send_ranges(const struct hrtls_model_gw_range ranges[], size_t count) {
+    struct tag_ranges tag_ranges = {
+        .seq = next_seq++,
+        .count = count
+    };
+    memcpy(tag_ranges.ranges, ranges, count * sizeof(*ranges));
+
+    if (k_msgq_num_used_get(&ranges_queue)) {
+        hrtls_metric_inc(HRTLS_METRIC_RANGES_QUEUE_DROPS);
     }
+    k_msgq_purge(&ranges_queue);
+    k_msgq_put(&ranges_queue, &tag_ranges, K_NO_WAIT);
     k_work_submit(&mesh_loc_push_work);
 }
 
+// updates last_pos on success
+static int position_and_send(struct rtls_pos *last_pos) {
+    static const size_t repetitions = 5;
+    const uint32_t start_ms = k_uptime_get_32();
+
+    if (atomic_get(&raw_range_uplink)) {
+        struct hrtls_model_gw_range ranges[RTLS_MAX_MEASUREMENTS];
+        size_t count;
+        int err = perform_ranging(ranges, &count, last_pos, repetitions);
+        if (!err) {
+            hrtls_latency_record_since(&latency, LATENCY_POSITIONING, start_ms);
+            send_ranges(ranges, count);
+        }
+        return err;
+    }
+
+    struct rtls_result rtls_result;
+    int err = perform_positioning(&rtls_result, repetitions);
+    if (!err) {
+        hrtls_latency_record_since(&latency, LATENCY_POSITIONING, start_ms);
+        *last_pos = rtls_result.pos;
+        send_location(&rtls_result);
+    }
+    return err;
+}
+
+void cmd_handler(uint16_t gw_addr, const struct hrtls_model_tag_cmd *cmd) {
+    LOG_INF("Command from addr 0x%04" PRIx16 ", period: %" PRIu16 " ms, uplink: %" PRIu8 ", group: 0x%04" PRIx16,
+            gw_addr, cmd->period_ms, cmd->uplink, cmd->group_addr);
+
+    if (cmd->group_addr && mesh_set_user_group(cmd->group_addr)) {
+        LOG_WRN("Invalid group address: 0x%04" PRIx16, cmd->group_addr);
+    }
+
+    if (cmd->period_ms) {
+        atomic_set(&period_ms, cmd->period_ms);
+    }
+
+    switch (cmd->uplink) {
+    case HRTLS_MODEL_TAG_UPLINK_KEEP:
+        break;
+    case HRTLS_MODEL_TAG_UPLINK_FIX:
+        atomic_set(&raw_range_uplink, false);
+        break;
+    case HRTLS_MODEL_TAG_UPLINK_RANGES:
+        atomic_set(&raw_range_uplink, true);
+        break;
+    default:
+        LOG_WRN("Unknown uplink mode: %" PRIu8, cmd->uplink);
+        break;
+    }
+}
+
+int request_calibration(const struct rtls_pos *tag_pos) {
+    return k_msgq_put(&calibration_queue, tag_pos, K_NO_WAIT);
+}
+
+static void try_calibrating(void) {
+    struct rtls_pos tag_pos;
+    if (k_msgq_get(&calibration_queue, &tag_pos, K_NO_WAIT)) {
+        return;
+    }
+
+    uint16_t ant_dly;
+    int err = perform_calibration(&tag_pos, CALIBRATION_REPETITIONS, &ant_dly);
+    if (err) {
+        LOG_WRN("Calibration failed, %d", err);
+        return;
+    }
+
+    err = uwb_set_antenna_delay(ant_dly);
+    if (err) {
+        LOG_WRN("Couldn't persist antenna delay, %d", err);
+    }
+}
+
+static void uwb_wakeup_or_fail(void) {
+    int err = uwb_wakeup();
+    if (!err) {
+        return;
+    }
+
+    LOG_WRN("UWB wakeup failed, reinitializing");
+    err = uwb_module_initialize(UWB_TWR_MODE_SS);
+    if (err) {
+        LOG_ERR("UWB reinit failed, %d", err);
+        hrtls_fail();
+    }
+}
+
+static void sleep_until_next_positioning(int64_t next_timestamp, int64_t ms_to_sleep) {
+    if (!IS_ENABLED(CONFIG_HRTLS_UWB_DEEP_SLEEP) || uwb_sleep()) {
+        k_sleep(K_MSEC(ms_to_sleep));
+        return;
+    }
+
+    // wake the radio up ahead of time, so that it doesn't delay the next fix
+    int64_t wakeup_ms = DIV_ROUND_UP(uwb_last_wakeup_us(), 1000);
+    k_sleep(K_MSEC(MAX(ms_to_sleep - wakeup_ms, 0)));
+    uwb_wakeup_or_fail();
+
+    int64_t ms_left = next_timestamp - k_uptime_get();
+    if (ms_left > 0) {
+        k_sleep(K_MSEC(ms_left));
+    }
+}
+
 void hrtls_fail(void) {
     log_panic();
     k_fatal_halt(0);
@@ -80,28 +370,30 @@ void main(void) {
         hrtls_fail();
     }
 
-    static const int64_t period_ms = 200;
-
+    struct rtls_pos last_pos = { 0 };
     int64_t last_timestamp = k_uptime_get();
     while (true) {
-        struct rtls_result rtls_result;
-        err = perform_positioning(&rtls_result, 5);
-
-        if (!err) {
-            send_location(&rtls_result);
+        err = anchor_map_sync(tag_model, gateways_best(), &last_pos);
+        if (err) {
+            LOG_WRN("Anchor map sync failed, %d", err);
         }
 
-        const int64_t next_timestamp = last_timestamp + period_ms;
+        try_calibrating();
+
+        position_and_send(&last_pos);
+
+        const int64_t period = atomic_get(&period_ms);
+        const int64_t next_timestamp = last_timestamp + period;
         const int64_t now = k_uptime_get();
         if (next_timestamp > now) {
             last_timestamp = next_timestamp;
         }
         else {
             LOG_WRN("looks like the timestamp clock has slipped!");
-            last_timestamp = now + period_ms;
+            last_timestamp = now + period;
         }
         int64_t ms_to_sleep = next_timestamp - now;
-        LOG_INF("next positioning in %" PRId64 " ms", ms_to_sleep);
-        k_sleep(K_MSEC(ms_to_sleep));
+        HRTLS_TRACE(HRTLS_TRACE_TAG_SLEEP, ms_to_sleep, 0, 0);
+        sleep_until_next_positioning(next_timestamp, ms_to_sleep);
     }
 }
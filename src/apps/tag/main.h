@@ -4,3 +4,9 @@
 
 extern uint8_t dev_uuid[16];
 void hrtls_fail(void);
+
+struct hrtls_model_tag_cmd;
+void cmd_handler(uint16_t gw_addr, const struct hrtls_model_tag_cmd *cmd);
+
+struct rtls_pos;
+int request_calibration(const struct rtls_pos *tag_pos);
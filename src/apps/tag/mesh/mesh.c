@@ -1,19 +1,56 @@
+#include <errno.h>
 #include <stdint.h>
+#include <string.h>
 #include <inttypes.h>
 
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/mesh.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
 #include <zephyr/sys/byteorder.h>
 
 #include <models/tag.h>
 
+#include "../anchor_map.h"
+#include "../gateways.h"
 #include "../main.h"
 #include "mesh.h"
 
 LOG_MODULE_REGISTER(mesh_mesh);
 
+#define SETTINGS_SUBTREE "hrtls/mesh"
+#define SETTINGS_USER_GROUP_KEY "user_group"
+
+// user group the tag was last assigned to, 0 if none
+static uint16_t user_group;
+
+#if IS_ENABLED(CONFIG_BT_SETTINGS)
+static int settings_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg) {
+    if (strcmp(name, SETTINGS_USER_GROUP_KEY)) {
+        return -ENOENT;
+    }
+    if (len != sizeof(user_group)) {
+        return -EINVAL;
+    }
+
+    ssize_t res = read_cb(cb_arg, &user_group, sizeof(user_group));
+    return res < 0 ? res : 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(hrtls_mesh, SETTINGS_SUBTREE, NULL, settings_set, NULL, NULL);
+
+// flash writes are kept out of the mesh RX context delivering commands
+static void store_user_group(struct k_work *work) {
+    int err = settings_save_one(SETTINGS_SUBTREE "/" SETTINGS_USER_GROUP_KEY, &user_group, sizeof(user_group));
+    if (err) {
+        LOG_WRN("Couldn't store user group, %d", err);
+    }
+}
+
+static K_WORK_DEFINE(store_user_group_work, store_user_group);
+#endif
+
 static void attention_on(struct bt_mesh_model *mod)
 {
     LOG_INF("Attention on");
@@ -33,8 +70,19 @@ static struct bt_mesh_health_srv health_srv = {
 
 BT_MESH_HEALTH_PUB_DEFINE(health_pub, 0);
 
+static void gw_announce_handler(uint16_t gw_addr, uint8_t hops, int8_t rssi, uint16_t period_ms, uint16_t map_version) {
+    gateways_update(gw_addr, hops, rssi, period_ms);
+    anchor_map_announced(map_version);
+}
+
+static struct hrtls_model_tag_handlers tag_handlers = {
+    .gw_announce = gw_announce_handler,
+    .map_update = anchor_map_update,
+    .cmd = cmd_handler
+};
+
 static struct bt_mesh_model vnd_models[] = {
-    HRTLS_MODEL_TAG
+    HRTLS_MODEL_TAG(&tag_handlers)
 };
 
 static struct bt_mesh_model sig_models[] = {
@@ -97,8 +145,18 @@ static void self_provision(void) {
         LOG_ERR("App key add failed, %d", err);
         hrtls_fail();
     }
+}
 
+// bindings aren't made through the configuration server, so they aren't persisted,
+// the user group is restored from its own settings key
+static void configure_models(void) {
     vnd_models[0].keys[0] = 0;
+    vnd_models[0].groups[0] = HRTLS_GW_GROUP_ADDR;
+    vnd_models[0].groups[1] = HRTLS_TAG_GROUP_ADDR;
+    if (BT_MESH_ADDR_IS_GROUP(user_group)) {
+        vnd_models[0].groups[2] = user_group;
+        LOG_INF("Restored user group 0x%04" PRIx16, user_group);
+    }
 }
 
 static void bt_ready(int err) {
@@ -115,16 +173,46 @@ static void bt_ready(int err) {
         hrtls_fail();
     }
 
-    err = bt_mesh_prov_enable(BT_MESH_PROV_ADV | BT_MESH_PROV_GATT);
-    if (err) {
-        LOG_ERR("Can't enable provisioning, %d", err);
+    // restores provisioning data, IV index and sequence number stored by the mesh stack
+    if (IS_ENABLED(CONFIG_BT_SETTINGS)) {
+        err = settings_load();
+        if (err) {
+            LOG_WRN("Settings load failed, %d", err);
+        }
+    }
+
+    if (bt_mesh_is_provisioned()) {
+        LOG_INF("Restored provisioning data");
     }
+    else {
+        err = bt_mesh_prov_enable(BT_MESH_PROV_ADV | BT_MESH_PROV_GATT);
+        if (err) {
+            LOG_ERR("Can't enable provisioning, %d", err);
+        }
 
-    self_provision();
+        self_provision();
+    }
+    configure_models();
 
     LOG_INF("Mesh initialized");
 }
 
+int mesh_set_user_group(uint16_t group_addr) {
+    if (!BT_MESH_ADDR_IS_GROUP(group_addr)) {
+        return -EINVAL;
+    }
+    vnd_models[0].groups[2] = group_addr;
+
+#if IS_ENABLED(CONFIG_BT_SETTINGS)
+    // repeated commands mustn't wear out the flash
+    if (group_addr != user_group) {
+        user_group = group_addr;
+        k_work_submit(&store_user_group_work);
+    }
+#endif
+    return 0;
+}
+
 int mesh_initialize(struct bt_mesh_model **out_tag_model) {
     int res = bt_enable(bt_ready);
     if (res) {
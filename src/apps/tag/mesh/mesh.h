@@ -7,3 +7,5 @@
 #include <models/tag.h>
 
 int mesh_initialize(struct bt_mesh_model **out_tag_model);
+// subscribes to a user group, replacing the previous one; persisted across reboots
+int mesh_set_user_group(uint16_t group_addr);
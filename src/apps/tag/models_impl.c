@@ -1,17 +1,106 @@
+#include <errno.h>
 #include <string.h>
 
 #include <zephyr/bluetooth/mesh.h>
 #include <zephyr/logging/log.h>
 
+#include <metrics/metrics.h>
 #include <models/tag.h>
 
 LOG_MODULE_REGISTER(tag_impl);
 
+static int handle_message_gw_announce(struct bt_mesh_model *model,
+                                      struct bt_mesh_msg_ctx *ctx,
+                                      struct net_buf_simple *buf) {
+    struct hrtls_model_tag_handlers *handlers = model->user_data;
+    hrtls_metric_inc(HRTLS_METRIC_MESH_RX);
+
+    uint8_t initial_ttl = net_buf_simple_pull_u8(buf);
+    uint16_t period_ms = net_buf_simple_pull_le16(buf);
+    uint16_t map_version = net_buf_simple_pull_le16(buf);
+    if (ctx->recv_ttl > initial_ttl) {
+        LOG_ERR("Gateway announcement has inconsistent TTL: %" PRIu8 "/%" PRIu8, ctx->recv_ttl, initial_ttl);
+        return -1;
+    }
+
+    if (handlers->gw_announce) {
+        handlers->gw_announce(ctx->addr, initial_ttl - ctx->recv_ttl, ctx->recv_rssi, period_ms, map_version);
+    }
+
+    return 0;
+}
+
+static int handle_message_conf_update(struct bt_mesh_model *model,
+                                      struct bt_mesh_msg_ctx *ctx,
+                                      struct net_buf_simple *buf) {
+    struct hrtls_model_tag_handlers *handlers = model->user_data;
+    hrtls_metric_inc(HRTLS_METRIC_MESH_RX);
+
+    uint16_t map_version = net_buf_simple_pull_le16(buf);
+    uint8_t part = net_buf_simple_pull_u8(buf);
+    uint8_t parts = net_buf_simple_pull_u8(buf);
+    if (part >= parts || parts > HRTLS_MAP_NEIGHBOURHOOD_REGIONS) {
+        LOG_ERR("Conf update has invalid part: %" PRIu8 " of %" PRIu8, part, parts);
+        return -1;
+    }
+
+    struct hrtls_map_region_ref region;
+    region.id.x = net_buf_simple_pull_u8(buf);
+    region.id.y = net_buf_simple_pull_u8(buf);
+    region.version = net_buf_simple_pull_le16(buf);
+    uint8_t count = net_buf_simple_pull_u8(buf);
+    if (count > HRTLS_MAP_REGION_ANCHORS_MAX || buf->len != count * HRTLS_MAP_ANCHOR_LEN) {
+        LOG_ERR("Conf update has unexpected length: %" PRIu16 " for %" PRIu8 " anchors", buf->len, count);
+        return -1;
+    }
+
+    struct hrtls_map_anchor anchors[HRTLS_MAP_REGION_ANCHORS_MAX];
+    for (uint8_t i = 0; i < count; i++) {
+        anchors[i].addr = net_buf_simple_pull_le16(buf);
+        anchors[i].x = net_buf_simple_pull_le32(buf);
+        anchors[i].y = net_buf_simple_pull_le32(buf);
+        anchors[i].z = net_buf_simple_pull_le32(buf);
+    }
+
+    if (handlers->map_update) {
+        handlers->map_update(ctx->addr, map_version, part, parts, &region, anchors, count);
+    }
+
+    return 0;
+}
+
+static int handle_message_cmd(struct bt_mesh_model *model,
+                              struct bt_mesh_msg_ctx *ctx,
+                              struct net_buf_simple *buf) {
+    struct hrtls_model_tag_handlers *handlers = model->user_data;
+    hrtls_metric_inc(HRTLS_METRIC_MESH_RX);
+
+    const struct hrtls_model_tag_cmd cmd = {
+        .period_ms = net_buf_simple_pull_le16(buf),
+        .uplink = net_buf_simple_pull_u8(buf),
+        .group_addr = net_buf_simple_pull_le16(buf)
+    };
+
+    if (handlers->cmd) {
+        handlers->cmd(ctx->addr, &cmd);
+    }
+
+    return 0;
+}
+
 const struct bt_mesh_model_op hrtls_model_tag_ops[] = {
+    { HRTLS_MODEL_TAG_GW_ANNOUNCE_OPCODE, BT_MESH_LEN_EXACT(HRTLS_MODEL_TAG_GW_ANNOUNCE_LEN), handle_message_gw_announce},
+    { HRTLS_MODEL_TAG_CONF_UPDATE_OPCODE, BT_MESH_LEN_MIN(HRTLS_MODEL_TAG_CONF_UPDATE_HDR_LEN), handle_message_conf_update},
+    { HRTLS_MODEL_TAG_CMD_OPCODE, BT_MESH_LEN_EXACT(HRTLS_MODEL_TAG_CMD_LEN), handle_message_cmd},
     BT_MESH_MODEL_OP_END
 };
 
-int hrtls_model_tag_loc_push(struct bt_mesh_model *tag_model, uint16_t addr, struct hrtls_model_gw_location *location) {
+int hrtls_model_tag_loc_push(struct bt_mesh_model *tag_model,
+                             uint16_t addr,
+                             const struct hrtls_model_gw_fix *fix,
+                             uint32_t age_ms,
+                             const struct bt_mesh_send_cb *cb,
+                             void *cb_data) {
     struct bt_mesh_msg_ctx ctx = {
         .addr = addr,
         .app_idx = tag_model->keys[0],
@@ -19,9 +108,122 @@ int hrtls_model_tag_loc_push(struct bt_mesh_model *tag_model, uint16_t addr, str
         // .send_rel = true
     };
 
-    BT_MESH_MODEL_BUF_DEFINE(buf, HRTLS_MODEL_GW_LOC_PUSH_OPCODE, HRTLS_MODEL_GW_LOC_PUSH_LEN);
-    bt_mesh_model_msg_init(&buf, HRTLS_MODEL_GW_LOC_PUSH_OPCODE);
-    net_buf_simple_add_mem(&buf, location, sizeof(*location));
+    BT_MESH_MODEL_BUF_DEFINE(buf, HRTLS_MODEL_GW_LOC_PUSH_V2_OPCODE, HRTLS_MODEL_GW_LOC_PUSH_V2_LEN);
+    bt_mesh_model_msg_init(&buf, HRTLS_MODEL_GW_LOC_PUSH_V2_OPCODE);
+    net_buf_simple_add_le64(&buf, hrtls_model_gw_loc_v2_pack(fix, age_ms));
+
+    return bt_mesh_model_send(tag_model, &ctx, &buf, cb, cb_data);
+}
+
+BUILD_ASSERT(HRTLS_MODEL_GW_LOC_BATCH_SEGMENTS <= CONFIG_BT_MESH_TX_SEG_MAX,
+             "Location batches don't fit into TX segments");
+
+static void add_delta(struct net_buf_simple *buf, int32_t value, int32_t prev_value) {
+    hrtls_varint_add(buf, hrtls_zigzag_encode(value - prev_value));
+}
+
+int hrtls_model_tag_loc_batch_push(struct bt_mesh_model *tag_model,
+                                   uint16_t addr,
+                                   const struct hrtls_model_gw_fix fixes[],
+                                   size_t count,
+                                   uint32_t first_age_ms,
+                                   const struct bt_mesh_send_cb *cb,
+                                   void *cb_data) {
+    if (!count || count > HRTLS_MODEL_GW_LOC_BATCH_MAX) {
+        return -EINVAL;
+    }
+
+    const struct hrtls_model_gw_fix base = {
+        .timestamp_ms = fixes[0].timestamp_ms
+    };
+    size_t len = HRTLS_MODEL_GW_LOC_BATCH_HDR_LEN;
+    for (size_t i = 0; i < count; i++) {
+        len += hrtls_model_gw_loc_batch_fix_len(&fixes[i], i ? &fixes[i - 1] : &base);
+    }
+    if (len > HRTLS_MODEL_GW_LOC_BATCH_PUSH_MAX_LEN) {
+        return -EMSGSIZE;
+    }
+
+    struct bt_mesh_msg_ctx ctx = {
+        .addr = addr,
+        .app_idx = tag_model->keys[0],
+        .send_ttl = BT_MESH_TTL_DEFAULT,
+    };
+
+    BT_MESH_MODEL_BUF_DEFINE(buf, HRTLS_MODEL_GW_LOC_BATCH_PUSH_OPCODE, HRTLS_MODEL_GW_LOC_BATCH_PUSH_MAX_LEN);
+    bt_mesh_model_msg_init(&buf, HRTLS_MODEL_GW_LOC_BATCH_PUSH_OPCODE);
+    net_buf_simple_add_u8(&buf, fixes[0].seq);
+    net_buf_simple_add_le32(&buf, first_age_ms);
+    net_buf_simple_add_u8(&buf, count);
+
+    struct hrtls_model_gw_fix prev = base;
+    for (size_t i = 0; i < count; i++) {
+        hrtls_varint_add(&buf, fixes[i].timestamp_ms - prev.timestamp_ms);
+        add_delta(&buf, fixes[i].x, prev.x);
+        add_delta(&buf, fixes[i].y, prev.y);
+        add_delta(&buf, fixes[i].z, prev.z);
+        add_delta(&buf, fixes[i].err, prev.err);
+        prev = fixes[i];
+    }
+
+    return bt_mesh_model_send(tag_model, &ctx, &buf, cb, cb_data);
+}
+
+int hrtls_model_tag_ranges_push(struct bt_mesh_model *tag_model,
+                                uint16_t addr,
+                                uint8_t seq,
+                                const struct hrtls_model_gw_range ranges[],
+                                size_t count,
+                                const struct bt_mesh_send_cb *cb,
+                                void *cb_data) {
+    if (!count || count > HRTLS_MODEL_GW_RANGES_MAX) {
+        return -EINVAL;
+    }
+
+    struct bt_mesh_msg_ctx ctx = {
+        .addr = addr,
+        .app_idx = tag_model->keys[0],
+        .send_ttl = BT_MESH_TTL_DEFAULT,
+    };
+
+    BT_MESH_MODEL_BUF_DEFINE(buf, HRTLS_MODEL_GW_RANGES_PUSH_OPCODE, HRTLS_MODEL_GW_RANGES_PUSH_MAX_LEN);
+    bt_mesh_model_msg_init(&buf, HRTLS_MODEL_GW_RANGES_PUSH_OPCODE);
+    net_buf_simple_add_u8(&buf, seq);
+    net_buf_simple_add_u8(&buf, count);
+    for (size_t i = 0; i < count; i++) {
+        net_buf_simple_add_le16(&buf, ranges[i].anchor_addr);
+        net_buf_simple_add_le16(&buf, MIN(ranges[i].distance_mm / 10, UINT16_MAX));
+        net_buf_simple_add_u8(&buf, ranges[i].nlos);
+    }
+
+    return bt_mesh_model_send(tag_model, &ctx, &buf, cb, cb_data);
+}
+
+// the gateway replies with a segmented region update per requested region at once
+BUILD_ASSERT(HRTLS_MAP_NEIGHBOURHOOD_REGIONS < CONFIG_BT_MESH_RX_SEG_MSG_COUNT,
+             "Map updates can't be reassembled in parallel");
+
+int hrtls_model_tag_map_get(struct bt_mesh_model *tag_model,
+                            uint16_t addr,
+                            const struct hrtls_map_region_ref refs[],
+                            size_t count) {
+    if (!count || count > HRTLS_MAP_NEIGHBOURHOOD_REGIONS) {
+        return -EINVAL;
+    }
+
+    struct bt_mesh_msg_ctx ctx = {
+        .addr = addr,
+        .app_idx = tag_model->keys[0],
+        .send_ttl = BT_MESH_TTL_DEFAULT,
+    };
+
+    BT_MESH_MODEL_BUF_DEFINE(buf, HRTLS_MODEL_GW_MAP_GET_OPCODE, HRTLS_MODEL_GW_MAP_GET_MAX_LEN);
+    bt_mesh_model_msg_init(&buf, HRTLS_MODEL_GW_MAP_GET_OPCODE);
+    for (size_t i = 0; i < count; i++) {
+        net_buf_simple_add_u8(&buf, refs[i].id.x);
+        net_buf_simple_add_u8(&buf, refs[i].id.y);
+        net_buf_simple_add_le16(&buf, refs[i].version);
+    }
 
     return bt_mesh_model_send(tag_model, &ctx, &buf, NULL, NULL);
 }
@@ -1,92 +1,237 @@
+#include <stdbool.h>
 #include <stddef.h>
+#include <string.h>
+
+#include <math.h>
 
 #include <zephyr.h>
 #include <zephyr/logging/log.h>
 
+#include <dw1000/decadriver/deca_device_api.h>
+
+#include <metrics/metrics.h>
 #include <models/tag.h>
+#include <trace/trace.h>
 #include <uwb/uwb.h>
 #include <uwb/tag.h>
+#include <uwb/utils.h>
 
 #include "rtls/rtls.h"
+#include "anchor_map.h"
 
 LOG_MODULE_REGISTER(positioning);
 
-static const struct rtls_anchor anchors[] = {
-    { // shelf
-        .addr = 1,
-        .pos = {
-            .x = 2.34,
-            .y = 1.57,
-            .z = 4.31
-        }
-    },
-    { // corner of window
-        .addr = 2,
-        .pos = {
-            .x = 0.27,
-            .y = 2.31,
-            .z = 5.01
+#if !defined(CONFIG_HRTLS_TAG_FIXED_POINT) && !defined(CONFIG_ZSL)
+#error "The float solver needs CONFIG_ZSL, enable it or CONFIG_HRTLS_TAG_FIXED_POINT"
+#endif
+
+// anchors of the map neighbourhood, refreshed before every positioning or calibration
+static struct rtls_anchor anchors[ANCHOR_MAP_ANCHORS_MAX];
+
+// keeps blocked anchors from zeroing out the normal equations
+#define MIN_MEASUREMENT_WEIGHT (UINT8_MAX / 20)
+#define NLOS_REJECT_THRESHOLD (CONFIG_HRTLS_NLOS_REJECT_PERCENT * UINT8_MAX / 100)
+
+static size_t reject_nlos_measurements(struct rtls_measurement measurements[],
+                                       const uint8_t nlos[],
+                                       size_t n) {
+    bool rejected[RTLS_MAX_MEASUREMENTS] = { 0 };
+    size_t left = n;
+
+    while (left > RTLS_MIN_MEASUREMENTS) {
+        size_t worst = n;
+        for (size_t i = 0; i < n; i++) {
+            if (rejected[i] || nlos[i] <= NLOS_REJECT_THRESHOLD) {
+                continue;
+            }
+            if (worst == n || nlos[i] > nlos[worst]) {
+                worst = i;
+            }
         }
-    },
-    { // wardrobe
-        .addr = 3,
-        .pos = {
-            .x = 2.56,
-            .y = 2.36,
-            .z = 0.58
+        if (worst == n) {
+            break;
         }
-    },
-    { // door
-        .addr = 4,
-        .pos = {
-            .x = 0.14,
-            .y = 0.05,
-            .z = 0.02
+        LOG_WRN("Rejecting measurement %zu, NLOS likelihood: %u%%", worst, nlos[worst] * 100 / UINT8_MAX);
+        hrtls_metric_inc(HRTLS_METRIC_NLOS_REJECTED);
+        rejected[worst] = true;
+        left--;
+    }
+
+    size_t out_n = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!rejected[i]) {
+            measurements[out_n] = measurements[i];
+            measurements[out_n].weight = MAX(UINT8_MAX - nlos[i], MIN_MEASUREMENT_WEIGHT);
+            out_n++;
         }
-    },
-};
+    }
+    return out_n;
+}
 
-int perform_positioning(struct rtls_result *out_result, size_t repetitions) {
-    static struct rtls_pos last_pos = { 0 };
+BUILD_ASSERT(RTLS_MAX_MEASUREMENTS <= HRTLS_MODEL_GW_RANGES_MAX);
 
-    size_t anchor_indices[4];
-    rtls_select_nearby_anchors(anchors, ARRAY_SIZE(anchors), last_pos, anchor_indices);
+// position the nearest anchors are picked around, the last fix or the nearest anchor in raw ranges mode
+static struct rtls_pos last_pos = { 0 };
+
+// averages ranges to anchors nearest to last_pos over given number of repetitions
+static int measure_ranges(size_t repetitions,
+                          size_t out_anchor_indices[RTLS_MAX_MEASUREMENTS],
+                          struct rtls_measurement out_measurements[RTLS_MAX_MEASUREMENTS],
+                          uint8_t out_nlos[RTLS_MAX_MEASUREMENTS],
+                          size_t *out_n) {
+    const size_t map_count = anchor_map_anchors(anchors);
+    if (map_count < RTLS_MIN_MEASUREMENTS) {
+        LOG_WRN("Not enough anchors in the map: %zu", map_count);
+        return -3;
+    }
+
+    const size_t anchors_count = MIN(map_count, RTLS_MAX_MEASUREMENTS);
+    rtls_select_nearby_anchors(anchors, map_count, last_pos, out_anchor_indices, anchors_count);
 
     // order of iteration is enforced by the fact, that
     // tags are getting overwhelmed if they're pinged in a row
-    struct rtls_measurement measurements[4] = { 0 };
+    memset(out_measurements, 0, anchors_count * sizeof(*out_measurements));
+    uint32_t nlos_sum[RTLS_MAX_MEASUREMENTS] = { 0 };
     for (size_t i = 0; i < repetitions; i++) {
-        for (size_t j = 0; j < 4; j++) {
-            const struct rtls_anchor *anchor = &anchors[anchor_indices[j]];
-            float distance;
-            int twr_res = uwb_tag_twr(CONFIG_HRTLS_PAN_ID, CONFIG_HRTLS_UWB_ADDR, anchor->addr, &distance);
+        for (size_t j = 0; j < anchors_count; j++) {
+            const struct rtls_anchor *anchor = &anchors[out_anchor_indices[j]];
+            int32_t distance;
+            struct uwb_rx_quality quality;
+            int twr_res = uwb_tag_twr(CONFIG_HRTLS_PAN_ID, CONFIG_HRTLS_UWB_ADDR, anchor->addr, &distance, &quality);
+            hrtls_metric_inc(twr_res ? HRTLS_METRIC_TWR_ERR(twr_res) : HRTLS_METRIC_TWR_OK);
             if (twr_res) {
                 LOG_WRN("TWR fail with anchor %" PRIu16 ", res: %d", anchor->addr, twr_res);
                 return -1;
             }
-            measurements[j].distance += distance;
+            out_measurements[j].distance += distance;
+            nlos_sum[j] += quality.nlos;
             k_sleep(K_MSEC(2));
         }
     }
-    for (size_t i = 0; i < 4; i++) {
-        measurements[i].distance /= repetitions;
-        measurements[i].anchor_pos = anchors[anchor_indices[i]].pos;
+    for (size_t i = 0; i < anchors_count; i++) {
+        out_measurements[i].distance /= (int32_t)repetitions;
+        out_measurements[i].anchor_pos = anchors[out_anchor_indices[i]].pos;
+        out_nlos[i] = nlos_sum[i] / repetitions;
     }
 
-    int64_t start_time = k_uptime_get();
+    *out_n = anchors_count;
+    return 0;
+}
+
+int perform_positioning(struct rtls_result *out_result, size_t repetitions) {
+    size_t anchor_indices[RTLS_MAX_MEASUREMENTS];
+    struct rtls_measurement measurements[RTLS_MAX_MEASUREMENTS];
+    uint8_t nlos[RTLS_MAX_MEASUREMENTS];
+    size_t anchors_count;
+    int res = measure_ranges(repetitions, anchor_indices, measurements, nlos, &anchors_count);
+    if (res) {
+        return res;
+    }
+
+    size_t measurements_count = reject_nlos_measurements(measurements, nlos, anchors_count);
+
     struct rtls_result result;
-    int fp_res = rtls_find_position(measurements, &result);
+    uint32_t start = k_cycle_get_32();
+#ifdef CONFIG_HRTLS_TAG_FIXED_POINT
+    int fp_res = rtls_find_position_fixed(measurements, measurements_count, &result);
+#else
+    int fp_res = rtls_find_position(measurements, measurements_count, &result);
+#endif
+    hrtls_metric_record(HRTLS_METRIC_SOLVE_US, k_cyc_to_us_floor32(k_cycle_get_32() - start));
     if (fp_res) {
         LOG_WRN("Find position fail, res: %d", fp_res);
+        hrtls_metric_inc(HRTLS_METRIC_SOLVER_FAIL);
         return -2;
     }
     last_pos = result.pos;
 
-    LOG_INF("Find position res %f/%f/%f/%f/%" PRId64,
-            result.pos.x, result.pos.y, result.pos.z,
-            result.error,
-            k_uptime_get() - start_time);
+    HRTLS_TRACE(HRTLS_TRACE_TAG_POSITION, result.pos.x, result.pos.y, result.pos.z);
 
     *out_result = result;
     return 0;
 }
+
+int perform_ranging(struct hrtls_model_gw_range out_ranges[RTLS_MAX_MEASUREMENTS],
+                    size_t *out_count,
+                    struct rtls_pos *out_approx_pos,
+                    size_t repetitions) {
+    size_t anchor_indices[RTLS_MAX_MEASUREMENTS];
+    struct rtls_measurement measurements[RTLS_MAX_MEASUREMENTS];
+    uint8_t nlos[RTLS_MAX_MEASUREMENTS];
+    size_t anchors_count;
+    int res = measure_ranges(repetitions, anchor_indices, measurements, nlos, &anchors_count);
+    if (res) {
+        return res;
+    }
+
+    size_t nearest = 0;
+    for (size_t i = 0; i < anchors_count; i++) {
+        out_ranges[i] = (struct hrtls_model_gw_range) {
+            .anchor_addr = anchors[anchor_indices[i]].addr,
+            .distance_mm = MAX(measurements[i].distance, 0),
+            .nlos = nlos[i]
+        };
+        if (measurements[i].distance < measurements[nearest].distance) {
+            nearest = i;
+        }
+    }
+
+    // the tag doesn't know its position, nearest anchor is good enough to pick anchors around
+    last_pos = measurements[nearest].anchor_pos;
+
+    *out_count = anchors_count;
+    *out_approx_pos = last_pos;
+    return 0;
+}
+
+int perform_calibration(const struct rtls_pos *tag_pos, size_t repetitions, uint16_t *out_ant_dly) {
+    // SS-TWR range error is the sum of residual delays of both ends,
+    // anchors are assumed to be calibrated already
+    const size_t count = anchor_map_anchors(anchors);
+    if (count < CONFIG_HRTLS_CALIB_MIN_ANCHORS) {
+        LOG_WRN("Not enough anchors in the map: %zu", count);
+        return -3;
+    }
+
+    float errors[ARRAY_SIZE(anchors)] = { 0 };
+    for (size_t i = 0; i < repetitions; i++) {
+        for (size_t j = 0; j < count; j++) {
+            int32_t distance;
+            int twr_res = uwb_tag_twr(CONFIG_HRTLS_PAN_ID, CONFIG_HRTLS_UWB_ADDR, anchors[j].addr, &distance, NULL);
+            if (twr_res) {
+                LOG_WRN("TWR fail with anchor %" PRIu16 ", res: %d", anchors[j].addr, twr_res);
+                return -1;
+            }
+            errors[j] += distance / 1000.0f;
+            k_sleep(K_MSEC(2));
+        }
+    }
+
+    float mean_error = 0;
+    for (size_t i = 0; i < count; i++) {
+        const struct rtls_pos *pos = &anchors[i].pos;
+        float true_distance = sqrtf(powf(pos->x - tag_pos->x, 2) +
+                                    powf(pos->y - tag_pos->y, 2) +
+                                    powf(pos->z - tag_pos->z, 2)) / 1000;
+        errors[i] = errors[i] / repetitions - true_distance;
+        mean_error += errors[i] / count;
+    }
+
+    float residual_pow2 = 0;
+    for (size_t i = 0; i < count; i++) {
+        residual_pow2 += powf(errors[i] - mean_error, 2) / count;
+    }
+
+    float correction = mean_error / (SPEED_OF_LIGHT_M_S * DWT_TIME_UNITS);
+    float ant_dly = uwb_antenna_delay() + roundf(correction);
+    if (ant_dly <= 0 || ant_dly >= UINT16_MAX) {
+        LOG_WRN("Antenna delay out of range: %f", ant_dly);
+        return -2;
+    }
+
+    LOG_INF("Calibration mean error %f m, residual RMS %f m, antenna delay %u -> %u",
+            mean_error, sqrtf(residual_pow2), uwb_antenna_delay(), (unsigned)ant_dly);
+
+    *out_ant_dly = (uint16_t)ant_dly;
+    return 0;
+}
@@ -1,6 +1,19 @@
 #pragma once
 #include <stddef.h>
+#include <stdint.h>
+
+#include <models/gw.h>
 
 #include "rtls/rtls.h"
 
 int perform_positioning(struct rtls_result *out_result, size_t repetitions);
+// measures ranges to be solved by the gateway, approximate position is good enough
+// to select anchors and sync the map around it
+int perform_ranging(struct hrtls_model_gw_range out_ranges[RTLS_MAX_MEASUREMENTS],
+                    size_t *out_count,
+                    struct rtls_pos *out_approx_pos,
+                    size_t repetitions);
+
+// estimates antenna delay of this tag placed at a known position,
+// ranging with every anchor of the map neighbourhood
+int perform_calibration(const struct rtls_pos *tag_pos, size_t repetitions, uint16_t *out_ant_dly);
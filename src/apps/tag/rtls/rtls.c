@@ -1,21 +1,16 @@
 #include <assert.h>
 #include <errno.h>
 #include <math.h>
-#include <memory.h>
 #include <stddef.h>
 #include <stdint.h>
-#include <stdlib.h>
 
+#ifdef CONFIG_ZSL
 #include <zsl/zsl.h>
 #include <zsl/matrices.h>
+#endif
 
 #include "rtls.h"
 
-struct cmp_args {
-    const struct rtls_anchor *anchors;
-    struct rtls_pos last_pos;
-};
-
 static inline float powf2(float x) {
     return x * x;
 }
@@ -24,92 +19,100 @@ static inline float vec3_len_pow2(float x, float y, float z) {
     return powf2(x) + powf2(y) + powf2(z);
 }
 
-static inline float pos_pow2(const struct rtls_pos *pos) {
-    return vec3_len_pow2(pos->x, pos->y, pos->z);
-}
-
-static int anchor_indices_cmp(void *arg, const void *a, const void *b) {
-    struct cmp_args *args = arg;
-    const struct rtls_pos *last_pos = &args->last_pos;
-    const struct rtls_pos *a_pos = &args->anchors[*(const size_t *)a].pos;
-    const struct rtls_pos *b_pos = &args->anchors[*(const size_t *)b].pos;
-
-    float dist_a_pow2 = vec3_len_pow2(a_pos->x - last_pos->x,
-                                      a_pos->y - last_pos->y,
-                                      a_pos->z - last_pos->z);
-    float dist_b_pow2 = vec3_len_pow2(b_pos->x - last_pos->x,
-                                      b_pos->y - last_pos->y,
-                                      b_pos->z - last_pos->z);
-
-    float dist_pow2_diff = dist_a_pow2 - dist_b_pow2;
-    if (dist_pow2_diff < 0) {
-        return -1;
-    }
-    else if (dist_pow2_diff > 0) {
-        return 1;
-    }
-
-    return 0;
+static inline int64_t dist_pow2(const struct rtls_pos *a, const struct rtls_pos *b) {
+    const int64_t dx = a->x - b->x;
+    const int64_t dy = a->y - b->y;
+    const int64_t dz = a->z - b->z;
+    return dx * dx + dy * dy + dz * dz;
 }
 
 int rtls_select_nearby_anchors(const struct rtls_anchor anchors[],
                                size_t n,
                                struct rtls_pos last_pos,
-                               size_t out_anchor_indices[4]) {
+                               size_t out_anchor_indices[],
+                               size_t out_n) {
     assert(anchors);
     assert(out_anchor_indices);
-    assert(n >= 4);
+    assert(out_n >= RTLS_MIN_MEASUREMENTS);
+    assert(n >= out_n);
 
-    size_t *indices = malloc(n * sizeof(*indices));
-    if (!indices) {
-        return -ENOMEM;
-    }
+    // out_n nearest anchors kept sorted by insertion, out_n is small and
+    // this avoids both the heap and qsort_r(), whose signature differs between libcs
+    int64_t out_dist_pow2[RTLS_MAX_MEASUREMENTS];
+    assert(out_n <= RTLS_MAX_MEASUREMENTS);
 
+    size_t count = 0;
     for (size_t i = 0; i < n; i++) {
-        indices[i] = i;
+        const int64_t d = dist_pow2(&anchors[i].pos, &last_pos);
+        if (count == out_n && d >= out_dist_pow2[count - 1]) {
+            continue;
+        }
+
+        size_t j = count < out_n ? count++ : count - 1;
+        for (; j > 0 && out_dist_pow2[j - 1] > d; j--) {
+            out_dist_pow2[j] = out_dist_pow2[j - 1];
+            out_anchor_indices[j] = out_anchor_indices[j - 1];
+        }
+        out_dist_pow2[j] = d;
+        out_anchor_indices[j] = i;
     }
 
-    struct cmp_args args = {
-        .anchors = anchors,
-        .last_pos = last_pos
-    };
-
-    qsort_r(indices, n, sizeof(*indices), &args, anchor_indices_cmp);
-    memcpy(out_anchor_indices, indices, 4 * sizeof(*indices));
-
     return 0;
 }
 
-int rtls_find_position(const struct rtls_measurement measurements[4],
+// tags positioning on integers only can be built without zscilib
+#ifdef CONFIG_ZSL
+int rtls_find_position(const struct rtls_measurement measurements[],
+                       size_t n,
                        struct rtls_result *out_result) {
     assert(measurements);
     assert(out_result);
+    assert(n >= RTLS_MIN_MEASUREMENTS && n <= RTLS_MAX_MEASUREMENTS);
 
-    ZSL_MATRIX_DEF(A, 4, 4);
-    for (size_t row = 0; row < 4; row++) {
-        zsl_mtx_set(&A, row, 0, 1);
-        zsl_mtx_set(&A, row, 1, -2 * measurements[row].anchor_pos.x);
-        zsl_mtx_set(&A, row, 2, -2 * measurements[row].anchor_pos.y);
-        zsl_mtx_set(&A, row, 3, -2 * measurements[row].anchor_pos.z);
+    // each measurement contributes a row of the linearized system
+    // [1, -2x, -2y, -2z] * [w, x, y, z]^T = d^2 - |anchor|^2
+    // which is solved through normal equations A^T W A * res = A^T W b
+    zsl_real_t ata[4 * 4] = { 0 };
+    zsl_real_t atb[4] = { 0 };
+    for (size_t i = 0; i < n; i++) {
+        const struct rtls_measurement *m = &measurements[i];
+        assert(m->weight > 0);
+
+        // in m, so that squares stay well within single precision
+        const float ax = m->anchor_pos.x / 1000.0f;
+        const float ay = m->anchor_pos.y / 1000.0f;
+        const float az = m->anchor_pos.z / 1000.0f;
+        const float weight = m->weight / (float)UINT8_MAX;
+
+        const zsl_real_t row[4] = { 1, -2 * ax, -2 * ay, -2 * az };
+        const zsl_real_t b = powf2(m->distance / 1000.0f) - vec3_len_pow2(ax, ay, az);
+
+        for (size_t r = 0; r < 4; r++) {
+            for (size_t c = 0; c < 4; c++) {
+                ata[r * 4 + c] += weight * row[r] * row[c];
+            }
+            atb[r] += weight * row[r] * b;
+        }
     }
 
-    zsl_real_t A_det;
-    zsl_mtx_deter(&A, &A_det);
-    if (A_det == 0) {
+    ZSL_MATRIX_DEF(AtA, 4, 4);
+    zsl_mtx_from_arr(&AtA, ata);
+
+    zsl_real_t AtA_det;
+    zsl_mtx_deter(&AtA, &AtA_det);
+    if (AtA_det == 0) {
         // det == 0 <=> anchors are coplanar
         return -EINVAL;
     }
 
-    ZSL_MATRIX_DEF(A_inv, 4, 4);
-    zsl_mtx_inv(&A, &A_inv);
+    ZSL_MATRIX_DEF(AtA_inv, 4, 4);
+    zsl_mtx_inv(&AtA, &AtA_inv);
 
-    ZSL_MATRIX_DEF(b, 4, 1);
-    for (size_t row = 0; row < 4; row++) {
-        zsl_mtx_set(&b, row, 0, powf2(measurements[row].distance) - pos_pow2(&measurements[row].anchor_pos));
-    }
+    ZSL_MATRIX_DEF(Atb, 4, 1);
+    zsl_mtx_from_arr(&Atb, atb);
 
     ZSL_MATRIX_DEF(res, 4, 1);
-    zsl_mtx_mult(&A_inv, &b, &res);
+    zsl_mtx_mult(&AtA_inv, &Atb, &res);
 
     float w, x, y, z;
     zsl_mtx_get(&res, 0, 0, &w);
@@ -117,10 +120,11 @@ int rtls_find_position(const struct rtls_measurement measurements[4],
     zsl_mtx_get(&res, 2, 0, &y);
     zsl_mtx_get(&res, 3, 0, &z);
 
-    out_result->error = fabsf(w - vec3_len_pow2(x, y, z));
-    out_result->pos.x = x;
-    out_result->pos.y = y;
-    out_result->pos.z = z;
+    out_result->error = fabsf(w - vec3_len_pow2(x, y, z)) * 1000;
+    out_result->pos.x = lroundf(x * 1000);
+    out_result->pos.y = lroundf(y * 1000);
+    out_result->pos.z = lroundf(z * 1000);
 
     return 0;
 }
+#endif
@@ -3,10 +3,14 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#define RTLS_MIN_MEASUREMENTS 4
+#define RTLS_MAX_MEASUREMENTS 8
+
+// in mm, as anchor maps and fixes carry them
 struct rtls_pos {
-    float x;
-    float y;
-    float z;
+    int32_t x;
+    int32_t y;
+    int32_t z;
 };
 
 struct rtls_anchor {
@@ -16,18 +20,33 @@ struct rtls_anchor {
 
 struct rtls_measurement {
     struct rtls_pos anchor_pos;
-    float distance;
+    // in mm
+    int32_t distance;
+    // relative confidence in the measurement, 1..UINT8_MAX
+    uint8_t weight;
 };
 
 struct rtls_result {
     struct rtls_pos pos;
-    float error;
+    // |w - |pos|^2| residual of the linearized system, in 1000ths of m^2
+    uint32_t error;
 };
 
 int rtls_select_nearby_anchors(const struct rtls_anchor anchors[],
                                size_t n,
                                struct rtls_pos last_pos,
-                               size_t out_anchor_indices[4]);
+                               size_t out_anchor_indices[],
+                               size_t out_n);
 
-int rtls_find_position(const struct rtls_measurement measurements[4],
+// weighted least squares over RTLS_MIN_MEASUREMENTS..RTLS_MAX_MEASUREMENTS measurements,
+// with exactly RTLS_MIN_MEASUREMENTS it's an exact solution regardless of weights,
+// available with CONFIG_ZSL only
+int rtls_find_position(const struct rtls_measurement measurements[],
+                       size_t n,
                        struct rtls_result *out_result);
+
+// rtls_find_position() on integers only, for tags without an FPU,
+// anchors have to be within 2^24 mm of each other and distances below that
+int rtls_find_position_fixed(const struct rtls_measurement measurements[],
+                             size_t n,
+                             struct rtls_result *out_result);
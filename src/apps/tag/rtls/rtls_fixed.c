@@ -0,0 +1,180 @@
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "rtls.h"
+
+// Same linearized system as rtls_find_position(), taken relative to the first anchor and
+// divided by a power of two P bounding all lengths involved, so that the unknowns become
+// [w / P^2, x / P, y / P, z / P] and every coefficient of a row lies within [-1, 1].
+#define MAX_LENGTH_MM (1 << 24)
+#define MIN_SCALE_BITS 10
+#define ROW_FRAC_BITS 20
+// normal equations are scaled down to it before elimination, products of two entries stay within 64 bits
+#define NORMAL_MAX_BITS 29
+#define SOLUTION_FRAC_BITS 28
+#define SOLUTION_ONE ((int64_t)1 << SOLUTION_FRAC_BITS)
+
+static inline int64_t shift_right_round(int64_t value, unsigned shift) {
+    return shift ? (value + ((int64_t)1 << (shift - 1))) >> shift : value;
+}
+
+static inline unsigned bit_length(uint64_t value) {
+    return value ? 64 - __builtin_clzll(value) : 0;
+}
+
+static inline int64_t max3(int64_t a, int64_t b, int64_t c) {
+    return a > b ? (a > c ? a : c) : (b > c ? b : c);
+}
+
+static void swap_unknowns(int64_t ata[4][4], int64_t atb[4], size_t order[4], size_t i, size_t j) {
+    for (size_t k = 0; k < 4; k++) {
+        const int64_t row = ata[i][k];
+        ata[i][k] = ata[j][k];
+        ata[j][k] = row;
+    }
+    for (size_t k = 0; k < 4; k++) {
+        const int64_t col = ata[k][i];
+        ata[k][i] = ata[k][j];
+        ata[k][j] = col;
+    }
+    const int64_t b = atb[i];
+    atb[i] = atb[j];
+    atb[j] = b;
+    const size_t o = order[i];
+    order[i] = order[j];
+    order[j] = o;
+}
+
+// gaussian elimination of the symmetric positive definite normal equations, solution in Q SOLUTION_FRAC_BITS
+static int solve_normal_equations(int64_t ata[4][4], int64_t atb[4], int64_t out_res[4]) {
+    size_t order[4] = { 0, 1, 2, 3 };
+
+    for (size_t i = 0; i < 4; i++) {
+        // pivoting on the largest remaining diagonal keeps multipliers within [-1, 1]
+        size_t pivot = i;
+        for (size_t k = i + 1; k < 4; k++) {
+            if (ata[k][k] > ata[pivot][pivot]) {
+                pivot = k;
+            }
+        }
+        swap_unknowns(ata, atb, order, i, pivot);
+        if (ata[i][i] <= 0) {
+            // anchors are coplanar
+            return -EINVAL;
+        }
+
+        for (size_t j = i + 1; j < 4; j++) {
+            const int64_t f = ata[j][i];
+            for (size_t k = i; k < 4; k++) {
+                ata[j][k] -= ata[i][k] * f / ata[i][i];
+            }
+            atb[j] -= atb[i] * f / ata[i][i];
+        }
+    }
+
+    int64_t res[4];
+    for (size_t i = 4; i-- > 0;) {
+        int64_t num = atb[i] * SOLUTION_ONE;
+        for (size_t k = i + 1; k < 4; k++) {
+            num -= ata[i][k] * res[k];
+        }
+        res[i] = num / ata[i][i];
+        // P bounds the solution by construction, anything past it comes from nearly coplanar anchors
+        if (llabs(res[i]) > 2 * SOLUTION_ONE) {
+            return -EINVAL;
+        }
+    }
+
+    for (size_t i = 0; i < 4; i++) {
+        out_res[order[i]] = res[i];
+    }
+    return 0;
+}
+
+int rtls_find_position_fixed(const struct rtls_measurement measurements[],
+                             size_t n,
+                             struct rtls_result *out_result) {
+    assert(measurements);
+    assert(out_result);
+    assert(n >= RTLS_MIN_MEASUREMENTS && n <= RTLS_MAX_MEASUREMENTS);
+
+    const struct rtls_pos *origin = &measurements[0].anchor_pos;
+    int64_t max_length = 0;
+    for (size_t i = 0; i < n; i++) {
+        const struct rtls_measurement *m = &measurements[i];
+        assert(m->weight > 0);
+
+        const int64_t length = max3(llabs((int64_t)m->anchor_pos.x - origin->x),
+                                    llabs((int64_t)m->anchor_pos.y - origin->y),
+                                    llabs((int64_t)m->anchor_pos.z - origin->z));
+        max_length = max3(max_length, length, llabs(m->distance));
+    }
+    if (max_length >= MAX_LENGTH_MM) {
+        return -ERANGE;
+    }
+
+    // P > 2 * every length keeps the tag, which is within distance of each anchor, inside [-1, 1] too
+    unsigned scale_bits = bit_length(2 * max_length);
+    if (scale_bits < MIN_SCALE_BITS) {
+        scale_bits = MIN_SCALE_BITS;
+    }
+
+    // rows in Q ROW_FRAC_BITS, normal equations accumulate weights on top of that
+    int64_t ata[4][4] = { 0 };
+    int64_t atb[4] = { 0 };
+    for (size_t i = 0; i < n; i++) {
+        const struct rtls_measurement *m = &measurements[i];
+        const int64_t ax = m->anchor_pos.x - origin->x;
+        const int64_t ay = m->anchor_pos.y - origin->y;
+        const int64_t az = m->anchor_pos.z - origin->z;
+
+        const int64_t row[4] = {
+            (int64_t)1 << ROW_FRAC_BITS,
+            shift_right_round(-ax * ((int64_t)2 << ROW_FRAC_BITS), scale_bits),
+            shift_right_round(-ay * ((int64_t)2 << ROW_FRAC_BITS), scale_bits),
+            shift_right_round(-az * ((int64_t)2 << ROW_FRAC_BITS), scale_bits)
+        };
+        const int64_t b = shift_right_round((int64_t)m->distance * m->distance - (ax * ax + ay * ay + az * az),
+                                            2 * scale_bits - ROW_FRAC_BITS);
+
+        for (size_t r = 0; r < 4; r++) {
+            for (size_t c = 0; c < 4; c++) {
+                ata[r][c] += m->weight * row[r] * row[c];
+            }
+            atb[r] += m->weight * row[r] * b;
+        }
+    }
+
+    // the first row has the largest coefficients, so ata[0][0] is the largest entry
+    const unsigned normal_bits = bit_length(ata[0][0]);
+    const unsigned normal_shift = normal_bits > NORMAL_MAX_BITS ? normal_bits - NORMAL_MAX_BITS : 0;
+    for (size_t r = 0; r < 4; r++) {
+        for (size_t c = 0; c < 4; c++) {
+            ata[r][c] = shift_right_round(ata[r][c], normal_shift);
+        }
+        atb[r] = shift_right_round(atb[r], normal_shift);
+    }
+
+    int64_t res[4];
+    int err = solve_normal_equations(ata, atb, res);
+    if (err) {
+        return err;
+    }
+
+    const unsigned pos_shift = SOLUTION_FRAC_BITS - scale_bits;
+    out_result->pos.x = origin->x + shift_right_round(res[1], pos_shift);
+    out_result->pos.y = origin->y + shift_right_round(res[2], pos_shift);
+    out_result->pos.z = origin->z + shift_right_round(res[3], pos_shift);
+
+    // |w - |pos|^2| in units of P^2, then in mm^2
+    const int64_t len_pow2 = (res[1] * res[1] + res[2] * res[2] + res[3] * res[3]) >> SOLUTION_FRAC_BITS;
+    const uint64_t residual = llabs(res[0] - len_pow2);
+    const int residual_shift = 2 * (int)scale_bits - SOLUTION_FRAC_BITS;
+    const uint64_t residual_mm2 = residual_shift >= 0 ? residual << residual_shift : residual >> -residual_shift;
+    out_result->error = residual_mm2 / 1000 > UINT32_MAX ? UINT32_MAX : residual_mm2 / 1000;
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <zephyr/shell/shell.h>
+
+#include <metrics/metrics.h>
+
+#include "rtls/rtls.h"
+#include "latency.h"
+#include "main.h"
+
+static int cmd_calib(const struct shell *sh, size_t argc, char **argv) {
+    const struct rtls_pos tag_pos = {
+        .x = strtof(argv[1], NULL) * 1000,
+        .y = strtof(argv[2], NULL) * 1000,
+        .z = strtof(argv[3], NULL) * 1000
+    };
+
+    int res = request_calibration(&tag_pos);
+    if (res) {
+        shell_error(sh, "Calibration already pending");
+        return res;
+    }
+
+    shell_print(sh, "Calibration scheduled for the next positioning cycle");
+    return 0;
+}
+
+static int cmd_latency(const struct shell *sh, size_t argc, char **argv) {
+    hrtls_latency_print(&latency, sh);
+    return 0;
+}
+
+static int cmd_latency_reset(const struct shell *sh, size_t argc, char **argv) {
+    hrtls_latency_reset(&latency);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(latency_cmds,
+    SHELL_CMD(reset, NULL, "Clear latency histograms", cmd_latency_reset),
+    SHELL_SUBCMD_SET_END
+);
+
+static int cmd_stats(const struct shell *sh, size_t argc, char **argv) {
+    hrtls_metrics_print(sh);
+    return 0;
+}
+
+static int cmd_stats_reset(const struct shell *sh, size_t argc, char **argv) {
+    hrtls_metrics_reset();
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(stats_cmds,
+    SHELL_CMD(reset, NULL, "Clear counters and histograms", cmd_stats_reset),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(hrtls_cmds,
+    SHELL_CMD_ARG(calib, NULL, "Calibrate antenna delay with tag placed at <x> <y> <z> [m]", cmd_calib, 4, 0),
+    SHELL_CMD(latency, &latency_cmds, "Print latency percentiles of positioning and uplink stages", cmd_latency),
+    SHELL_CMD(stats, &stats_cmds, "Print runtime metrics", cmd_stats),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(hrtls, &hrtls_cmds, "HyperRTLS commands", NULL);
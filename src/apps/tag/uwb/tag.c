@@ -7,14 +7,15 @@
 
 #include <dw1000/decadriver/deca_device_api.h>
 #include <dw1000/decadriver/deca_regs.h>
+#include <dw1000/platform/deca_range_tables.h>
+#include <metrics/metrics.h>
+#include <uwb/frames.h>
+#include <uwb/twr.h>
 #include <uwb/utils.h>
 #include <uwb/tag.h>
 
 LOG_MODULE_REGISTER(tag);
 
-#define SS_POLL_RX_TS_OFFSET 10
-#define SS_RESP_TX_TS_OFFSET 14
-
 #define SS_POLL_TX_RESP_RX_DLY_UUS (140 + 800)
 #define SS_RESP_RX_TIMEOUT_UUS 210
 
@@ -23,49 +24,46 @@ static void ss_poll_build(uint16_t pan_id,
                           uint16_t target_addr,
                           uint8_t frame_seq_nb,
                           uint8_t *buf) {
-    const uint8_t poll[] = {
-        0x41, 0x88, // header
-        frame_seq_nb,
-        GET_BYTE(pan_id, 0), GET_BYTE(pan_id, 1),
-        GET_BYTE(target_addr, 0), GET_BYTE(target_addr, 1),
-        GET_BYTE(self_addr, 0), GET_BYTE(self_addr, 1),
-        0xE0 // poll
+    const struct uwb_frame_ss_poll poll = {
+        .hdr = {
+            .fctrl = UWB_FRAME_FCTRL_DATA,
+            .seq = frame_seq_nb,
+            .pan_id = pan_id,
+            .dst = target_addr,
+            .src = self_addr
+        }
     };
 
-    static_assert(sizeof(poll) == SS_POLL_LEN);
-
-    memcpy(buf, poll, SS_POLL_LEN);
+    uwb_frame_ss_poll_encode(&poll, buf);
 }
 
-static int ss_response_verify(uint16_t pan_id, uint16_t self_addr, uint16_t target_addr, const uint8_t *frame) {
-    const uint8_t expected_header[] = {
-        0x41, 0x88, //header
-        0,
-        GET_BYTE(pan_id, 0), GET_BYTE(pan_id, 1),
-        GET_BYTE(self_addr, 0), GET_BYTE(self_addr, 1),
-        GET_BYTE(target_addr, 0), GET_BYTE(target_addr, 1),
-        0xE1 // response
-    };
-
-    const bool mask[] = {
-        true, true,
-        false,
-        true, true,
-        true, true,
-        true, true,
-        true
-    };
-
-    static_assert(ARRAY_SIZE(expected_header) == SS_RESP_LEN - 8);
-    static_assert(ARRAY_SIZE(mask) == SS_RESP_LEN - 8);
+// the anchor differs for every poll, so only own addressing is matched and the source is compared once decoded
+static int ss_response_verify(uint16_t pan_id, uint16_t self_addr, const uint8_t *frame) {
+    static struct uwb_frame_matcher matcher;
+    static struct uwb_frame_hdr matched_header;
+
+    if (!matched_header.fctrl || matched_header.pan_id != pan_id || matched_header.dst != self_addr) {
+        matched_header = (struct uwb_frame_hdr) {
+            .fctrl = UWB_FRAME_FCTRL_DATA,
+            .pan_id = pan_id,
+            .dst = self_addr
+        };
+        uwb_frame_ss_resp_matcher_init(&matcher,
+                                       &matched_header,
+                                       UWB_FRAME_MATCH_PAN_ID | UWB_FRAME_MATCH_DST);
+    }
 
-    return masked_memcmp(expected_header, frame, mask, SS_RESP_LEN - 8);
+    return uwb_frame_match(&matcher, frame);
 }
 
-static int uwb_tag_twr_ss(uint16_t pan_id, uint16_t self_addr, uint16_t target_addr, float *out_distance_m) {
+static int uwb_tag_twr_ss(uint16_t pan_id,
+                          uint16_t self_addr,
+                          uint16_t target_addr,
+                          int32_t *out_distance_mm,
+                          struct uwb_rx_quality *out_quality) {
     static uint8_t frame_seq_nb = 0;
 
-    uint8_t poll_buf[SS_POLL_LEN];
+    uint8_t poll_buf[uwb_frame_ss_poll_len];
     ss_poll_build(pan_id, self_addr, target_addr, frame_seq_nb++, poll_buf);
 
     // reset RX
@@ -79,42 +77,82 @@ static int uwb_tag_twr_ss(uint16_t pan_id, uint16_t self_addr, uint16_t target_a
         return -2;
     }
 
+    // only the first poll after a deep sleep has a wake up to measure
+    const uint32_t wakeup_to_poll_us = uwb_take_wakeup_elapsed_us();
+    if (wakeup_to_poll_us) {
+        hrtls_metric_record(HRTLS_METRIC_WAKEUP_TO_POLL_US, wakeup_to_poll_us);
+    }
+
     uint32_t status_reg = wait_for_status(SYS_STATUS_RXFCG | SYS_STATUS_ALL_RX_ERR | SYS_STATUS_ALL_RX_TO);
     if (!(status_reg & SYS_STATUS_RXFCG)) {
         return -3;
     }
 
-    uint8_t response_buf[SS_RESP_LEN];
+    uint8_t response_buf[uwb_frame_ss_resp_len];
     if (read_frame(response_buf, ARRAY_SIZE(response_buf))) {
         return -4;
     }
 
-    if (ss_response_verify(pan_id, self_addr, target_addr, response_buf)) {
-        LOG_HEXDUMP_INF(response_buf, SS_RESP_LEN, "XD");
+    if (ss_response_verify(pan_id, self_addr, response_buf)) {
+        LOG_HEXDUMP_INF(response_buf, uwb_frame_ss_resp_len, "XD");
         return -5;
     }
 
+    struct uwb_frame_ss_resp response;
+    uwb_frame_ss_resp_decode(response_buf, &response);
+    if (response.hdr.src != target_addr) {
+        return -5;
+    }
+
+    if (out_quality) {
+        uwb_read_rx_quality(out_quality);
+    }
+
     uint32_t poll_tx_ts = dwt_readtxtimestamplo32();
-    uint32_t poll_rx_ts = (uint32_t)buf_le_to_u64(response_buf + SS_POLL_RX_TS_OFFSET, 4);
-    uint32_t resp_tx_ts = (uint32_t)buf_le_to_u64(response_buf + SS_RESP_TX_TS_OFFSET, 4);
+    uint32_t poll_rx_ts = (uint32_t)response.poll_rx_ts;
+    uint32_t resp_tx_ts = (uint32_t)response.resp_tx_ts;
     uint32_t resp_rx_ts = dwt_readrxtimestamplo32();
-    float clock_offset_ratio = dwt_readcarrierintegrator() * (FREQ_OFFSET_MULTIPLIER * HERTZ_TO_PPM_MULTIPLIER_CHAN_2 / 1e6);
+    int32_t carrier_integrator = dwt_readcarrierintegrator();
 
     uint32_t tx_to_rx_tag = resp_rx_ts - poll_tx_ts;
     uint32_t rx_to_tx_anchor = resp_tx_ts - poll_rx_ts;
 
-    float tof = ((tx_to_rx_tag - rx_to_tx_anchor * (1 - clock_offset_ratio)) / 2e0) * DWT_TIME_UNITS;
-    *out_distance_m = tof * SPEED_OF_LIGHT_M_S;
+    if (IS_ENABLED(CONFIG_HRTLS_TAG_FIXED_POINT)) {
+        int32_t distance = uwb_ss_twr_distance_mm(tx_to_rx_tag, rx_to_tx_anchor, carrier_integrator);
+        if (IS_ENABLED(CONFIG_HRTLS_UWB_RANGE_BIAS)) {
+            distance -= deca_range_bias_mm(distance);
+        }
+        *out_distance_mm = distance;
+    }
+    else {
+        float distance = uwb_ss_twr_distance_m(tx_to_rx_tag, rx_to_tx_anchor, carrier_integrator);
+        if (IS_ENABLED(CONFIG_HRTLS_UWB_RANGE_BIAS)) {
+            distance -= deca_range_bias(distance);
+        }
+        *out_distance_mm = distance * 1000;
+    }
     return 0;
 }
 
-static int uwb_tag_twr_ds(uint16_t pan_id, uint16_t self_addr, uint16_t target_addr, float *out_distance_m) {
+static int uwb_tag_twr_ds(uint16_t pan_id,
+                          uint16_t self_addr,
+                          uint16_t target_addr,
+                          int32_t *out_distance_mm,
+                          struct uwb_rx_quality *out_quality) {
     assert(false);
     return -1;
 }
 
-int uwb_tag_twr(uint16_t pan_id, uint16_t self_addr, uint16_t target_addr, float *out_distance_m) {
-    int (*impls[])(uint16_t pan_id, uint16_t self_addr, uint16_t target_addr, float *out_distance_m) = {
+int uwb_tag_twr(uint16_t pan_id,
+                uint16_t self_addr,
+                uint16_t target_addr,
+                int32_t *out_distance_mm,
+                struct uwb_rx_quality *out_quality) {
+    int (*impls[])(uint16_t pan_id,
+                   uint16_t self_addr,
+                   uint16_t target_addr,
+                   int32_t *out_distance_mm,
+                   struct uwb_rx_quality *out_quality) = {
         [UWB_TWR_MODE_SS] = uwb_tag_twr_ss,
         [UWB_TWR_MODE_DS] = uwb_tag_twr_ds
     };
@@ -123,5 +161,5 @@ int uwb_tag_twr(uint16_t pan_id, uint16_t self_addr, uint16_t target_addr, float
         return -1;
     }
 
-    return impls[uwb_current_mode](pan_id, self_addr, target_addr, out_distance_m);
+    return impls[uwb_current_mode](pan_id, self_addr, target_addr, out_distance_mm, out_quality);
 }
@@ -696,3 +696,95 @@ double dwt_getrangebias(uint8 chan, float range, uint8 prf)
 
     return (mOffset) ;
 }
+
+//---------------------------------------------------------------------------------------------------------------------------
+// Direct lookup variant of dwt_getrangebias(): correction in CM for every 25 CM range bin (0..255) of selected channel/PRF
+//---------------------------------------------------------------------------------------------------------------------------
+
+#define NUM_RANGE_BINS      (256)
+
+static int8 range_bias_cm[NUM_RANGE_BINS];
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * Function: deca_range_bias_init()
+ *
+ * Description: This function precomputes the range bias correction for every 25 CM bin, so that
+ *              deca_range_bias() doesn't have to scan the correction table on every call.
+ *
+ * input parameters:
+ * @param chan  - specifies the operating channel (e.g. 1, 2, 3, 4, 5, 6 or 7)
+ * @param prf   - this is the PRF e.g. DWT_PRF_16M or DWT_PRF_64M
+ *
+ * output parameters
+ *
+ * no return value
+ */
+void deca_range_bias_init(uint8 chan, uint8 prf)
+{
+    const uint8 *table ;
+    int cmoffseti ;
+    int wideband = (chan == 4) || (chan == 7) ;
+
+    if (prf == DWT_PRF_16M)
+    {
+        table = wideband ? range25cm16PRFwb[chan_idxwb[chan]] : range25cm16PRFnb[chan_idxnb[chan]] ;
+        cmoffseti = wideband ? CM_OFFSET_16M_WB : CM_OFFSET_16M_NB ;
+    }
+    else // 64M PRF
+    {
+        table = wideband ? range25cm64PRFwb[chan_idxwb[chan]] : range25cm64PRFnb[chan_idxnb[chan]] ;
+        cmoffseti = wideband ? CM_OFFSET_64M_WB : CM_OFFSET_64M_NB ;
+    }
+
+    // both bins and table are monotonic, so a single merge pass is enough (all tables end in 255 !!!!)
+    int i = 0 ;
+    for (int bin = 0; bin < NUM_RANGE_BINS; bin++)
+    {
+        while (bin > table[i]) i++ ;
+        range_bias_cm[bin] = (int8) (i + cmoffseti) ;
+    }
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * Function: deca_range_bias()
+ *
+ * Description: This function returns the range bias correction for channel/PRF set up by deca_range_bias_init().
+ *
+ * input parameters:
+ * @param range - the calculated distance before correction
+ *
+ * output parameters
+ *
+ * returns correction needed in meters
+ */
+float deca_range_bias(float range)
+{
+    int rangeint25cm = (int) (range * 4.00f) ;      // convert range to integer number of 25cm values.
+
+    if (rangeint25cm < 0) rangeint25cm = 0 ;        // negative ranges hit the first table entry, same as in dwt_getrangebias()
+    if (rangeint25cm >= NUM_RANGE_BINS) rangeint25cm = NUM_RANGE_BINS - 1 ;
+
+    return range_bias_cm[rangeint25cm] * 0.01f ;
+}
+
+/*! ------------------------------------------------------------------------------------------------------------------
+ * Function: deca_range_bias_mm()
+ *
+ * Description: Integer variant of deca_range_bias(), for builds without an FPU.
+ *
+ * input parameters:
+ * @param range_mm - the calculated distance before correction, in millimetres
+ *
+ * output parameters
+ *
+ * returns correction needed in millimetres
+ */
+int deca_range_bias_mm(int range_mm)
+{
+    int rangeint25cm = range_mm / 250 ;             // same bins as deca_range_bias(), truncated towards zero
+
+    if (rangeint25cm < 0) rangeint25cm = 0 ;
+    if (rangeint25cm >= NUM_RANGE_BINS) rangeint25cm = NUM_RANGE_BINS - 1 ;
+
+    return range_bias_cm[rangeint25cm] * 10 ;
+}
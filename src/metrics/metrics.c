@@ -0,0 +1,147 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include <metrics/metrics.h>
+#include <stats/histogram.h>
+
+struct metric_desc {
+    const char *name;
+    bool gauge;
+};
+
+static const struct metric_desc metrics[] = {
+#if defined(CONFIG_HRTLS_TARGET_ANCHOR) || defined(CONFIG_HRTLS_TARGET_TAG)
+    [HRTLS_METRIC_TWR_OK] = { "twr_ok" },
+    [HRTLS_METRIC_TWR_ERR_1] = { "twr_err_1" },
+    [HRTLS_METRIC_TWR_ERR_2] = { "twr_err_2" },
+    [HRTLS_METRIC_TWR_ERR_3] = { "twr_err_3" },
+    [HRTLS_METRIC_TWR_ERR_4] = { "twr_err_4" },
+    [HRTLS_METRIC_TWR_ERR_5] = { "twr_err_5" },
+#endif
+#if defined(CONFIG_HRTLS_TARGET_GW) || defined(CONFIG_HRTLS_TARGET_SIM) || defined(CONFIG_HRTLS_TARGET_TAG)
+    [HRTLS_METRIC_MESH_RX] = { "mesh_rx" },
+#endif
+#if defined(CONFIG_HRTLS_TARGET_TAG)
+    [HRTLS_METRIC_SOLVER_FAIL] = { "solver_fail" },
+    [HRTLS_METRIC_NLOS_REJECTED] = { "nlos_rejected" },
+    [HRTLS_METRIC_LOC_QUEUE_DROPS] = { "loc_queue_drops" },
+    [HRTLS_METRIC_RANGES_QUEUE_DROPS] = { "ranges_queue_drops" },
+    [HRTLS_METRIC_LOC_COALESCED] = { "loc_coalesced" },
+    [HRTLS_METRIC_MESH_TX_FAIL] = { "mesh_tx_fail" },
+    [HRTLS_METRIC_MESH_TX_IN_FLIGHT] = { "mesh_tx_in_flight", true },
+#endif
+#if defined(CONFIG_HRTLS_TARGET_GW) || defined(CONFIG_HRTLS_TARGET_SIM)
+    [HRTLS_METRIC_FIXES_RX] = { "fixes_rx" },
+    [HRTLS_METRIC_RANGES_RX] = { "ranges_rx" },
+    [HRTLS_METRIC_DUPLICATES] = { "duplicates" },
+    [HRTLS_METRIC_SOLVER_FAIL] = { "solver_fail" },
+    [HRTLS_METRIC_TRACKER_QUEUE_DROPS] = { "tracker_queue_drops" },
+    [HRTLS_METRIC_RANGES_QUEUE_DROPS] = { "ranges_queue_drops" },
+    [HRTLS_METRIC_ZONE_EVENT_DROPS] = { "zone_event_drops" },
+    [HRTLS_METRIC_SCHEDULER_DROPS] = { "scheduler_drops" },
+    [HRTLS_METRIC_TRACK_DROPS] = { "track_drops" },
+    [HRTLS_METRIC_PUBLISHES] = { "publishes" },
+    [HRTLS_METRIC_PUBLISH_FAIL] = { "publish_fail" },
+    [HRTLS_METRIC_OFFLINE_STORED] = { "offline_stored" },
+    [HRTLS_METRIC_OFFLINE_DROPS] = { "offline_drops" },
+    [HRTLS_METRIC_MQTT_CONNECTS] = { "mqtt_connects" },
+    [HRTLS_METRIC_MQTT_CONNECTED] = { "mqtt_connected", true },
+#endif
+};
+
+BUILD_ASSERT(ARRAY_SIZE(metrics) == HRTLS_METRICS_COUNT);
+
+// anchors have no histograms, arrays are kept non-empty for them
+static const char *const histogram_names[MAX(HRTLS_METRIC_HISTOGRAMS_COUNT, 1)] = {
+#if defined(CONFIG_HRTLS_TARGET_TAG)
+    [HRTLS_METRIC_SOLVE_US] = "solve_us",
+    [HRTLS_METRIC_WAKEUP_TO_POLL_US] = "wakeup_to_poll_us",
+#endif
+#if defined(CONFIG_HRTLS_TARGET_GW) || defined(CONFIG_HRTLS_TARGET_SIM)
+    [HRTLS_METRIC_MULTILAT_US] = "multilat_us",
+    [HRTLS_METRIC_PUBLISH_BYTES] = "publish_bytes",
+#endif
+};
+
+static atomic_t values[HRTLS_METRICS_COUNT];
+static struct hrtls_histogram histograms[MAX(HRTLS_METRIC_HISTOGRAMS_COUNT, 1)];
+
+void hrtls_metric_inc(enum hrtls_metric metric) {
+    atomic_inc(&values[metric]);
+}
+
+void hrtls_metric_add(enum hrtls_metric metric, uint32_t value) {
+    atomic_add(&values[metric], value);
+}
+
+void hrtls_metric_set(enum hrtls_metric metric, uint32_t value) {
+    atomic_set(&values[metric], value);
+}
+
+uint32_t hrtls_metric_get(enum hrtls_metric metric) {
+    return atomic_get(&values[metric]);
+}
+
+const char *hrtls_metric_name(enum hrtls_metric metric) {
+    return metric < HRTLS_METRICS_COUNT ? metrics[metric].name : "unknown";
+}
+
+void hrtls_metric_record(enum hrtls_metric_histogram histogram, uint32_t value) {
+    hrtls_histogram_record(&histograms[histogram], value);
+}
+
+const char *hrtls_metric_histogram_name(enum hrtls_metric_histogram histogram) {
+    return histogram < HRTLS_METRIC_HISTOGRAMS_COUNT ? histogram_names[histogram] : "unknown";
+}
+
+void hrtls_metrics_reset(void) {
+    for (enum hrtls_metric metric = 0; metric < HRTLS_METRICS_COUNT; metric++) {
+        if (!metrics[metric].gauge) {
+            atomic_set(&values[metric], 0);
+        }
+    }
+    for (enum hrtls_metric_histogram histogram = 0; histogram < HRTLS_METRIC_HISTOGRAMS_COUNT; histogram++) {
+        hrtls_histogram_reset(&histograms[histogram]);
+    }
+}
+
+void hrtls_metrics_print(const struct shell *sh) {
+    for (enum hrtls_metric metric = 0; metric < HRTLS_METRICS_COUNT; metric++) {
+        shell_print(sh, "%-20s %10" PRIu32, metrics[metric].name, hrtls_metric_get(metric));
+    }
+    if (!HRTLS_METRIC_HISTOGRAMS_COUNT) {
+        return;
+    }
+
+    shell_print(sh, "%-20s %10s %10s %10s", "histogram", "count", "p50", "p99");
+    for (enum hrtls_metric_histogram histogram = 0; histogram < HRTLS_METRIC_HISTOGRAMS_COUNT; histogram++) {
+        const struct hrtls_histogram *h = &histograms[histogram];
+        shell_print(sh, "%-20s %10" PRIu32 " %10" PRIu32 " %10" PRIu32, histogram_names[histogram],
+                    hrtls_histogram_count(h), hrtls_histogram_percentile(h, 50), hrtls_histogram_percentile(h, 99));
+    }
+}
+
+int hrtls_metrics_to_json(char *buf, size_t size) {
+    size_t len = snprintf(buf, size, "{");
+    for (enum hrtls_metric metric = 0; metric < HRTLS_METRICS_COUNT; metric++) {
+        len += snprintf(buf + MIN(len, size), size - MIN(len, size), "%s\"%s\":%" PRIu32,
+                        metric ? "," : "", metrics[metric].name, hrtls_metric_get(metric));
+    }
+    for (enum hrtls_metric_histogram histogram = 0; histogram < HRTLS_METRIC_HISTOGRAMS_COUNT; histogram++) {
+        const struct hrtls_histogram *h = &histograms[histogram];
+        len += snprintf(buf + MIN(len, size), size - MIN(len, size),
+                        ",\"%s\":{\"count\":%" PRIu32 ",\"p50\":%" PRIu32 ",\"p99\":%" PRIu32 "}",
+                        histogram_names[histogram], hrtls_histogram_count(h),
+                        hrtls_histogram_percentile(h, 50), hrtls_histogram_percentile(h, 99));
+    }
+    len += snprintf(buf + MIN(len, size), size - MIN(len, size), "}");
+    return len < size ? (int)len : -ENOMEM;
+}
@@ -0,0 +1,58 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include <stats/histogram.h>
+#include <stats/latency.h>
+
+void hrtls_latency_record(const struct hrtls_latency *latency, unsigned stage, uint32_t duration_ms) {
+    hrtls_histogram_record(&latency->histograms[stage], duration_ms);
+}
+
+void hrtls_latency_record_since(const struct hrtls_latency *latency, unsigned stage, uint32_t start_ms) {
+    hrtls_latency_record(latency, stage, k_uptime_get_32() - start_ms);
+}
+
+const char *hrtls_latency_stage_name(const struct hrtls_latency *latency, unsigned stage) {
+    return stage < latency->count ? latency->names[stage] : "unknown";
+}
+
+uint32_t hrtls_latency_count(const struct hrtls_latency *latency, unsigned stage) {
+    return hrtls_histogram_count(&latency->histograms[stage]);
+}
+
+uint32_t hrtls_latency_percentile(const struct hrtls_latency *latency, unsigned stage, unsigned percent) {
+    return hrtls_histogram_percentile(&latency->histograms[stage], percent);
+}
+
+void hrtls_latency_reset(const struct hrtls_latency *latency) {
+    for (unsigned stage = 0; stage < latency->count; stage++) {
+        hrtls_histogram_reset(&latency->histograms[stage]);
+    }
+}
+
+void hrtls_latency_print(const struct hrtls_latency *latency, const struct shell *sh) {
+    shell_print(sh, "%-12s %10s %8s %8s", "stage", "count", "p50 ms", "p99 ms");
+    for (unsigned stage = 0; stage < latency->count; stage++) {
+        shell_print(sh, "%-12s %10" PRIu32 " %8" PRIu32 " %8" PRIu32, latency->names[stage],
+                    hrtls_latency_count(latency, stage), hrtls_latency_percentile(latency, stage, 50),
+                    hrtls_latency_percentile(latency, stage, 99));
+    }
+}
+
+int hrtls_latency_to_json(const struct hrtls_latency *latency, char *buf, size_t size) {
+    size_t len = snprintf(buf, size, "{");
+    for (unsigned stage = 0; stage < latency->count; stage++) {
+        len += snprintf(buf + MIN(len, size), size - MIN(len, size),
+                        "%s\"%s\":{\"count\":%" PRIu32 ",\"p50\":%" PRIu32 ",\"p99\":%" PRIu32 "}",
+                        stage ? "," : "", latency->names[stage], hrtls_latency_count(latency, stage),
+                        hrtls_latency_percentile(latency, stage, 50), hrtls_latency_percentile(latency, stage, 99));
+    }
+    len += snprintf(buf + MIN(len, size), size - MIN(len, size), "}");
+    return len < size ? (int)len : -ENOMEM;
+}
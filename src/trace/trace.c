@@ -0,0 +1,144 @@
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include <trace/trace.h>
+
+#define TRACE_RECORDS CONFIG_HRTLS_TRACE_RECORDS
+BUILD_ASSERT((TRACE_RECORDS & (TRACE_RECORDS - 1)) == 0, "trace buffer size has to be a power of two");
+
+static const char *const event_names[HRTLS_TRACE_EVENTS_COUNT] = {
+    [HRTLS_TRACE_MQTT_EVT] = "mqtt_evt",
+    [HRTLS_TRACE_MQTT_PUBLISH_RX] = "mqtt_publish_rx",
+    [HRTLS_TRACE_MQTT_INPUT] = "mqtt_input",
+    [HRTLS_TRACE_MQTT_POLL] = "mqtt_poll",
+    [HRTLS_TRACE_GW_FIX_RX] = "gw_fix_rx",
+    [HRTLS_TRACE_GW_RANGES_RX] = "gw_ranges_rx",
+    [HRTLS_TRACE_GW_PUBLISH] = "gw_publish",
+    [HRTLS_TRACE_TAG_FIX_TX] = "tag_fix_tx",
+    [HRTLS_TRACE_TAG_RANGES_TX] = "tag_ranges_tx",
+    [HRTLS_TRACE_TAG_POSITION] = "tag_position",
+    [HRTLS_TRACE_TAG_SLEEP] = "tag_sleep",
+    [HRTLS_TRACE_ANCHOR_TWR] = "anchor_twr",
+};
+
+static struct hrtls_trace_record records[TRACE_RECORDS];
+// number of records ever claimed, the next one goes to records[head % TRACE_RECORDS]
+static atomic_t head;
+// position of the shell reader, so that consecutive dumps don't repeat records
+static uint32_t shell_cursor;
+
+const char *hrtls_trace_event_name(enum hrtls_trace_event event) {
+    if (event >= HRTLS_TRACE_EVENTS_COUNT || !event_names[event]) {
+        return "unknown";
+    }
+    return event_names[event];
+}
+
+// lock-free and safe to call from ISRs, writers racing for the same slot
+// a full buffer length apart are the only way to get a torn record,
+// and the reader drops those thanks to seq being invalidated first and written last
+void hrtls_trace(enum hrtls_trace_event event, uint32_t a, uint32_t b, uint32_t c) {
+    uint32_t seq = (uint32_t)atomic_inc(&head);
+    struct hrtls_trace_record *record = &records[seq % TRACE_RECORDS];
+
+    record->seq = 0;
+    compiler_barrier();
+    record->cycles = k_cycle_get_32();
+    record->event = event;
+    record->args[0] = a;
+    record->args[1] = b;
+    record->args[2] = c;
+    compiler_barrier();
+    record->seq = seq + 1;
+}
+
+size_t hrtls_trace_read(uint32_t *cursor, struct hrtls_trace_record *buf, size_t len, uint32_t *lost) {
+    uint32_t end = (uint32_t)atomic_get(&head);
+    uint32_t seq = *cursor;
+    size_t count = 0;
+
+    *lost = 0;
+    if (end - seq > TRACE_RECORDS) {
+        *lost = end - seq - TRACE_RECORDS;
+        seq = end - TRACE_RECORDS;
+    }
+
+    for (; seq != end && count < len; seq++) {
+        const struct hrtls_trace_record *record = &records[seq % TRACE_RECORDS];
+        uint32_t before = record->seq;
+        compiler_barrier();
+        buf[count] = *record;
+        compiler_barrier();
+        uint32_t after = record->seq;
+
+        if (before == seq + 1 && after == seq + 1) {
+            count++;
+        }
+        else if (before == 0 || (int32_t)(before - (seq + 1)) < 0) {
+            // claimed but not written yet, pick it up with the next read
+            break;
+        }
+        else {
+            // overwritten while reading
+            (*lost)++;
+        }
+    }
+
+    *cursor = seq;
+    return count;
+}
+
+#if defined(CONFIG_SHELL)
+static void print_records(const struct shell *sh, uint32_t *cursor) {
+    struct hrtls_trace_record buf[16];
+    uint32_t lost_total = 0;
+    size_t count;
+
+    shell_print(sh, "%10s %-16s %11s %11s %11s", "time us", "event", "a", "b", "c");
+    do {
+        uint32_t lost;
+        count = hrtls_trace_read(cursor, buf, ARRAY_SIZE(buf), &lost);
+        lost_total += lost;
+        for (size_t i = 0; i < count; i++) {
+            const struct hrtls_trace_record *record = &buf[i];
+            shell_print(sh, "%10" PRIu32 " %-16s %11" PRId32 " %11" PRId32 " %11" PRId32,
+                        k_cyc_to_us_floor32(record->cycles), hrtls_trace_event_name(record->event),
+                        (int32_t)record->args[0], (int32_t)record->args[1], (int32_t)record->args[2]);
+        }
+    } while (count == ARRAY_SIZE(buf));
+
+    if (lost_total) {
+        shell_warn(sh, "%" PRIu32 " records overwritten before they were read", lost_total);
+    }
+}
+
+static int cmd_trace_dump(const struct shell *sh, size_t argc, char **argv) {
+    print_records(sh, &shell_cursor);
+    return 0;
+}
+
+static int cmd_trace_all(const struct shell *sh, size_t argc, char **argv) {
+    uint32_t cursor = 0;
+    print_records(sh, &cursor);
+    return 0;
+}
+
+static int cmd_trace_clear(const struct shell *sh, size_t argc, char **argv) {
+    shell_cursor = (uint32_t)atomic_get(&head);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(trace_cmds,
+    SHELL_CMD(dump, NULL, "Print trace records not printed yet", cmd_trace_dump),
+    SHELL_CMD(all, NULL, "Print all trace records still in the buffer", cmd_trace_all),
+    SHELL_CMD(clear, NULL, "Skip trace records recorded so far", cmd_trace_clear),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(trace, &trace_cmds, "Hot path event trace", cmd_trace_dump);
+#endif
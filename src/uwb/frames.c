@@ -0,0 +1,69 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <uwb/frames.h>
+
+#define FUNC_OFFSET (UWB_FRAME_HDR_LEN - 1)
+#define LO_LEN sizeof(uint64_t)
+#define HI_LEN (UWB_FRAME_HDR_LEN - LO_LEN)
+
+static_assert(HI_LEN == sizeof(uint16_t), "header has to split into 64 and 16 bit words");
+
+void uwb_frame_hdr_encode(const struct uwb_frame_hdr *hdr, uint8_t func, uint8_t *buf) {
+    u64_to_buf_le(hdr->fctrl, buf + 0, 2);
+    u64_to_buf_le(hdr->seq, buf + 2, 1);
+    u64_to_buf_le(hdr->pan_id, buf + 3, 2);
+    u64_to_buf_le(hdr->dst, buf + 5, 2);
+    u64_to_buf_le(hdr->src, buf + 7, 2);
+    buf[FUNC_OFFSET] = func;
+}
+
+void uwb_frame_hdr_decode(const uint8_t *buf, struct uwb_frame_hdr *out_hdr) {
+    out_hdr->fctrl = buf_le_to_u64(buf + 0, 2);
+    out_hdr->seq = buf_le_to_u64(buf + 2, 1);
+    out_hdr->pan_id = buf_le_to_u64(buf + 3, 2);
+    out_hdr->dst = buf_le_to_u64(buf + 5, 2);
+    out_hdr->src = buf_le_to_u64(buf + 7, 2);
+}
+
+void uwb_frame_matcher_init(struct uwb_frame_matcher *matcher,
+                            const struct uwb_frame_hdr *expected,
+                            unsigned fields,
+                            uint8_t func) {
+    const struct uwb_frame_hdr mask_hdr = {
+        .fctrl = UINT16_MAX,
+        .seq = (fields & UWB_FRAME_MATCH_SEQ) ? UINT8_MAX : 0,
+        .pan_id = (fields & UWB_FRAME_MATCH_PAN_ID) ? UINT16_MAX : 0,
+        .dst = (fields & UWB_FRAME_MATCH_DST) ? UINT16_MAX : 0,
+        .src = (fields & UWB_FRAME_MATCH_SRC) ? UINT16_MAX : 0
+    };
+
+    uint8_t expected_buf[UWB_FRAME_HDR_LEN];
+    uint8_t mask_buf[UWB_FRAME_HDR_LEN];
+    uwb_frame_hdr_encode(expected, func, expected_buf);
+    uwb_frame_hdr_encode(&mask_hdr, UINT8_MAX, mask_buf);
+
+    // both the frame and the matcher are loaded the same way,
+    // so the comparison doesn't depend on CPU endianness
+    memcpy(&matcher->lo_expected, expected_buf, LO_LEN);
+    memcpy(&matcher->lo_mask, mask_buf, LO_LEN);
+    memcpy(&matcher->hi_expected, expected_buf + LO_LEN, HI_LEN);
+    memcpy(&matcher->hi_mask, mask_buf + LO_LEN, HI_LEN);
+    matcher->lo_expected &= matcher->lo_mask;
+    matcher->hi_expected &= matcher->hi_mask;
+}
+
+int uwb_frame_match(const struct uwb_frame_matcher *matcher, const uint8_t *buf) {
+    uint64_t lo;
+    uint16_t hi;
+    memcpy(&lo, buf, LO_LEN);
+    memcpy(&hi, buf + LO_LEN, HI_LEN);
+
+    if ((lo & matcher->lo_mask) != matcher->lo_expected
+        || (hi & matcher->hi_mask) != matcher->hi_expected) {
+        return -1;
+    }
+    return 0;
+}
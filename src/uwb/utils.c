@@ -8,21 +8,6 @@
 
 #include <uwb/utils.h>
 
-int masked_memcmp(const uint8_t *left,
-                         const uint8_t *right,
-                         const bool *mask,
-                         size_t len) {
-    for (size_t i = 0; i < len; i++) {
-        if (!mask[i]) {
-            continue;
-        }
-        if (left[i] != right[i]) {
-            return -1;
-        }
-    }
-    return 0;
-}
-
 uint64_t buf_le_to_u64(const uint8_t *buf, size_t len) {
     assert(len <= 8);
 
@@ -33,6 +18,14 @@ uint64_t buf_le_to_u64(const uint8_t *buf, size_t len) {
     return res;
 }
 
+void u64_to_buf_le(uint64_t value, uint8_t *buf, size_t len) {
+    assert(len <= 8);
+
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = GET_BYTE(value, i);
+    }
+}
+
 uint32_t wait_for_status(uint32_t mask) {
     uint32_t status_reg;
     do {
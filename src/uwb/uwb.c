@@ -1,17 +1,39 @@
 #include <dw1000/decadriver/deca_device_api.h>
 #include <dw1000/decadriver/deca_regs.h>
+#include <dw1000/platform/deca_range_tables.h>
 #include <dw1000/platform/deca_spi.h>
 #include <dw1000/platform/port.h>
 
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
 #include <zephyr.h>
+#include <zephyr/settings/settings.h>
 
 #include <uwb/uwb.h>
 
 #define INIT_TIMEOUT_MS 2000
 
-// borrowed from decawave samples
-#define TX_ANT_DLY 16436
-#define RX_ANT_DLY 16436
+// RX power estimation constants in 0.01 dB, see DW1000 user manual, section 4.7
+#define RX_POWER_A_PRF16_CDB 11377
+#define RX_POWER_A_PRF64_CDB 12174
+#define RX_POWER_CIR_SCALE_BITS 17
+// difference of total and first path power, above which NLOS is likely
+#define NLOS_POWER_DIFF_LOW_CDB 600
+#define NLOS_POWER_DIFF_HIGH_CDB 1000
+
+// SPI CS has to be held low for at least 500us to wake DW1000 up,
+// 600 bytes at slow rate is comfortably above that
+#define WAKEUP_BUFFER_LEN 600
+
+// borrowed from decawave samples, used if neither settings nor OTP provide one
+#define DEFAULT_ANT_DLY 16436
+// OTP word holding factory calibrated antenna delays, 64MHz PRF in upper half
+#define OTP_ANT_DLY_ADDRESS 0x1C
+
+#define SETTINGS_SUBTREE "hrtls/uwb"
+#define SETTINGS_ANT_DLY_KEY "ant_dly"
 
 static dwt_config_t config_ss = {
     2,               /* Channel number. */
@@ -40,6 +62,49 @@ static dwt_config_t config_ds = {
 };
 
 enum uwb_twr_mode uwb_current_mode = -1;
+static const dwt_config_t *current_config;
+static bool sleeping;
+static uint16_t ant_dly = DEFAULT_ANT_DLY;
+static uint16_t stored_ant_dly;
+// DW1000 datasheet wake up time from DEEPSLEEP, until the first wake up is measured
+#define DEFAULT_WAKEUP_US 3000
+static uint32_t last_wakeup_us = DEFAULT_WAKEUP_US;
+static uint32_t wakeup_start;
+static bool wakeup_elapsed_taken = true;
+
+#if IS_ENABLED(CONFIG_SETTINGS)
+static int settings_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg) {
+    if (strcmp(name, SETTINGS_ANT_DLY_KEY)) {
+        return -ENOENT;
+    }
+    if (len != sizeof(stored_ant_dly)) {
+        return -EINVAL;
+    }
+
+    ssize_t res = read_cb(cb_arg, &stored_ant_dly, sizeof(stored_ant_dly));
+    return res < 0 ? res : 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(hrtls_uwb, SETTINGS_SUBTREE, NULL, settings_set, NULL, NULL);
+#endif
+
+static uint16_t load_antenna_delay(const dwt_config_t *config) {
+    if (IS_ENABLED(CONFIG_SETTINGS)
+        && !settings_subsys_init()
+        && !settings_load_subtree(SETTINGS_SUBTREE)
+        && stored_ant_dly) {
+        return stored_ant_dly;
+    }
+
+    uint32 otp_ant_dly;
+    dwt_otpread(OTP_ANT_DLY_ADDRESS, &otp_ant_dly, 1);
+    uint16_t prf_ant_dly = config->prf == DWT_PRF_16M ? otp_ant_dly & 0xFFFF : otp_ant_dly >> 16;
+    if (prf_ant_dly && prf_ant_dly != 0xFFFF) {
+        return prf_ant_dly;
+    }
+
+    return DEFAULT_ANT_DLY;
+}
 
 static bool try_initalizing(void) {
     reset_DW1000();
@@ -47,6 +112,18 @@ static bool try_initalizing(void) {
     return dwt_initialise(DWT_LOADUCODE) == DWT_SUCCESS;
 }
 
+// settings that aren't restored from AON after deep sleep
+static void apply_volatile_config(void) {
+    static uint8_t eui[] = {'A', 'C', 'K', 'D', 'A', 'T', 'R', 'X'};
+
+    dwt_setrxantennadelay(ant_dly);
+    dwt_settxantennadelay(ant_dly);
+    dwt_setpanid(CONFIG_HRTLS_PAN_ID);
+    dwt_setaddress16(CONFIG_HRTLS_UWB_ADDR);
+    dwt_seteui(eui);
+    dwt_enableframefilter(SYS_CFG_FF_ALL_EN);
+}
+
 int uwb_module_initialize(enum uwb_twr_mode mode) {
     int64_t start = k_uptime_get();
     bool res;
@@ -59,18 +136,139 @@ int uwb_module_initialize(enum uwb_twr_mode mode) {
     if (!res) {
         return -1;
     }
-    static uint8_t eui[] = {'A', 'C', 'K', 'D', 'A', 'T', 'R', 'X'};
+    dwt_config_t *config = mode == UWB_TWR_MODE_SS ? &config_ss : &config_ds;
+
+    // OTP has to be read while SPI still runs at slow rate
+    ant_dly = load_antenna_delay(config);
 
     port_set_dw1000_fastrate();
-    dwt_configure(mode == UWB_TWR_MODE_SS ? &config_ss : &config_ds);
-    dwt_setrxantennadelay(RX_ANT_DLY);
-    dwt_settxantennadelay(TX_ANT_DLY);
-    dwt_setpanid(CONFIG_HRTLS_PAN_ID);
-    dwt_setaddress16(CONFIG_HRTLS_UWB_ADDR);
-    dwt_seteui(eui);
-    dwt_enableframefilter(SYS_CFG_FF_ALL_EN);
+    dwt_configure(config);
+    deca_range_bias_init(config->chan, config->prf);
+    apply_volatile_config();
+
+    if (IS_ENABLED(CONFIG_HRTLS_UWB_DEEP_SLEEP)) {
+        // AON keeps dwt_configure() results, LDE microcode is reloaded
+        // on wake up as requested by dwt_initialise(DWT_LOADUCODE)
+        dwt_configuresleep(DWT_PRESRV_SLEEP | DWT_CONFIG, DWT_WAKE_CS | DWT_SLP_EN);
+    }
 
     uwb_current_mode = mode;
+    current_config = config;
+    sleeping = false;
 
     return 0;
 }
+
+int uwb_sleep(void) {
+    if (!IS_ENABLED(CONFIG_HRTLS_UWB_DEEP_SLEEP)) {
+        return -ENOTSUP;
+    }
+    if (sleeping) {
+        return 0;
+    }
+
+    dwt_entersleep();
+    sleeping = true;
+    return 0;
+}
+
+int uwb_wakeup(void) {
+    if (!sleeping) {
+        return 0;
+    }
+
+    static uint8_t wakeup_buf[WAKEUP_BUFFER_LEN];
+    uint32_t start = k_cycle_get_32();
+
+    port_set_dw1000_slowrate();
+    int res = dwt_spicswakeup(wakeup_buf, sizeof(wakeup_buf));
+    port_set_dw1000_fastrate();
+    if (res != DWT_SUCCESS) {
+        return -1;
+    }
+
+    apply_volatile_config();
+    sleeping = false;
+
+    last_wakeup_us = k_cyc_to_us_ceil32(k_cycle_get_32() - start);
+    wakeup_start = start;
+    wakeup_elapsed_taken = false;
+    return 0;
+}
+
+uint32_t uwb_last_wakeup_us(void) {
+    return last_wakeup_us;
+}
+
+uint32_t uwb_take_wakeup_elapsed_us(void) {
+    if (wakeup_elapsed_taken) {
+        return 0;
+    }
+    wakeup_elapsed_taken = true;
+    return k_cyc_to_us_ceil32(k_cycle_get_32() - wakeup_start);
+}
+
+uint16_t uwb_antenna_delay(void) {
+    return ant_dly;
+}
+
+int uwb_set_antenna_delay(uint16_t new_ant_dly) {
+    ant_dly = new_ant_dly;
+    dwt_setrxantennadelay(ant_dly);
+    dwt_settxantennadelay(ant_dly);
+
+    if (!IS_ENABLED(CONFIG_SETTINGS)) {
+        return -ENOTSUP;
+    }
+
+    stored_ant_dly = ant_dly;
+    return settings_save_one(SETTINGS_SUBTREE "/" SETTINGS_ANT_DLY_KEY, &stored_ant_dly, sizeof(stored_ant_dly));
+}
+
+// 10 * log10(value) in 0.01 dB, value has to be non-zero
+static int32_t centi_db(uint64_t value) {
+    const unsigned exp = 63 - __builtin_clzll(value);
+    // mantissa within [1, 2) in Q15, every squaring yields the next bit of log2
+    uint32_t mantissa = exp >= 15 ? value >> (exp - 15) : value << (15 - exp);
+    int32_t log2_q8 = exp << 8;
+    for (unsigned bit = BIT(7); bit; bit >>= 1) {
+        mantissa = (mantissa * mantissa) >> 15;
+        if (mantissa >= BIT(16)) {
+            mantissa >>= 1;
+            log2_q8 |= bit;
+        }
+    }
+    // 1000 * log10(2) = 301.03
+    return log2_q8 * 30103 / (100 << 8);
+}
+
+void uwb_read_rx_quality(struct uwb_rx_quality *out_quality) {
+    dwt_rxdiag_t diag;
+    dwt_readdiagnostics(&diag);
+
+    const uint64_t fp_pow = (uint64_t)diag.firstPathAmp1 * diag.firstPathAmp1
+        + (uint64_t)diag.firstPathAmp2 * diag.firstPathAmp2
+        + (uint64_t)diag.firstPathAmp3 * diag.firstPathAmp3;
+    const uint64_t cir_pow = (uint64_t)diag.maxGrowthCIR << RX_POWER_CIR_SCALE_BITS;
+    if (!diag.rxPreamCount || !fp_pow || !cir_pow) {
+        *out_quality = (struct uwb_rx_quality) {
+            .fp_power_cdbm = INT16_MIN,
+            .rx_power_cdbm = INT16_MIN,
+            .nlos = UINT8_MAX
+        };
+        return;
+    }
+
+    const int32_t a = current_config->prf == DWT_PRF_16M ? RX_POWER_A_PRF16_CDB : RX_POWER_A_PRF64_CDB;
+    const int32_t n_pow2 = centi_db((uint64_t)diag.rxPreamCount * diag.rxPreamCount);
+    const int32_t fp_power = centi_db(fp_pow) - n_pow2 - a;
+    const int32_t rx_power = centi_db(cir_pow) - n_pow2 - a;
+    out_quality->fp_power_cdbm = CLAMP(fp_power, INT16_MIN, INT16_MAX);
+    out_quality->rx_power_cdbm = CLAMP(rx_power, INT16_MIN, INT16_MAX);
+
+    // with a direct path most of the energy arrives in the first path,
+    // a blocked one leaves it buried under later reflections
+    const int32_t likelihood = (rx_power - fp_power - NLOS_POWER_DIFF_LOW_CDB) * UINT8_MAX
+        / (NLOS_POWER_DIFF_HIGH_CDB - NLOS_POWER_DIFF_LOW_CDB);
+    out_quality->nlos = CLAMP(likelihood, 0, UINT8_MAX);
+}
@@ -0,0 +1,407 @@
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <zephyr/sys/util.h>
+#include <ztest.h>
+
+#include <uwb/twr.h>
+
+#include "rtls/rtls.h"
+
+#define FIXES 1000
+#define AREA_MM 10000
+#define TAG_MIN_Z_MM 500
+#define TAG_MAX_Z_MM 2500
+// ranges are whole mm and the float solver works in single precision m
+#define IDEAL_TOLERANCE_MM 5
+// z is the least constrained axis, it takes most of the noise
+#define NOISE_MM 30
+#define NOISY_TOLERANCE_MM 400
+#define NOISY_RMS_TOLERANCE_MM 100
+#define NLOS_BIAS_MM 800
+#define NLOS_WEIGHT (UINT8_MAX / 20)
+// fixed-point and float solutions of the same fix
+#define FIXED_TOLERANCE_MM 2
+// anchor's reply delay of SS-TWR, as set up by the anchor firmware
+#define TWR_REPLY_TICKS ((330 + 800) * UUS_TO_DWT_TIME)
+// carrier integrator values of clock offsets within about +-30 ppm
+#define TWR_MAX_CARRIER_INTEGRATOR (1 << 15)
+#define TWR_MAX_DISTANCE_MM 100000
+// half a tick of the reply correction and half a mm of the result
+#define TWR_TOLERANCE_MM 2
+#define TWR_MAX_MEAN_ERROR_MM 0.1
+// box of 10 km, its ranges stay below the fixed-point solver's limit of 2^24 mm
+#define LARGEST_SCALE 1000
+#define LARGEST_TOLERANCE_MM (AREA_MM * LARGEST_SCALE / 50000)
+
+// box around the area, corners alternate between two heights
+static const struct rtls_anchor box_anchors[] = {
+    { 0x0100, { 0, 0, 300 } },
+    { 0x0101, { AREA_MM, 0, 3000 } },
+    { 0x0102, { 0, AREA_MM, 3000 } },
+    { 0x0103, { AREA_MM, AREA_MM, 300 } },
+    { 0x0104, { 0, 0, 3000 } },
+    { 0x0105, { AREA_MM, 0, 300 } },
+    { 0x0106, { 0, AREA_MM, 300 } },
+    { 0x0107, { AREA_MM, AREA_MM, 3000 } },
+};
+
+BUILD_ASSERT(ARRAY_SIZE(box_anchors) == RTLS_MAX_MEASUREMENTS);
+
+static uint32_t rand_state;
+
+static uint32_t test_rand(void) {
+    // xorshift32, every test starts from the same seed so failures reproduce
+    uint32_t x = rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rand_state = x;
+    return x;
+}
+
+static int32_t rand_range(int32_t min, int32_t max) {
+    return min + (int32_t)(test_rand() % (uint32_t)(max - min + 1));
+}
+
+static double rand_gaussian(void) {
+    const double u = 1.0 - (test_rand() >> 8) / (double)(1 << 24);
+    const double v = (test_rand() >> 8) / (double)(1 << 24);
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static struct rtls_pos rand_tag_pos(void) {
+    return (struct rtls_pos) {
+        .x = rand_range(0, AREA_MM),
+        .y = rand_range(0, AREA_MM),
+        .z = rand_range(TAG_MIN_Z_MM, TAG_MAX_Z_MM)
+    };
+}
+
+static double distance_mm(const struct rtls_pos *a, const struct rtls_pos *b) {
+    const double dx = (double)a->x - b->x;
+    const double dy = (double)a->y - b->y;
+    const double dz = (double)a->z - b->z;
+    return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+// exact ranges from given anchors, with gaussian noise of given sigma
+static void measure(const struct rtls_anchor anchors[], size_t n, const struct rtls_pos *tag_pos,
+                    double noise_mm, struct rtls_measurement out_measurements[]) {
+    for (size_t i = 0; i < n; i++) {
+        out_measurements[i] = (struct rtls_measurement) {
+            .anchor_pos = anchors[i].pos,
+            .distance = lround(distance_mm(&anchors[i].pos, tag_pos) + rand_gaussian() * noise_mm),
+            .weight = UINT8_MAX
+        };
+    }
+}
+
+static void setup(void) {
+    rand_state = 1;
+}
+
+static void test_select_nearby_anchors(void) {
+    // jittered grid, so that distances rarely tie
+    struct rtls_anchor anchors[64];
+    for (size_t i = 0; i < ARRAY_SIZE(anchors); i++) {
+        anchors[i] = (struct rtls_anchor) {
+            .addr = 0x0100 + i,
+            .pos = {
+                .x = (i % 8) * AREA_MM / 8 + rand_range(-300, 300),
+                .y = (i / 8) * AREA_MM / 8 + rand_range(-300, 300),
+                .z = rand_range(300, 3000)
+            }
+        };
+    }
+
+    for (size_t out_n = RTLS_MIN_MEASUREMENTS; out_n <= RTLS_MAX_MEASUREMENTS; out_n++) {
+        for (int fix = 0; fix < FIXES; fix++) {
+            const struct rtls_pos pos = rand_tag_pos();
+            size_t indices[RTLS_MAX_MEASUREMENTS];
+            zassert_equal(rtls_select_nearby_anchors(anchors, ARRAY_SIZE(anchors), pos, indices, out_n), 0,
+                          "selection failed");
+
+            // sorted by distance, distinct, and no other anchor is nearer than the farthest selected
+            bool selected[ARRAY_SIZE(anchors)] = { false };
+            for (size_t i = 0; i < out_n; i++) {
+                zassert_true(indices[i] < ARRAY_SIZE(anchors), "index %zu out of range", indices[i]);
+                zassert_false(selected[indices[i]], "anchor %zu selected twice", indices[i]);
+                selected[indices[i]] = true;
+                if (i) {
+                    zassert_true(distance_mm(&anchors[indices[i - 1]].pos, &pos)
+                                     <= distance_mm(&anchors[indices[i]].pos, &pos),
+                                 "selection not sorted by distance");
+                }
+            }
+            const double farthest = distance_mm(&anchors[indices[out_n - 1]].pos, &pos);
+            for (size_t i = 0; i < ARRAY_SIZE(anchors); i++) {
+                zassert_true(selected[i] || distance_mm(&anchors[i].pos, &pos) >= farthest,
+                             "anchor %zu nearer than the selected ones", i);
+            }
+        }
+    }
+}
+
+static void test_select_all_anchors(void) {
+    const struct rtls_pos pos = { AREA_MM / 2, AREA_MM / 2, 1000 };
+    size_t indices[RTLS_MAX_MEASUREMENTS];
+    zassert_equal(rtls_select_nearby_anchors(box_anchors, ARRAY_SIZE(box_anchors), pos, indices,
+                                             ARRAY_SIZE(box_anchors)), 0, "selection failed");
+
+    uint32_t seen = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(box_anchors); i++) {
+        seen |= BIT(indices[i]);
+    }
+    zassert_equal(seen, BIT_MASK(ARRAY_SIZE(box_anchors)), "not every anchor selected");
+}
+
+static void check_ideal(size_t n) {
+    for (int fix = 0; fix < FIXES; fix++) {
+        const struct rtls_pos truth = rand_tag_pos();
+        struct rtls_measurement measurements[RTLS_MAX_MEASUREMENTS];
+        measure(box_anchors, n, &truth, 0, measurements);
+
+        struct rtls_result result;
+        zassert_equal(rtls_find_position(measurements, n, &result), 0, "solver failed on fix %d", fix);
+        const double error = distance_mm(&result.pos, &truth);
+        zassert_true(error <= IDEAL_TOLERANCE_MM, "fix %d off by %.1f mm", fix, error);
+    }
+}
+
+static void test_find_position_ideal_min(void) {
+    check_ideal(RTLS_MIN_MEASUREMENTS);
+}
+
+static void test_find_position_ideal_max(void) {
+    check_ideal(RTLS_MAX_MEASUREMENTS);
+}
+
+static void test_find_position_noisy(void) {
+    double error_pow2_sum = 0;
+    for (int fix = 0; fix < FIXES; fix++) {
+        const struct rtls_pos truth = rand_tag_pos();
+        struct rtls_measurement measurements[RTLS_MAX_MEASUREMENTS];
+        measure(box_anchors, RTLS_MAX_MEASUREMENTS, &truth, NOISE_MM, measurements);
+
+        struct rtls_result result;
+        zassert_equal(rtls_find_position(measurements, RTLS_MAX_MEASUREMENTS, &result), 0,
+                      "solver failed on fix %d", fix);
+        const double error = distance_mm(&result.pos, &truth);
+        zassert_true(error <= NOISY_TOLERANCE_MM, "fix %d off by %.1f mm", fix, error);
+        error_pow2_sum += error * error;
+    }
+
+    const double rms = sqrt(error_pow2_sum / FIXES);
+    zassert_true(rms <= NOISY_RMS_TOLERANCE_MM, "RMS error %.1f mm", rms);
+}
+
+static void test_find_position_nlos_weight(void) {
+    // one range through an obstacle, a low weight has to pull the fix back towards the truth
+    double equal_sum = 0;
+    double weighted_sum = 0;
+    for (int fix = 0; fix < FIXES; fix++) {
+        const struct rtls_pos truth = rand_tag_pos();
+        struct rtls_measurement measurements[RTLS_MAX_MEASUREMENTS];
+        measure(box_anchors, RTLS_MAX_MEASUREMENTS, &truth, 0, measurements);
+        const size_t nlos = fix % RTLS_MAX_MEASUREMENTS;
+        measurements[nlos].distance += NLOS_BIAS_MM;
+
+        struct rtls_result equal;
+        zassert_equal(rtls_find_position(measurements, RTLS_MAX_MEASUREMENTS, &equal), 0,
+                      "solver failed on fix %d", fix);
+        measurements[nlos].weight = NLOS_WEIGHT;
+        struct rtls_result weighted;
+        zassert_equal(rtls_find_position(measurements, RTLS_MAX_MEASUREMENTS, &weighted), 0,
+                      "solver failed on fix %d", fix);
+
+        const double equal_error = distance_mm(&equal.pos, &truth);
+        const double weighted_error = distance_mm(&weighted.pos, &truth);
+        zassert_true(weighted_error <= equal_error + IDEAL_TOLERANCE_MM,
+                     "fix %d weighted off by %.1f mm, equal by %.1f mm", fix, weighted_error, equal_error);
+        equal_sum += equal_error;
+        weighted_sum += weighted_error;
+    }
+    zassert_true(weighted_sum * 4 <= equal_sum, "mean error weighted %.1f mm, equal %.1f mm",
+                 weighted_sum / FIXES, equal_sum / FIXES);
+}
+
+static void test_find_position_coplanar(void) {
+    // anchors on the floor can't tell z from -z, the normal equations are singular
+    struct rtls_anchor anchors[RTLS_MAX_MEASUREMENTS];
+    for (size_t i = 0; i < ARRAY_SIZE(anchors); i++) {
+        anchors[i] = box_anchors[i];
+        anchors[i].pos.z = 0;
+    }
+
+    for (size_t n = RTLS_MIN_MEASUREMENTS; n <= RTLS_MAX_MEASUREMENTS; n++) {
+        const struct rtls_pos truth = rand_tag_pos();
+        struct rtls_measurement measurements[RTLS_MAX_MEASUREMENTS];
+        measure(anchors, n, &truth, 0, measurements);
+
+        struct rtls_result result;
+        zassert_equal(rtls_find_position(measurements, n, &result), -EINVAL,
+                      "coplanar anchors solved with %zu measurements", n);
+    }
+}
+
+static void check_fixed_matches_float(size_t n, double noise_mm) {
+    for (int fix = 0; fix < FIXES; fix++) {
+        const struct rtls_pos truth = rand_tag_pos();
+        struct rtls_measurement measurements[RTLS_MAX_MEASUREMENTS];
+        measure(box_anchors, n, &truth, noise_mm, measurements);
+
+        struct rtls_result float_result;
+        struct rtls_result fixed_result;
+        zassert_equal(rtls_find_position(measurements, n, &float_result), 0, "float solver failed on fix %d", fix);
+        zassert_equal(rtls_find_position_fixed(measurements, n, &fixed_result), 0,
+                      "fixed-point solver failed on fix %d", fix);
+
+        const double diff = distance_mm(&fixed_result.pos, &float_result.pos);
+        zassert_true(diff <= FIXED_TOLERANCE_MM, "fix %d differs by %.1f mm", fix, diff);
+        if (!noise_mm) {
+            const double error = distance_mm(&fixed_result.pos, &truth);
+            zassert_true(error <= IDEAL_TOLERANCE_MM, "fix %d off by %.1f mm", fix, error);
+        }
+    }
+}
+
+static void test_find_position_fixed_ideal_min(void) {
+    check_fixed_matches_float(RTLS_MIN_MEASUREMENTS, 0);
+}
+
+static void test_find_position_fixed_ideal_max(void) {
+    check_fixed_matches_float(RTLS_MAX_MEASUREMENTS, 0);
+}
+
+static void test_find_position_fixed_noisy(void) {
+    check_fixed_matches_float(RTLS_MAX_MEASUREMENTS, NOISE_MM);
+}
+
+static void test_find_position_fixed_coplanar(void) {
+    // the fixed-point solver works relative to the first anchor, so any common height is singular
+    static const int32_t heights_mm[] = { 0, 3000 };
+    for (size_t h = 0; h < ARRAY_SIZE(heights_mm); h++) {
+        struct rtls_anchor anchors[RTLS_MAX_MEASUREMENTS];
+        for (size_t i = 0; i < ARRAY_SIZE(anchors); i++) {
+            anchors[i] = box_anchors[i];
+            anchors[i].pos.z = heights_mm[h];
+        }
+
+        for (size_t n = RTLS_MIN_MEASUREMENTS; n <= RTLS_MAX_MEASUREMENTS; n++) {
+            const struct rtls_pos truth = rand_tag_pos();
+            struct rtls_measurement measurements[RTLS_MAX_MEASUREMENTS];
+            measure(anchors, n, &truth, 0, measurements);
+
+            struct rtls_result result;
+            zassert_equal(rtls_find_position_fixed(measurements, n, &result), -EINVAL,
+                          "anchors at %d mm solved with %zu measurements", heights_mm[h], n);
+        }
+    }
+}
+
+static void test_find_position_fixed_out_of_range(void) {
+    const struct rtls_pos truth = { AREA_MM / 2, AREA_MM / 2, 1000 };
+    struct rtls_measurement measurements[RTLS_MAX_MEASUREMENTS];
+    struct rtls_result result;
+
+    // an anchor 2^24 mm away from the first one
+    measure(box_anchors, RTLS_MAX_MEASUREMENTS, &truth, 0, measurements);
+    measurements[1].anchor_pos.x = measurements[0].anchor_pos.x + BIT(24);
+    zassert_equal(rtls_find_position_fixed(measurements, RTLS_MAX_MEASUREMENTS, &result), -ERANGE,
+                  "distant anchor accepted");
+
+    // a range of 2^24 mm
+    measure(box_anchors, RTLS_MAX_MEASUREMENTS, &truth, 0, measurements);
+    measurements[2].distance = BIT(24);
+    zassert_equal(rtls_find_position_fixed(measurements, RTLS_MAX_MEASUREMENTS, &result), -ERANGE,
+                  "long range accepted");
+}
+
+static void test_find_position_fixed_largest(void) {
+    // the whole deployment scaled up to just below the limit, precision is relative to its size
+    struct rtls_anchor anchors[RTLS_MAX_MEASUREMENTS];
+    for (size_t i = 0; i < ARRAY_SIZE(anchors); i++) {
+        anchors[i] = box_anchors[i];
+        anchors[i].pos.x *= LARGEST_SCALE;
+        anchors[i].pos.y *= LARGEST_SCALE;
+        anchors[i].pos.z *= LARGEST_SCALE;
+    }
+
+    for (int fix = 0; fix < FIXES; fix++) {
+        struct rtls_pos truth = rand_tag_pos();
+        truth.x *= LARGEST_SCALE;
+        truth.y *= LARGEST_SCALE;
+        truth.z *= LARGEST_SCALE;
+        struct rtls_measurement measurements[RTLS_MAX_MEASUREMENTS];
+        measure(anchors, RTLS_MAX_MEASUREMENTS, &truth, 0, measurements);
+
+        struct rtls_result result;
+        zassert_equal(rtls_find_position_fixed(measurements, RTLS_MAX_MEASUREMENTS, &result), 0,
+                      "solver failed on fix %d", fix);
+        const double error = distance_mm(&result.pos, &truth);
+        zassert_true(error <= LARGEST_TOLERANCE_MM, "fix %d off by %.1f mm", fix, error);
+    }
+}
+
+// distance of the SS-TWR exchange in mm, as uwb_ss_twr_distance_mm() should give it
+static double twr_exact_mm(uint32_t round_trip, uint32_t reply, int32_t carrier_integrator) {
+    const double reply_tag = reply * (1 + carrier_integrator / (double)BIT(UWB_CARRIER_INTEGRATOR_SHIFT));
+    return (round_trip - reply_tag) * SPEED_OF_LIGHT_M_S / (2.0 * UWB_DWT_TICKS_PER_MS);
+}
+
+static void test_twr_distance_mm(void) {
+    double error_sum = 0;
+    for (int fix = 0; fix < 100 * FIXES; fix++) {
+        const int32_t carrier_integrator = rand_range(-TWR_MAX_CARRIER_INTEGRATOR, TWR_MAX_CARRIER_INTEGRATOR);
+        const uint32_t reply = TWR_REPLY_TICKS;
+        const double distance_mm = rand_range(0, TWR_MAX_DISTANCE_MM);
+        const double reply_tag = reply * (1 + carrier_integrator / (double)BIT(UWB_CARRIER_INTEGRATOR_SHIFT));
+        const uint32_t round_trip = lround(reply_tag + 2 * distance_mm * UWB_DWT_TICKS_PER_MS / SPEED_OF_LIGHT_M_S);
+
+        const double exact = twr_exact_mm(round_trip, reply, carrier_integrator);
+        const double error = uwb_ss_twr_distance_mm(round_trip, reply, carrier_integrator) - exact;
+        zassert_true(fabs(error) <= TWR_TOLERANCE_MM, "%.1f mm off at %.1f mm, carrier integrator %d",
+                     error, exact, carrier_integrator);
+        error_sum += error;
+    }
+
+    // rounding to nearest leaves no bias
+    const double mean_error = error_sum / (100 * FIXES);
+    zassert_true(fabs(mean_error) <= TWR_MAX_MEAN_ERROR_MM, "mean error %.3f mm", mean_error);
+}
+
+static void test_twr_distance_mm_negative(void) {
+    // ranges of nearby anchors can come out negative, they round the same way as positive ones
+    const uint32_t reply = TWR_REPLY_TICKS;
+    for (uint32_t ticks = 0; ticks < 1000; ticks++) {
+        const int32_t ahead = uwb_ss_twr_distance_mm(reply + ticks, reply, 0);
+        const int32_t behind = uwb_ss_twr_distance_mm(reply - ticks, reply, 0);
+        zassert_equal(ahead, -behind, "%d mm ahead, %d mm behind at %u ticks", ahead, behind, ticks);
+        zassert_true(fabs(ahead - twr_exact_mm(reply + ticks, reply, 0)) <= 0.5, "not rounded at %u ticks", ticks);
+    }
+}
+
+void test_main(void) {
+    ztest_test_suite(rtls,
+        ztest_unit_test_setup_teardown(test_select_nearby_anchors, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_select_all_anchors, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_find_position_ideal_min, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_find_position_ideal_max, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_find_position_noisy, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_find_position_nlos_weight, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_find_position_coplanar, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_find_position_fixed_ideal_min, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_find_position_fixed_ideal_max, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_find_position_fixed_noisy, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_find_position_fixed_coplanar, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_find_position_fixed_out_of_range, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_find_position_fixed_largest, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_twr_distance_mm, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_twr_distance_mm_negative, setup, unit_test_noop)
+    );
+    ztest_run_test_suite(rtls);
+}